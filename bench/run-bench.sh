@@ -0,0 +1,170 @@
+#!/bin/sh
+# End to end xrestrict benchmarks against a headless Xorg with virtual uinput tablets.
+#
+# Needs Xorg with the dummy video and libinput input drivers, xinput, xrandr,
+# and permission to start Xorg and write /dev/uinput (usually root).
+#
+# Settings, from the environment:
+#   XRESTRICT      xrestrict binary               (../src/xrestrict)
+#   UINPUT_TABLET  uinput-tablet helper           (./uinput-tablet)
+#   BENCH_DISPLAY  display to start the server on (:99)
+#   DEVICE_COUNTS  numbers of tablets to test     (1 2 4 8 16 32 64)
+#   SCREEN_SIZES   framebuffer sizes to test      (1920x1080 3840x1080 7680x2160)
+#   RUNS           repetitions per measurement    (10)
+#   REPORT         JSON lines output              (bench-report.json)
+#
+# Every report line is one run: mode, screen size, CRTC count, device count,
+# and xrestrict's own --trace totals (wall_ms, requests, round_trips).
+# For interactive-identity, wall_ms excludes the time spent waiting for the click.
+# The script and profile modes compare switching every device with one xrestrict
+# per device against a single --profile; their wall_ms is measured around the
+# processes, so it includes process startup, and they report no request counts.
+
+set -u
+
+here=$(cd "$(dirname "$0")" && pwd)
+XRESTRICT=${XRESTRICT:-$here/../src/xrestrict}
+UINPUT_TABLET=${UINPUT_TABLET:-$here/uinput-tablet}
+BENCH_DISPLAY=${BENCH_DISPLAY:-:99}
+DEVICE_COUNTS=${DEVICE_COUNTS:-1 2 4 8 16 32 64}
+SCREEN_SIZES=${SCREEN_SIZES:-1920x1080 3840x1080 7680x2160}
+RUNS=${RUNS:-10}
+REPORT=${REPORT:-bench-report.json}
+
+work=$(mktemp -d)
+server_pid=
+tablet_pid=
+
+cleanup() {
+	exec 3>&- 2>/dev/null
+	[ -n "$tablet_pid" ] && kill "$tablet_pid" 2>/dev/null
+	[ -n "$server_pid" ] && kill "$server_pid" 2>/dev/null
+	wait 2>/dev/null
+	rm -rf "$work"
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+fail() {
+	echo "$*" >&2
+	exit 1
+}
+
+# Extracts a top level number from the first line of a --trace summary
+trace_total() {
+	head -n 1 "$1" | sed -n "s/.*\"$2\": \([0-9.]*\).*/\1/p"
+}
+
+trace_phase_wall() {
+	sed -n "s/.*\"name\": \"$2\".*\"wall_ms\": \([0-9.]*\).*/\1/p" "$1" | head -n 1
+}
+
+record() {
+	# mode size crtcs devices run trace_file [excluded_phase]
+	wall=$(trace_total "$6" wall_ms)
+	requests=$(trace_total "$6" requests)
+	round_trips=$(trace_total "$6" round_trips)
+	[ -n "$wall" ] || { echo "run failed: $1 $2 $4 devices" >&2; return; }
+	if [ $# -ge 7 ]; then
+		excluded=$(trace_phase_wall "$6" "$7")
+		wall=$(echo "$wall ${excluded:-0}" | awk '{ printf "%.3f", $1 - $2 }')
+	fi
+	printf '{"mode": "%s", "screen": "%s", "crtcs": %s, "devices": %s, "run": %s, "wall_ms": %s, "requests": %s, "round_trips": %s}\n' \
+		"$1" "$2" "$3" "$4" "$5" "$wall" "$requests" "$round_trips" >> "$REPORT"
+}
+
+now_ms() {
+	date +%s%N | awk '{ printf "%.3f", $1 / 1e6 }'
+}
+
+record_process() {
+	# mode size crtcs devices run start_ms
+	wall=$(echo "$(now_ms) $6" | awk '{ printf "%.3f", $1 - $2 }')
+	printf '{"mode": "%s", "screen": "%s", "crtcs": %s, "devices": %s, "run": %s, "wall_ms": %s, "requests": null, "round_trips": null}\n' \
+		"$1" "$2" "$3" "$4" "$5" "$wall" >> "$REPORT"
+}
+
+[ -x "$XRESTRICT" ] || fail "xrestrict not found at $XRESTRICT, run make first."
+[ -x "$UINPUT_TABLET" ] || fail "uinput-tablet not found at $UINPUT_TABLET, run make bench."
+
+Xorg "$BENCH_DISPLAY" -config "$here/xorg-dummy.conf" -noreset -nolisten tcp \
+	-logfile "$work/Xorg.log" >/dev/null 2>&1 &
+server_pid=$!
+export DISPLAY="$BENCH_DISPLAY"
+
+tries=0
+until xrandr >/dev/null 2>&1; do
+	tries=$((tries + 1))
+	[ $tries -lt 50 ] || fail "Xorg did not start, see $work/Xorg.log."
+	sleep 0.1
+done
+
+: > "$REPORT"
+
+for devices in $DEVICE_COUNTS; do
+	mkfifo "$work/tablet.in"
+	"$UINPUT_TABLET" "$devices" < "$work/tablet.in" > "$work/tablet.out" &
+	tablet_pid=$!
+	exec 3> "$work/tablet.in"
+
+	ids=
+	last=$((devices - 1))
+	tries=0
+	until xinput list --id-only "xrestrict bench tablet $last" >/dev/null 2>&1; do
+		tries=$((tries + 1))
+		[ $tries -lt 100 ] || fail "uinput tablets did not appear in the X server."
+		sleep 0.1
+	done
+	for i in $(seq 0 $last); do
+		ids="$ids $(xinput list --id-only "xrestrict bench tablet $i")"
+	done
+	first=$(echo $ids | cut -d ' ' -f 1)
+	batch=$(for id in $ids; do printf -- '-d %s ' "$id"; done)
+
+	mkdir -p "$work/config/xrestrict"
+	{ echo "[bench]"; for id in $ids; do echo "-d $id -c 0"; done; } > "$work/config/xrestrict/profiles"
+
+	for size in $SCREEN_SIZES; do
+		xrandr --fb "$size" >/dev/null 2>&1
+		crtcs=$(xrandr --listactivemonitors | sed -n 's/^Monitors: \([0-9]*\)/\1/p')
+		# Leave a layout cache and compiled profiles behind for the cached runs
+		"$XRESTRICT" -d "$first" > /dev/null 2>&1
+		XDG_CONFIG_HOME="$work/config" "$XRESTRICT" --profile bench > /dev/null 2>&1
+
+		for run in $(seq 1 "$RUNS"); do
+			"$XRESTRICT" --trace --no-cache -d "$first" -c 0 2> "$work/trace"
+			record single "$size" "$crtcs" "$devices" "$run" "$work/trace"
+
+			"$XRESTRICT" --trace -d "$first" -c 0 2> "$work/trace"
+			record single-cached "$size" "$crtcs" "$devices" "$run" "$work/trace"
+
+			"$XRESTRICT" --trace --no-cache $batch > /dev/null 2> "$work/trace"
+			record multi "$size" "$crtcs" "$devices" "$run" "$work/trace"
+
+			start=$(now_ms)
+			for id in $ids; do
+				"$XRESTRICT" -d "$id" -c 0 > /dev/null 2>&1
+			done
+			record_process script "$size" "$crtcs" "$devices" "$run" "$start"
+
+			start=$(now_ms)
+			XDG_CONFIG_HOME="$work/config" "$XRESTRICT" --profile bench > /dev/null 2>&1
+			record_process profile "$size" "$crtcs" "$devices" "$run" "$start"
+
+			"$XRESTRICT" --trace --no-cache -I > /dev/null 2> "$work/trace" &
+			xrestrict_pid=$!
+			sleep 0.3
+			echo "click 0 100 100" >&3
+			wait $xrestrict_pid
+			record interactive-identity "$size" "$crtcs" "$devices" "$run" "$work/trace" interactive_click
+		done
+	done
+
+	echo quit >&3
+	exec 3>&-
+	wait "$tablet_pid" 2>/dev/null
+	tablet_pid=
+	rm -f "$work/tablet.in"
+done
+
+echo "Wrote $(wc -l < "$REPORT") measurements to $REPORT."
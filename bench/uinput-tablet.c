@@ -0,0 +1,125 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/uinput.h>
+
+// Creates virtual absolute pointers for benchmarking, then follows commands on stdin:
+//     click INDEX X Y    touch device INDEX at device coordinates X, Y and release
+//     quit               destroy the devices and exit (as does end of input)
+
+#define TABLET_MAX   32767
+#define TABLET_RES   100 // units per mm
+#define MAX_TABLETS  256
+
+static int emit(int fd, int type, int code, int value) {
+	struct input_event event;
+	memset(&event, 0, sizeof(event));
+	event.type = type;
+	event.code = code;
+	event.value = value;
+	return write(fd, &event, sizeof(event)) == sizeof(event) ? 0 : -1;
+}
+
+static int tablet_create(int index) {
+	int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+	if (fd < 0) {
+		return -1;
+	}
+
+	ioctl(fd, UI_SET_EVBIT, EV_KEY);
+	ioctl(fd, UI_SET_KEYBIT, BTN_TOUCH);
+	ioctl(fd, UI_SET_KEYBIT, BTN_TOOL_PEN);
+	ioctl(fd, UI_SET_KEYBIT, BTN_LEFT);
+	ioctl(fd, UI_SET_EVBIT, EV_ABS);
+	ioctl(fd, UI_SET_ABSBIT, ABS_X);
+	ioctl(fd, UI_SET_ABSBIT, ABS_Y);
+	ioctl(fd, UI_SET_PROPBIT, INPUT_PROP_DIRECT);
+
+	struct uinput_user_dev device;
+	memset(&device, 0, sizeof(device));
+	snprintf(device.name, UINPUT_MAX_NAME_SIZE, "xrestrict bench tablet %d", index);
+	device.id.bustype = BUS_VIRTUAL;
+	device.id.vendor = 0x1209;
+	device.id.product = 0x0001;
+	device.id.version = index;
+	device.absmax[ABS_X] = TABLET_MAX;
+	device.absmax[ABS_Y] = TABLET_MAX;
+
+	if (write(fd, &device, sizeof(device)) != sizeof(device)) {
+		close(fd);
+		return -1;
+	}
+
+	struct uinput_abs_setup resolution;
+	memset(&resolution, 0, sizeof(resolution));
+	resolution.absinfo.maximum = TABLET_MAX;
+	resolution.absinfo.resolution = TABLET_RES;
+	resolution.code = ABS_X;
+	ioctl(fd, UI_ABS_SETUP, &resolution);
+	resolution.code = ABS_Y;
+	ioctl(fd, UI_ABS_SETUP, &resolution);
+
+	if (ioctl(fd, UI_DEV_CREATE) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int tablet_click(int fd, int x, int y) {
+	return emit(fd, EV_ABS, ABS_X, x) || emit(fd, EV_ABS, ABS_Y, y) ||
+		emit(fd, EV_KEY, BTN_TOOL_PEN, 1) || emit(fd, EV_KEY, BTN_TOUCH, 1) ||
+		emit(fd, EV_SYN, SYN_REPORT, 0) ||
+		emit(fd, EV_KEY, BTN_TOUCH, 0) || emit(fd, EV_KEY, BTN_TOOL_PEN, 0) ||
+		emit(fd, EV_SYN, SYN_REPORT, 0);
+}
+
+int main(int argc, char ** argv) {
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s COUNT\n", argv[0]);
+		return -1;
+	}
+
+	int count = atoi(argv[1]);
+	if (count < 1 || count > MAX_TABLETS) {
+		fprintf(stderr, "COUNT must be between 1 and %d.\n", MAX_TABLETS);
+		return -1;
+	}
+
+	int tablets[MAX_TABLETS];
+	for (int i = 0; i < count; i++) {
+		tablets[i] = tablet_create(i);
+		if (tablets[i] < 0) {
+			fprintf(stderr, "Failed to create uinput device %d.\n", i);
+			for (i--; i >= 0; i--) {
+				ioctl(tablets[i], UI_DEV_DESTROY);
+				close(tablets[i]);
+			}
+			return -1;
+		}
+	}
+
+	printf("ready\n");
+	fflush(stdout);
+
+	char line[256];
+	while (fgets(line, sizeof(line), stdin)) {
+		int index, x, y;
+		if (sscanf(line, "click %d %d %d", &index, &x, &y) == 3 && index >= 0 && index < count) {
+			if (tablet_click(tablets[index], x, y)) {
+				fprintf(stderr, "Failed to click device %d.\n", index);
+			}
+		} else if (strncmp(line, "quit", 4) == 0) {
+			break;
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+		ioctl(tablets[i], UI_DEV_DESTROY);
+		close(tablets[i]);
+	}
+	return 0;
+}
@@ -0,0 +1,750 @@
+#ifdef HAVE_CONFIG_H
+#	include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/XInput2.h>
+#include <X11/extensions/Xrandr.h>
+
+#include "apply.h"
+#include "cache.h"
+#include "trace.h"
+#if USE_XCB
+#	include "xcb_io.h"
+#endif
+
+void calc_matrix(const XID deviceid, const CTMConfiguration * config, Rectangle * screen_size, const CRTCRegion * crtc, const Rectangle * input_region, float * matrix) {
+	Rectangle scaled, aligned;
+
+	rectangle_scale_preserve_aspect(&(crtc->region), input_region, config->type, &scaled);
+
+	rectangle_align(&(crtc->region), &scaled, &config->affinity, &aligned);
+
+	calculate_coordinate_transform_matrix(&aligned, screen_size, matrix);
+}
+
+static int topology_reserve(Topology * topology, const int region_count) {
+	if (region_count <= topology->region_capacity) {
+		return 0;
+	}
+
+	CRTCRegion * regions = realloc(topology->regions, region_count * sizeof(*regions));
+	if (!regions) {
+		return ETOPOLOGY_ALLOCATION_FAILED;
+	}
+
+	topology->regions = regions;
+	topology->region_capacity = region_count;
+	return 0;
+}
+
+static int topology_index(Topology * topology) {
+	crtc_index_free(&topology->index);
+	if (crtc_index_build(&topology->index, topology->regions, topology->region_count)) {
+		return ETOPOLOGY_ALLOCATION_FAILED;
+	}
+	return 0;
+}
+
+int topology_query(Display * display, Topology * topology) {
+	xlib_find_screen_size(display, &(topology->screen_size.region));
+
+	trace_begin("screen_resources");
+	XRRScreenResources * resources = XRRGetScreenResourcesCurrent(display, DefaultRootWindow(display));
+	trace_end();
+
+	if (!resources) {
+		return ERESOURCES_REQUEST_FAILED;
+	}
+
+	// Every region comes from a distinct CRTC
+	if (topology_reserve(topology, resources->ncrtc)) {
+		XRRFreeScreenResources(resources);
+		return ETOPOLOGY_ALLOCATION_FAILED;
+	}
+
+	CacheKey key;
+	char path[4096];
+	bool cacheable = topology->use_cache && !cache_path(display, path, sizeof(path));
+
+	if (cacheable) {
+		cache_key_from_resources(resources, &(topology->screen_size.region), &key);
+
+		trace_begin("topology_cache");
+		int cached_count = cache_load(path, &key, topology->regions, topology->region_capacity);
+		trace_end();
+		if (cached_count >= 0) {
+			XRRFreeScreenResources(resources);
+			topology->region_count = cached_count;
+			return topology_index(topology);
+		}
+	}
+
+	trace_begin("crtc_regions");
+#	if USE_XCB
+		int region_count = xcbio_get_crtc_regions(display, resources, topology->regions, topology->region_capacity);
+#	else
+		int region_count = xlib_get_crtc_regions(display, resources, topology->regions, topology->region_capacity);
+#	endif
+	trace_end();
+	XRRFreeScreenResources(resources);
+
+	if (region_count < 0) {
+		topology->region_count = 0;
+		return ECRTC_REGIONS_FAILED;
+	}
+
+	if (cacheable) {
+		// Failing to save only costs the next run some round trips
+		cache_store(path, &key, topology->regions, region_count);
+	}
+
+	topology->region_count = region_count;
+	return topology_index(topology);
+}
+
+void topology_free(Topology * topology) {
+	crtc_index_free(&topology->index);
+	free(topology->regions);
+	topology->regions = NULL;
+	topology->region_count = topology->region_capacity = 0;
+}
+
+int topology_find_output(Display * display, XRRScreenResources * resources, const Topology * topology, const char * name) {
+	const size_t length = strlen(name);
+
+	for (int i = 0; i < topology->region_count; i++) {
+		XRROutputInfo * info = XRRGetOutputInfo(display, resources, topology->regions[i].output);
+		if (!info) {
+			continue;
+		}
+
+		bool found = (size_t)info->nameLen == length && memcmp(info->name, name, length) == 0;
+		XRRFreeOutputInfo(info);
+		if (found) {
+			return i;
+		}
+	}
+
+	return ETARGET_OUTPUT_NOT_FOUND;
+}
+
+int device_state_from_info(Display * display, XIDeviceInfo * info, DeviceState * state) {
+	if (xi2_device_info_find_xy_valuators(display, info, &state->valuators)) {
+		return EDEVICE_NO_VALUATORS;
+	}
+
+	if (xi2_device_get_region(info, &state->valuators, &state->region)) {
+		return EDEVICE_NO_REGION;
+	}
+
+	state->id = info->deviceid;
+	strncpy(state->name, info->name, MAX_DEVICE_NAME - 1);
+	state->name[MAX_DEVICE_NAME - 1] = '\0';
+	state->valid = true;
+	state->matrix_known = false;
+	state->watched = false;
+	state->inputs.known = false;
+	return 0;
+}
+
+int device_state_query(Display * display, const XID id, DeviceState * state) {
+	int device_count;
+	state->valid = false;
+
+	trace_begin("query_devices");
+	XIDeviceInfo * info = XIQueryDevice(display, id, &device_count);
+	trace_end();
+	if (!info) {
+		return EDEVICE_NOT_FOUND;
+	}
+
+	int result = device_state_from_info(display, info, state);
+	XIFreeDeviceInfo(info);
+	return result;
+}
+
+static bool device_state_held(const DeviceState * held, const int held_count, const XID id) {
+	for (int i = 0; i < held_count; i++) {
+		if (held[i].valid && held[i].id == id) {
+			return true;
+		}
+	}
+	return false;
+}
+
+int device_state_find_by_name(Display * display, const char * name, const DeviceState * held, const int held_count, DeviceState * state) {
+	int device_count;
+	int result = EDEVICE_NOT_FOUND;
+	state->valid = false;
+
+	trace_begin("query_devices");
+	XIDeviceInfo * info = XIQueryDevice(display, XIAllDevices, &device_count);
+	trace_end();
+	if (!info) {
+		return EDEVICE_NOT_FOUND;
+	}
+
+	const XIDeviceInfo * info_end = info + device_count;
+	for (XIDeviceInfo * device = info; device < info_end; device++) {
+		if ((device->use == XISlavePointer || device->use == XIFloatingSlave) && strncmp(device->name, name, MAX_DEVICE_NAME - 1) == 0 &&
+			!device_state_held(held, held_count, device->deviceid)) {
+			result = device_state_from_info(display, device, state);
+			if (!result) {
+				break;
+			}
+		}
+	}
+
+	XIFreeDeviceInfo(info);
+	return result;
+}
+
+int device_states_query(Display * display, const Target * targets, DeviceState * states, int * results, const int count) {
+	int failures = 0;
+
+	if (count == 1) {
+		results[0] = device_state_query(display, targets[0].device_id, states);
+		return results[0] ? 1 : 0;
+	}
+
+	int device_count = 0;
+	trace_begin("query_devices");
+	XIDeviceInfo * info = XIQueryDevice(display, XIAllDevices, &device_count);
+	trace_end();
+	const XIDeviceInfo * info_end = info + device_count;
+
+	for (int i = 0; i < count; i++) {
+		states[i].valid = false;
+		results[i] = EDEVICE_NOT_FOUND;
+
+		for (XIDeviceInfo * device = info; device < info_end; device++) {
+			if (device->deviceid == targets[i].device_id) {
+				results[i] = device_state_from_info(display, device, states + i);
+				break;
+			}
+		}
+
+		if (results[i]) {
+			failures++;
+		}
+	}
+
+	if (info) {
+		XIFreeDeviceInfo(info);
+	}
+	return failures;
+}
+
+int target_compute_matrix(Display * display, XRRScreenResources * resources, Topology * topology, const Target * target, const DeviceState * state, float * matrix) {
+	if (target->crtc_index >= topology->region_count) {
+		return ETARGET_CRTC_OUT_OF_RANGE;
+	}
+
+	CRTCRegion * region;
+	Rectangle input_region = state->region.region;
+	if (target->full_screen) {
+		region = &topology->screen_size;
+	} else {
+		region = topology->regions + target->crtc_index;
+
+		if (target->one_to_one) {
+			// The xcb path already knows output sizes from the topology query
+			if (region->width <= 0 || region->height <= 0) {
+				if (!resources || xlib_get_crtc_output_density(display, resources, region)) {
+					return ETARGET_OUTPUT_DENSITY;
+				}
+			}
+
+			if (region->width <= 0 || region->height <= 0 || state->region.hres <= 0 || state->region.vres <= 0) {
+				return ETARGET_OUTPUT_DENSITY;
+			}
+
+			input_region = region->region;
+
+			input_region.right = input_region.left + 1000L * RECT_WIDTH(region->region) * RECT_WIDTH(state->region.region) / state->region.hres / region->width;
+			input_region.bottom = input_region.top + 1000L * RECT_HEIGHT(region->region) * RECT_HEIGHT(state->region.region) / state->region.vres / region->height;
+		}
+	}
+
+	calc_matrix(state->id, &target->config, &(topology->screen_size.region), region, &input_region, matrix);
+	return 0;
+}
+
+int target_find_region(Display * display, Topology * topology, const Target * target, Rectangle * region) {
+	int crtc_index = target->crtc_index;
+
+	if (target->full_screen) {
+		*region = topology->screen_size.region;
+		return 0;
+	}
+
+	if (target->output[0]) {
+		XRRScreenResources * resources = XRRGetScreenResourcesCurrent(display, DefaultRootWindow(display));
+		crtc_index = resources ? topology_find_output(display, resources, topology, target->output) : -1;
+		if (resources) {
+			XRRFreeScreenResources(resources);
+		}
+		if (crtc_index < 0) {
+			return ETARGET_OUTPUT_NOT_FOUND;
+		}
+	}
+
+	if (crtc_index < 0 || crtc_index >= topology->region_count) {
+		return ETARGET_CRTC_OUT_OF_RANGE;
+	}
+	*region = topology->regions[crtc_index].region;
+	return 0;
+}
+
+static bool target_rectangles_equal(const Rectangle * a, const Rectangle * b) {
+	return a->left == b->left && a->top == b->top && a->right == b->right && a->bottom == b->bottom;
+}
+
+bool target_affected(const Topology * topology, const Target * target, const DeviceState * state) {
+	const MatrixInputs * inputs = &state->inputs;
+
+	// Another client may have overwritten the matrix, which needs putting back whatever changed
+	if (!inputs->known || !state->matrix_known || !target_rectangles_equal(&inputs->screen, &topology->screen_size.region)) {
+		return true;
+	}
+
+	const CRTCRegion * region = NULL;
+	if (target->full_screen) {
+		region = &topology->screen_size;
+	} else if (target->output[0]) {
+		// Outputs keep their XID for as long as the server runs, so no name lookup is needed
+		for (int i = 0; i < topology->region_count && !region; i++) {
+			if (topology->regions[i].output == inputs->region.output) {
+				region = topology->regions + i;
+			}
+		}
+	} else if (target->crtc_index < topology->region_count) {
+		region = topology->regions + target->crtc_index;
+	}
+
+	if (!region || region->crtc != inputs->region.crtc || region->output != inputs->region.output ||
+		!target_rectangles_equal(&region->region, &inputs->region.region)) {
+		return true;
+	}
+
+	// Output sizes which haven't been queried yet can't be compared
+	return target->one_to_one && !target->full_screen &&
+		(region->width != inputs->region.width || region->height != inputs->region.height);
+}
+
+void device_states_property_changed(Display * display, DeviceState * states, const int count, const XIPropertyEvent * event) {
+	Atom atoms[2];
+
+	if (xi2_matrix_atoms(display, atoms) || event->property != atoms[0]) {
+		return;
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (states[i].id == (XID)event->deviceid) {
+			states[i].matrix_known = false;
+		}
+	}
+}
+
+static Bool target_is_property_event(Display * display, XEvent * event, XPointer argument) {
+	// XInput is the only extension whose generic events are selected, so the opcode needn't be checked
+	return event->xcookie.type == GenericEvent && event->xcookie.evtype == XI_PropertyEvent;
+}
+
+// Every XI_PropertyEvent a write caused has arrived by the time the XSync after it returns. The first event
+// for a written device at or after the serial of its write is that write's, anything else is another client's.
+// Events about devices outside the batch are put back for whoever keeps track of those devices.
+static void target_confirm_writes(Display * display, const Atom matrix_atom, DeviceState * states, float (*matrices)[9], bool * written, const unsigned long * serials, const int count) {
+	XEvent event;
+	XEvent * others = NULL;
+	int other_count = 0, other_capacity = 0;
+
+	while (XCheckIfEvent(display, &event, target_is_property_event, NULL)) {
+		XGenericEventCookie * cookie = &event.xcookie;
+		if (!XGetEventData(display, cookie)) {
+			continue;
+		}
+
+		const XIPropertyEvent * property = cookie->data;
+		bool ours = false;
+		for (int i = 0; i < count; i++) {
+			if (states[i].id != (XID)property->deviceid) {
+				continue;
+			}
+			ours = true;
+
+			if (property->property != matrix_atom) {
+				continue;
+			} else if (written[i] && property->serial >= serials[i] && property->what != XIPropertyDeleted) {
+				memcpy(states[i].matrix, matrices[i], sizeof(states[i].matrix));
+				states[i].matrix_known = true;
+				written[i] = false;
+			} else {
+				states[i].matrix_known = false;
+			}
+		}
+
+		if (!ours && other_count >= other_capacity) {
+			int capacity = other_capacity ? other_capacity * 2 : 8;
+			XEvent * grown = realloc(others, capacity * sizeof(*others));
+			if (grown) {
+				others = grown;
+				other_capacity = capacity;
+			}
+		}
+		if (!ours && other_count < other_capacity) {
+			others[other_count++] = event;
+		} else {
+			XFreeEventData(display, cookie);
+		}
+	}
+
+	// XPutBackEvent puts events at the head of the queue, so the last one goes back first
+	for (int i = other_count - 1; i >= 0; i--) {
+		XPutBackEvent(display, others + i);
+		XFreeEventData(display, &others[i].xcookie);
+	}
+	free(others);
+}
+
+int target_write_batch(Display * display, DeviceState * states, float (*matrices)[9], int * results, const int count) {
+	unsigned long * serials = calloc(count + 1, sizeof(*serials));
+	bool * written = calloc(count ? count : 1, sizeof(*written));
+	XID * unwatched = calloc(count ? count : 1, sizeof(*unwatched));
+	int failures = 0, write_count = 0, unwatched_count = 0;
+	Atom atoms[2];
+
+	if (!serials || !written || !unwatched || xi2_matrix_atoms(display, atoms)) {
+		for (int i = 0; i < count; i++) {
+			results[i] = ETARGET_SET_FAILED;
+		}
+		failures = count;
+		goto done;
+	}
+
+	// Once a device is watched, a write which its known matrix already matches costs no request at all
+	for (int i = 0; i < count; i++) {
+		if (results[i]) {
+			continue;
+		}
+		if (!states[i].watched) {
+			unwatched[unwatched_count++] = states[i].id;
+			states[i].watched = true;
+		}
+		if (!states[i].matrix_known || !xi2_matrix_equal(states[i].matrix, matrices[i])) {
+			written[i] = true;
+			write_count++;
+		}
+	}
+
+	// Watching a device takes a round trip, but only once for as long as it stays plugged in
+	if (write_count || unwatched_count) {
+		XErrorTrap trap;
+		trace_begin("write_matrices");
+		xlib_error_trap_push(display, &trap);
+
+		if (unwatched_count) {
+			xi2_select_property_events(display, unwatched, unwatched_count);
+		}
+
+		// Issue every write without waiting on replies, errors are matched up by serial afterwards
+		for (int i = 0; i < count; i++) {
+			serials[i] = NextRequest(display);
+			if (written[i]) {
+				states[i].matrix_known = false;
+				xi2_device_set_matrix(display, states[i].id, matrices[i]);
+			}
+		}
+		serials[count] = NextRequest(display);
+		trace_end();
+
+		trace_begin("verify_matrices");
+		xlib_error_trap_pop(display, &trap);
+		target_confirm_writes(display, atoms[0], states, matrices, written, serials, count);
+		trace_end();
+
+		for (int i = 0; i < count; i++) {
+			if (!results[i] && xlib_error_trap_find(&trap, serials[i], serials[i + 1]) != Success) {
+				results[i] = ETARGET_SET_FAILED;
+				states[i].matrix_known = false;
+			}
+		}
+		xlib_error_trap_free(&trap);
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (results[i] == ETARGET_SET_FAILED) {
+			fprintf(stderr, "Failed to set Coordinate Transformation Matrix for device %lu.\n", states[i].id);
+		}
+		if (results[i]) {
+			failures++;
+		}
+	}
+
+done:
+	free(serials);
+	free(written);
+	free(unwatched);
+	return failures;
+}
+
+// Reads the current matrix of every device whose results entry is 0
+static void target_read_batch(Display * display, const DeviceState * states, float (*matrices)[9], int * results, const int count) {
+	trace_begin("read_matrices");
+#	if USE_XCB
+		XID * ids = malloc(count * sizeof(*ids));
+		int * read_results = malloc(count * sizeof(*read_results));
+		if (ids && read_results) {
+			for (int i = 0; i < count; i++) {
+				ids[i] = states[i].id;
+			}
+			xcbio_devices_get_matrix(display, ids, matrices, read_results, count);
+		}
+		for (int i = 0; i < count; i++) {
+			if (!results[i] && (!ids || !read_results || read_results[i])) {
+				results[i] = ETARGET_READ_FAILED;
+			}
+		}
+		free(ids);
+		free(read_results);
+#	else
+		for (int i = 0; i < count; i++) {
+			if (!results[i] && xi2_device_get_matrix(display, states[i].id, matrices[i])) {
+				results[i] = ETARGET_READ_FAILED;
+			}
+		}
+#	endif
+	trace_end();
+}
+
+#if USE_XCB
+// Reads every unknown matrix with one round trip, so that writes they already match can be skipped.
+// Without XCB each read is its own round trip, which would cost more than the writes it saves.
+static void target_learn_matrices(Display * display, DeviceState * states, const int * results, const int count) {
+	float (*current)[9] = calloc(count ? count : 1, sizeof(*current));
+	int * read_results = calloc(count ? count : 1, sizeof(*read_results));
+	bool unknown = false;
+
+	for (int i = 0; current && read_results && i < count; i++) {
+		read_results[i] = results[i] || states[i].matrix_known ? ETARGET_READ_FAILED : 0;
+		unknown = unknown || !read_results[i];
+	}
+
+	if (unknown) {
+		target_read_batch(display, states, current, read_results, count);
+		for (int i = 0; i < count; i++) {
+			if (!read_results[i]) {
+				memcpy(states[i].matrix, current[i], sizeof(states[i].matrix));
+				states[i].matrix_known = true;
+			}
+		}
+	}
+
+	free(current);
+	free(read_results);
+}
+#endif
+
+static double target_elapsed_ms(const struct timespec * start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+int target_write_atomic(Display * display, DeviceState * states, float (*matrices)[9], int * results, const int count, double * held_ms) {
+	float (*previous)[9] = calloc(count ? count : 1, sizeof(*previous));
+	int * read_results = calloc(count ? count : 1, sizeof(*read_results));
+	int * write_results = calloc(count ? count : 1, sizeof(*write_results));
+	int failures = 0;
+
+	if (held_ms) {
+		*held_ms = 0;
+	}
+
+	if (!previous || !read_results || !write_results) {
+		for (int i = 0; i < count; i++) {
+			results[i] = ETARGET_SET_FAILED;
+		}
+		failures = count;
+		goto done;
+	}
+
+	// Without every current matrix there is nothing to roll back to, so nothing is written
+	memcpy(read_results, results, count * sizeof(*results));
+	target_read_batch(display, states, previous, read_results, count);
+
+	bool readable = true, changed = false;
+	for (int i = 0; i < count; i++) {
+		if (results[i]) {
+			continue;
+		} else if (read_results[i]) {
+			readable = false;
+			fprintf(stderr, "Failed to read Coordinate Transformation Matrix for device %lu.\n", states[i].id);
+		} else {
+			memcpy(states[i].matrix, previous[i], sizeof(states[i].matrix));
+			states[i].matrix_known = true;
+			changed = changed || !xi2_matrix_equal(previous[i], matrices[i]);
+		}
+	}
+
+	// Nothing to grab the server for when every device already holds its matrix
+	if (readable && changed) {
+		// No other client runs while the server is grabbed, so devices are never seen half updated.
+		// The writes and their verification share a single round trip.
+		struct timespec grabbed;
+		trace_begin("server_grab");
+		clock_gettime(CLOCK_MONOTONIC, &grabbed);
+		XGrabServer(display);
+
+		memcpy(write_results, results, count * sizeof(*results));
+		target_write_batch(display, states, matrices, write_results, count);
+
+		bool written = true;
+		for (int i = 0; i < count; i++) {
+			if (!results[i] && write_results[i]) {
+				written = false;
+			}
+		}
+
+		if (!written) {
+			// Put back every device which did take its new matrix, reusing read_results
+			for (int i = 0; i < count; i++) {
+				read_results[i] = results[i] || write_results[i] ? ETARGET_SET_FAILED : 0;
+			}
+			target_write_batch(display, states, previous, read_results, count);
+		}
+
+		XUngrabServer(display);
+		XFlush(display);
+		trace_end();
+		if (held_ms) {
+			*held_ms = target_elapsed_ms(&grabbed);
+		}
+
+		for (int i = 0; i < count; i++) {
+			if (!results[i] && !written) {
+				results[i] = write_results[i] ? write_results[i] : ETARGET_ROLLED_BACK;
+			}
+		}
+	} else if (!readable) {
+		for (int i = 0; i < count; i++) {
+			if (!results[i]) {
+				results[i] = read_results[i] ? read_results[i] : ETARGET_ROLLED_BACK;
+			}
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (results[i]) {
+			failures++;
+		}
+	}
+
+done:
+	free(previous);
+	free(read_results);
+	free(write_results);
+	return failures;
+}
+
+int target_apply_batch(Display * display, Topology * topology, const Target * targets, DeviceState * states, int * results, const int count, const ApplyMode mode, FILE * output) {
+	float (*matrices)[9] = calloc(count, sizeof(*matrices));
+	XRRScreenResources * resources = NULL;
+	int failures = 0;
+
+	if (!matrices) {
+		for (int i = 0; i < count; i++) {
+			results[i] = ETARGET_SET_FAILED;
+		}
+		return count;
+	}
+
+	trace_begin("compute_matrices");
+	for (int i = 0; i < count; i++) {
+		if (!results[i] && (targets[i].output[0] || (targets[i].one_to_one && !targets[i].full_screen && targets[i].crtc_index < topology->region_count && topology->regions[targets[i].crtc_index].width <= 0))) {
+			resources = XRRGetScreenResourcesCurrent(display, DefaultRootWindow(display));
+			break;
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (results[i]) {
+			continue;
+		}
+
+		// Outputs are looked up on every apply since CRTC indices move when monitors come and go
+		Target target = targets[i];
+		if (target.output[0]) {
+			target.crtc_index = resources ? topology_find_output(display, resources, topology, target.output) : ETARGET_OUTPUT_NOT_FOUND;
+			if (target.crtc_index < 0) {
+				results[i] = ETARGET_OUTPUT_NOT_FOUND;
+				fprintf(stderr, "No monitor is connected to output \"%s\".\n", target.output);
+				continue;
+			}
+		}
+
+		results[i] = target_compute_matrix(display, resources, topology, &target, states + i, matrices[i]);
+		if (!results[i]) {
+			states[i].inputs.region = target.full_screen ? topology->screen_size : topology->regions[target.crtc_index];
+			states[i].inputs.screen = topology->screen_size.region;
+		} else if (results[i] == ETARGET_CRTC_OUT_OF_RANGE) {
+			fprintf(stderr, "CRTC index %d greater than highest index available %d.\n", target.crtc_index, topology->region_count - 1);
+		} else if (results[i] == ETARGET_OUTPUT_DENSITY) {
+			fprintf(stderr, "Failed to retrieve CRTC %d output density.\n", (int)topology->regions[target.crtc_index].crtc);
+		}
+	}
+
+	if (resources) {
+		XRRFreeScreenResources(resources);
+	}
+	trace_end();
+
+	if (mode == APPLY_DRY_RUN) {
+		for (int i = 0; i < count; i++) {
+			if (results[i]) {
+				continue;
+			}
+			if (count > 1) {
+				fprintf(output, "Device %lu: ", states[i].id);
+			}
+			fprintf(output, "Coordinate Transformation Matrix = ");
+			print_matrix(output, matrices[i]);
+			fprintf(output, "\n");
+		}
+	} else if (mode == APPLY_ATOMIC) {
+		double held_ms;
+		target_write_atomic(display, states, matrices, results, count, &held_ms);
+		if (held_ms > 0) {
+			fprintf(output, "Held the server for %.3f ms.\n", held_ms);
+		}
+	} else {
+#		if USE_XCB
+			target_learn_matrices(display, states, results, count);
+#		endif
+		target_write_batch(display, states, matrices, results, count);
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (results[i]) {
+			failures++;
+		}
+		if (results[i] != ETARGET_UNAFFECTED) {
+			states[i].inputs.known = mode != APPLY_DRY_RUN && !results[i];
+		}
+	}
+
+	free(matrices);
+	return failures;
+}
+
+void print_matrix(FILE * file, const float * matrix) {
+	fprintf(file, "%f", matrix[0]);
+	for (const float * x = matrix + 1; x < (matrix + 9); x++) {
+		fprintf(file, " %f", *x);
+	}
+}
@@ -0,0 +1,116 @@
+#ifndef XRESTRICT_APPLY_H_
+#define XRESTRICT_APPLY_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrandr.h>
+
+#include "xrestrict.h"
+#include "input.h"
+#include "display.h"
+
+#define MAX_DEVICE_NAME 128
+#define MAX_OUTPUT_NAME 32
+
+// Everything we learn about the screen layout from the server
+typedef struct Topology {
+	CRTCRegion screen_size;
+	CRTCRegion * regions;
+	int region_count, region_capacity;
+	CRTCIndex index;
+	bool use_cache; // Reuse regions saved by an earlier run with the same RandR configuration
+} Topology;
+
+// What the user asked us to do to a single device
+typedef struct Target {
+	int device_id;
+	DeviceSelector selector; // Resolved to device_id before anything else, see selector.h
+	int crtc_index;
+	char output[MAX_OUTPUT_NAME]; // When set, overrides crtc_index with the CRTC driving this output
+	bool full_screen;
+	bool one_to_one;
+	CTMConfiguration config;
+} Target;
+
+typedef enum ApplyMode {
+	APPLY_WRITE,
+	APPLY_DRY_RUN, // Print the matrices instead of writing them
+	APPLY_ATOMIC   // Write every matrix under a server grab, or none of them
+} ApplyMode;
+
+// What a device's matrix was last computed from. The matrix only has to change when one of these does.
+typedef struct MatrixInputs {
+	bool       known;
+	CRTCRegion region; // The device's CRTC, or the whole screen, including output sizes for one to one targets
+	Rectangle  screen;
+} MatrixInputs;
+
+// Per-device information which survives topology changes
+typedef struct DeviceState {
+	XID				id;
+	char			name[MAX_DEVICE_NAME];
+	ValuatorIndices	valuators;
+	PointerRegion	region;
+	bool			valid;
+	float			matrix[9];    // The device's matrix, when matrix_known
+	bool			matrix_known; // Cleared whenever another client may have changed the matrix
+	bool			watched;      // XI_PropertyEvent is selected for the device
+	MatrixInputs	inputs;
+} DeviceState;
+
+void calc_matrix(const XID deviceid, const CTMConfiguration * config, Rectangle * screen_size, const CRTCRegion * crtc, const Rectangle * input_region, float * matrix);
+
+#define ERESOURCES_REQUEST_FAILED   (-1)
+#define ECRTC_REGIONS_FAILED        (-2)
+#define ETOPOLOGY_ALLOCATION_FAILED (-4)
+// topology must be zero initialized before the first query, and may be queried again
+int topology_query(Display * display, Topology * topology);
+void topology_free(Topology * topology);
+// Returns the index of the region driven by the output named name
+int topology_find_output(Display * display, XRRScreenResources * resources, const Topology * topology, const char * name);
+
+#define EDEVICE_NOT_FOUND           (-1)
+#define EDEVICE_NO_VALUATORS        (-2)
+#define EDEVICE_NO_REGION           (-4)
+int device_state_from_info(Display * display, XIDeviceInfo * info, DeviceState * state);
+int device_state_query(Display * display, const XID id, DeviceState * state);
+// Takes the first device named name whose id no valid entry of held has, so identical devices plugged
+// in together end up with one state each. state may be one of held.
+int device_state_find_by_name(Display * display, const char * name, const DeviceState * held, const int held_count, DeviceState * state);
+// Queries every target's device with a single request, returns the number of failures
+int device_states_query(Display * display, const Target * targets, DeviceState * states, int * results, const int count);
+// Forgets the matrix of the device event is about when another client changed it
+void device_states_property_changed(Display * display, DeviceState * states, const int count, const XIPropertyEvent * event);
+
+#define ETARGET_CRTC_OUT_OF_RANGE   (-8)
+#define ETARGET_OUTPUT_DENSITY      (-16)
+// resources is only needed, and may be NULL otherwise, when target->one_to_one is set
+int target_compute_matrix(Display * display, XRRScreenResources * resources, Topology * topology, const Target * target, const DeviceState * state, float * matrix);
+
+#define ETARGET_UNAFFECTED          (-512)
+// Whether the topology changed any of the inputs of the device's matrix since it was last written
+bool target_affected(const Topology * topology, const Target * target, const DeviceState * state);
+
+#define ETARGET_SET_FAILED          (-32)
+#define ETARGET_OUTPUT_NOT_FOUND    (-64)
+#define ETARGET_READ_FAILED         (-128)
+#define ETARGET_ROLLED_BACK         (-256)
+// Writes matrices[i] to every device whose results entry is 0 with a single XSync, returns the number of failures.
+// Devices already known to hold their matrix aren't written, the rest are confirmed by XI_PropertyEvent.
+int target_write_batch(Display * display, DeviceState * states, float (*matrices)[9], int * results, const int count);
+// Same as target_write_batch inside XGrabServer, but if any write fails every other device gets its
+// previous matrix back and is marked ETARGET_ROLLED_BACK. held_ms receives how long the server was grabbed.
+int target_write_atomic(Display * display, DeviceState * states, float (*matrices)[9], int * results, const int count, double * held_ms);
+// Applies every target whose results entry is 0 with a single XSync, returns the number of failures.
+// Records the inputs of every matrix written, see target_affected. Dry runs print their matrices to
+// output, as atomic writes do how long they held the server.
+int target_apply_batch(Display * display, Topology * topology, const Target * targets, DeviceState * states, int * results, const int count, const ApplyMode mode, FILE * output);
+
+// Finds the rectangle target restricts the device to, as target_apply_batch would.
+// Returns ETARGET_OUTPUT_NOT_FOUND or ETARGET_CRTC_OUT_OF_RANGE when there is none.
+int target_find_region(Display * display, Topology * topology, const Target * target, Rectangle * region);
+
+void print_matrix(FILE * file, const float * matrix);
+
+#endif /* XRESTRICT_APPLY_H_ */
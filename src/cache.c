@@ -0,0 +1,164 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME        1099511628211ULL
+
+static uint64_t hash_xids(uint64_t hash, const XID * xids, const int count) {
+	for (int i = 0; i < count; i++) {
+		uint64_t xid = xids[i];
+		for (int byte = 0; byte < 8; byte++) {
+			hash ^= (xid >> (byte * 8)) & 0xff;
+			hash *= FNV_PRIME;
+		}
+	}
+	return hash;
+}
+
+void cache_key_from_resources(const XRRScreenResources * resources, const Rectangle * screen_size, CacheKey * key) {
+	memset(key, 0, sizeof(*key));
+	key->timestamp = resources->timestamp;
+	key->config_timestamp = resources->configTimestamp;
+
+	// Timestamps restart with the server, so also make sure it's the same set of CRTCs and outputs
+	uint64_t hash = FNV_OFFSET_BASIS;
+	hash = hash_xids(hash, resources->crtcs, resources->ncrtc);
+	hash = hash_xids(hash, resources->outputs, resources->noutput);
+	key->resources_hash = hash;
+
+	key->screen_width = RECT_WIDTH(*screen_size);
+	key->screen_height = RECT_HEIGHT(*screen_size);
+}
+
+int cache_directory(char * path, const size_t path_size) {
+	const char * cache_home = getenv("XDG_CACHE_HOME");
+	const char * home = getenv("HOME");
+	int length;
+
+	if (cache_home && *cache_home) {
+		length = snprintf(path, path_size, "%s/xrestrict", cache_home);
+	} else if (home && *home) {
+		length = snprintf(path, path_size, "%s/.cache", home);
+		if (length < 0 || (size_t)length >= path_size) {
+			return ECACHE_PATH;
+		}
+		mkdir(path, 0700);
+		length = snprintf(path, path_size, "%s/.cache/xrestrict", home);
+	} else {
+		return ECACHE_PATH;
+	}
+
+	if (length < 0 || (size_t)length >= path_size) {
+		return ECACHE_PATH;
+	}
+
+	if (mkdir(path, 0700) && errno != EEXIST) {
+		return ECACHE_PATH;
+	}
+	return length;
+}
+
+int cache_path(Display * display, char * path, const size_t path_size) {
+	int length = cache_directory(path, path_size);
+	if (length < 0) {
+		return length;
+	}
+
+	// One file per display and screen, e.g. "localhost:10.0" becomes "localhost_10.0.0"
+	const char * name = DisplayString(display);
+	int written = snprintf(path + length, path_size - length, "/%s.%d", name, DefaultScreen(display));
+	if (written < 0 || (size_t)written >= path_size - length) {
+		return ECACHE_PATH;
+	}
+
+	for (char * c = path + length + 1; *c; c++) {
+		if (*c == '/' || *c == ':') {
+			*c = '_';
+		}
+	}
+	return 0;
+}
+
+int cache_load(const char * path, const CacheKey * key, CRTCRegion * regions, const int max_regions) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return ECACHE_MISS;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) || (size_t)info.st_size < sizeof(CacheHeader)) {
+		close(fd);
+		return ECACHE_INVALID;
+	}
+
+	void * data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return ECACHE_INVALID;
+	}
+
+	int result;
+	const CacheHeader * header = data;
+	const size_t expected_size = sizeof(CacheHeader) + (size_t)header->region_count * sizeof(CRTCRegion);
+
+	if (header->magic != CACHE_MAGIC || header->version != CACHE_VERSION ||
+		header->region_size != sizeof(CRTCRegion) || header->region_count < 0 ||
+		(size_t)info.st_size != expected_size) {
+		result = ECACHE_INVALID;
+	} else if (memcmp(&header->key, key, sizeof(*key)) != 0) {
+		result = ECACHE_MISS;
+	} else if (header->region_count > max_regions) {
+		result = ECACHE_INVALID;
+	} else {
+		memcpy(regions, (const char *)data + sizeof(CacheHeader), header->region_count * sizeof(CRTCRegion));
+		result = header->region_count;
+	}
+
+	munmap(data, info.st_size);
+	return result;
+}
+
+int cache_store(const char * path, const CacheKey * key, const CRTCRegion * regions, const int region_count) {
+	char temporary[4096];
+	int length = snprintf(temporary, sizeof(temporary), "%s.%ld", path, (long)getpid());
+	if (length < 0 || (size_t)length >= sizeof(temporary)) {
+		return ECACHE_PATH;
+	}
+
+	CacheHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = CACHE_MAGIC;
+	header.version = CACHE_VERSION;
+	header.key = *key;
+	header.region_count = region_count;
+	header.region_size = sizeof(CRTCRegion);
+
+	FILE * file = fopen(temporary, "wb");
+	if (!file) {
+		return ECACHE_WRITE;
+	}
+
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(regions, sizeof(CRTCRegion), region_count, file) == (size_t)region_count;
+
+	if (fclose(file) || !written) {
+		unlink(temporary);
+		return ECACHE_WRITE;
+	}
+
+	// Readers either see the old file or the complete new one
+	if (rename(temporary, path)) {
+		unlink(temporary);
+		return ECACHE_WRITE;
+	}
+	return 0;
+}
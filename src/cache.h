@@ -0,0 +1,43 @@
+#ifndef XRESTRICT_CACHE_H_
+#define XRESTRICT_CACHE_H_
+
+#include <stdint.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrandr.h>
+
+#include "display.h"
+
+#define CACHE_MAGIC   0x31435258 // "XRC1"
+#define CACHE_VERSION 1
+
+// Identifies a RandR configuration, the cache is only used when every field matches
+typedef struct CacheKey {
+	uint64_t timestamp;
+	uint64_t config_timestamp;
+	uint64_t resources_hash;
+	int32_t  screen_width, screen_height;
+} CacheKey;
+
+// On disk the header is followed by region_count CRTCRegions
+typedef struct CacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	CacheKey key;
+	int32_t  region_count;
+	int32_t  region_size;
+} CacheHeader;
+
+void cache_key_from_resources(const XRRScreenResources * resources, const Rectangle * screen_size, CacheKey * key);
+
+#define ECACHE_PATH     (-1)
+#define ECACHE_MISS     (-2)
+#define ECACHE_INVALID  (-4)
+#define ECACHE_WRITE    (-8)
+// Creates the directory if needed, returns the length of its path
+int cache_directory(char * path, const size_t path_size);
+int cache_path(Display * display, char * path, const size_t path_size);
+// Returns the number of regions loaded
+int cache_load(const char * path, const CacheKey * key, CRTCRegion * regions, const int max_regions);
+int cache_store(const char * path, const CacheKey * key, const CRTCRegion * regions, const int region_count);
+
+#endif /* XRESTRICT_CACHE_H_ */
@@ -0,0 +1,282 @@
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/XInput2.h>
+#include <X11/extensions/Xrandr.h>
+
+#include "calibrate.h"
+
+#define CALIBRATE_TARGETS    (CALIBRATE_GRID * CALIBRATE_GRID)
+#define CALIBRATE_CROSS_SIZE 20
+
+static volatile sig_atomic_t calibrate_stop = 0;
+
+static void calibrate_signal_handler(int signal) {
+	calibrate_stop = 1;
+}
+
+typedef struct Calibration {
+	Display *      display;
+	Window         window;
+	GC             gc;
+	Rectangle      monitor;  // Where the targets are shown
+	Rectangle      screen;
+	const DeviceState * state;
+	CalibrationFit fit;
+	int            target;   // The target being touched, CALIBRATE_TARGETS once done
+	unsigned long  target_samples;
+	bool           pressed;
+	bool           touch;    // The device sends touch events, which its emulated pointer events duplicate
+	int            touch_id; // Only the first finger down counts
+	Point          last;
+} Calibration;
+
+static void calibrate_target_position(const Calibration * calibration, const int target, Point * position) {
+	const double steps[CALIBRATE_GRID] = {0.1, 0.5, 0.9};
+
+	position->x = calibration->monitor.left + steps[target % CALIBRATE_GRID] * RECT_WIDTH(calibration->monitor);
+	position->y = calibration->monitor.top + steps[target / CALIBRATE_GRID] * RECT_HEIGHT(calibration->monitor);
+}
+
+static void calibrate_draw(const Calibration * calibration) {
+	Display * display = calibration->display;
+	char status[128];
+
+	XClearWindow(display, calibration->window);
+	if (calibration->target >= CALIBRATE_TARGETS) {
+		return;
+	}
+
+	Point position;
+	calibrate_target_position(calibration, calibration->target, &position);
+	int x = position.x - calibration->monitor.left, y = position.y - calibration->monitor.top;
+
+	XDrawLine(display, calibration->window, calibration->gc, x - CALIBRATE_CROSS_SIZE, y, x + CALIBRATE_CROSS_SIZE, y);
+	XDrawLine(display, calibration->window, calibration->gc, x, y - CALIBRATE_CROSS_SIZE, x, y + CALIBRATE_CROSS_SIZE);
+	XDrawArc(display, calibration->window, calibration->gc, x - CALIBRATE_CROSS_SIZE / 2, y - CALIBRATE_CROSS_SIZE / 2,
+			 CALIBRATE_CROSS_SIZE, CALIBRATE_CROSS_SIZE, 0, 360 * 64);
+
+	int length = snprintf(status, sizeof(status), "Touch the center of the target and hold it (%d/%d), Ctrl+C to cancel",
+						  calibration->target + 1, CALIBRATE_TARGETS);
+
+	// The fit is kept up to date, so its residual can be shown as soon as there is one
+	float matrix[9];
+	Point residual;
+	if (!calibration_fit_solve(&calibration->fit, matrix, &residual)) {
+		length += snprintf(status + length, sizeof(status) - length, ", residual so far %.1f px",
+						   hypot(residual.x * RECT_WIDTH(calibration->screen), residual.y * RECT_HEIGHT(calibration->screen)));
+	}
+	XDrawString(display, calibration->window, calibration->gc, CALIBRATE_CROSS_SIZE, RECT_HEIGHT(calibration->monitor) / 2 + 3 * CALIBRATE_CROSS_SIZE,
+				status, length);
+	XFlush(display);
+}
+
+static void calibrate_add_sample(Calibration * calibration, const XIRawEvent * raw) {
+	const PointerRegion * device = &calibration->state->region;
+
+	// The matrix the device has now is applied to valuators, but not to their raw values
+	const XIValuatorState raw_valuators = {
+		.mask_len = raw->valuators.mask_len,
+		.mask = raw->valuators.mask,
+		.values = raw->raw_values
+	};
+	const XIValuatorState * valuators = &raw_valuators;
+	Point point;
+	xi2_read_points((const XIValuatorState * const *)&valuators, 1, &calibration->state->valuators, &calibration->last, &point);
+
+	if (!calibration->pressed) {
+		return;
+	}
+
+	Point target;
+	calibrate_target_position(calibration, calibration->target, &target);
+
+	const Point normalized_device = {
+		(point.x - device->region.left) / RECT_WIDTH(device->region),
+		(point.y - device->region.top) / RECT_HEIGHT(device->region)
+	};
+	const Point normalized_screen = {
+		(target.x - calibration->screen.left) / RECT_WIDTH(calibration->screen),
+		(target.y - calibration->screen.top) / RECT_HEIGHT(calibration->screen)
+	};
+	calibration_fit_add(&calibration->fit, &normalized_device, &normalized_screen);
+	calibration->target_samples++;
+}
+
+static void calibrate_handle_raw(Calibration * calibration, const int evtype, const XIRawEvent * raw) {
+	const bool touch_event = evtype == XI_RawTouchBegin || evtype == XI_RawTouchUpdate || evtype == XI_RawTouchEnd;
+
+	if (raw->deviceid != (int)calibration->state->id || (calibration->touch && !touch_event)) {
+		return;
+	}
+
+	if (touch_event) {
+		calibration->touch = true;
+		if (calibration->pressed && raw->detail != calibration->touch_id) {
+			return;
+		}
+	}
+
+	if (evtype == XI_RawButtonPress || evtype == XI_RawTouchBegin) {
+		if (calibration->pressed || (evtype == XI_RawButtonPress && raw->detail != Button1)) {
+			return;
+		}
+		calibration->pressed = true;
+		calibration->touch_id = raw->detail;
+		calibration->target_samples = 0;
+	}
+
+	calibrate_add_sample(calibration, raw);
+
+	if ((evtype == XI_RawButtonRelease && raw->detail == Button1) || evtype == XI_RawTouchEnd) {
+		calibration->pressed = false;
+		if (calibration->target_samples >= CALIBRATE_MIN_SAMPLES) {
+			calibration->target++;
+		}
+		calibrate_draw(calibration);
+	}
+}
+
+static void calibrate_drain_events(Calibration * calibration, const int xi_opcode) {
+	XEvent event;
+	XGenericEventCookie * cookie = &event.xcookie;
+
+	while (XPending(calibration->display) && calibration->target < CALIBRATE_TARGETS) {
+		XNextEvent(calibration->display, &event);
+
+		if (event.type == Expose && event.xexpose.count == 0) {
+			calibrate_draw(calibration);
+		} else if (cookie->type == GenericEvent && cookie->extension == xi_opcode && XGetEventData(calibration->display, cookie)) {
+			calibrate_handle_raw(calibration, cookie->evtype, cookie->data);
+			XFreeEventData(calibration->display, cookie);
+		}
+	}
+}
+
+static void calibrate_select_events(Display * display, const XID id, const bool touch) {
+	unsigned char mask_data[XIMaskLen(XI_RawTouchEnd)] = {0};
+	XIEventMask mask = {
+		.deviceid = id,
+		.mask_len = sizeof(mask_data),
+		.mask = mask_data
+	};
+	XISetMask(mask_data, XI_RawButtonPress);
+	XISetMask(mask_data, XI_RawButtonRelease);
+	XISetMask(mask_data, XI_RawMotion);
+	if (touch) {
+		XISetMask(mask_data, XI_RawTouchBegin);
+		XISetMask(mask_data, XI_RawTouchUpdate);
+		XISetMask(mask_data, XI_RawTouchEnd);
+	}
+	XISelectEvents(display, DefaultRootWindow(display), &mask, 1);
+}
+
+int calibrate_run(Display * display, Topology * topology, const Target * target, DeviceState * state, const ApplyMode mode) {
+	int xi_opcode, xi_event_base, xi_error_base;
+
+	if (!XQueryExtension(display, "XInputExtension", &xi_opcode, &xi_event_base, &xi_error_base)) {
+		return ECALIBRATE_NO_XINPUT;
+	}
+
+	Calibration calibration;
+	memset(&calibration, 0, sizeof(calibration));
+	calibration.display = display;
+	calibration.state = state;
+	calibration.screen = topology->screen_size.region;
+	calibration_fit_reset(&calibration.fit);
+
+	int result = target_find_region(display, topology, target, &calibration.monitor);
+	if (result) {
+		return result;
+	}
+	if (RECT_WIDTH(calibration.monitor) <= 0 || RECT_HEIGHT(calibration.monitor) <= 0 ||
+		RECT_WIDTH(state->region.region) <= 0 || RECT_HEIGHT(state->region.region) <= 0) {
+		return ECALIBRATE_WINDOW;
+	}
+
+	// Raw touch events need XInput 2.2, pens and servers without it send pointer events only. Some servers
+	// refuse a version lower than one libXi announced already, which mustn't take the default error handler down.
+	int major = 2, minor = 2;
+	XErrorTrap trap;
+	xlib_error_trap_push(display, &trap);
+	const bool touch = XIQueryVersion(display, &major, &minor) == Success && (major > 2 || minor >= 2);
+	xlib_error_trap_pop(display, &trap);
+	xlib_error_trap_free(&trap);
+
+	const int screen = DefaultScreen(display);
+	XSetWindowAttributes attributes = {
+		.override_redirect = True,
+		.background_pixel = BlackPixel(display, screen),
+		.event_mask = ExposureMask
+	};
+	calibration.window = XCreateWindow(display, DefaultRootWindow(display), calibration.monitor.left, calibration.monitor.top,
+									   RECT_WIDTH(calibration.monitor), RECT_HEIGHT(calibration.monitor), 0, CopyFromParent,
+									   InputOutput, CopyFromParent, CWOverrideRedirect | CWBackPixel | CWEventMask, &attributes);
+	if (!calibration.window) {
+		return ECALIBRATE_WINDOW;
+	}
+	calibration.gc = XCreateGC(display, calibration.window, 0, NULL);
+	XSetForeground(display, calibration.gc, WhitePixel(display, screen));
+	XMapRaised(display, calibration.window);
+
+	calibrate_select_events(display, state->id, touch);
+	XFlush(display);
+
+	struct sigaction action, previous_int, previous_term;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = calibrate_signal_handler;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, &previous_int);
+	sigaction(SIGTERM, &action, &previous_term);
+	// Signals only arrive while waiting, so calibrate_stop cannot change after it was checked
+	sigset_t blocked, unblocked;
+	sigemptyset(&blocked);
+	sigaddset(&blocked, SIGINT);
+	sigaddset(&blocked, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &blocked, &unblocked);
+
+	while (!calibrate_stop && calibration.target < CALIBRATE_TARGETS) {
+		int wait_result = xlib_wait_for_events(display, -1, &unblocked);
+		if (wait_result < 0 && errno != EINTR) {
+			break;
+		}
+		calibrate_drain_events(&calibration, xi_opcode);
+	}
+
+	pthread_sigmask(SIG_SETMASK, &unblocked, NULL);
+	sigaction(SIGINT, &previous_int, NULL);
+	sigaction(SIGTERM, &previous_term, NULL);
+
+	XFreeGC(display, calibration.gc);
+	XDestroyWindow(display, calibration.window);
+	XFlush(display);
+
+	if (calibration.target < CALIBRATE_TARGETS) {
+		return ECALIBRATE_INTERRUPTED;
+	}
+
+	float matrices[1][9];
+	Point residual;
+	if (calibration_fit_solve(&calibration.fit, matrices[0], &residual)) {
+		return ECALIBRATE_DEGENERATE;
+	}
+
+	const double residual_x = residual.x * RECT_WIDTH(calibration.screen), residual_y = residual.y * RECT_HEIGHT(calibration.screen);
+	printf("Fitted %.0f samples, residual %.2f px RMS (%.2f px horizontally, %.2f px vertically).\n",
+		   calibration.fit.count, hypot(residual_x, residual_y), residual_x, residual_y);
+
+	if (mode == APPLY_DRY_RUN) {
+		printf("Coordinate Transformation Matrix = ");
+		print_matrix(stdout, matrices[0]);
+		printf("\n");
+		return 0;
+	}
+
+	// Raw values don't go through the device's current matrix, so the fit replaces it rather than correcting it
+	target_write_batch(display, state, matrices, &result, 1);
+	return result ? ECALIBRATE_WRITE : 0;
+}
@@ -0,0 +1,23 @@
+#ifndef XRESTRICT_CALIBRATE_H_
+#define XRESTRICT_CALIBRATE_H_
+
+#include <X11/Xlib.h>
+
+#include "apply.h"
+
+// Targets sit on a grid at 10%, 50% and 90% of the monitor
+#define CALIBRATE_GRID        3
+// Touches with fewer samples are taken as accidental and the target is shown again
+#define CALIBRATE_MIN_SAMPLES 8
+
+#define ECALIBRATE_NO_XINPUT   (-1)
+#define ECALIBRATE_WINDOW      (-2)
+#define ECALIBRATE_INTERRUPTED (-4)
+#define ECALIBRATE_DEGENERATE  (-8)
+#define ECALIBRATE_WRITE       (-16)
+// Shows targets across the monitor target restricts the device to, fits the matrix which puts the device's
+// touches onto them and writes it, or prints it in APPLY_DRY_RUN mode. Returns ETARGET_* codes when the
+// monitor can't be found.
+int calibrate_run(Display * display, Topology * topology, const Target * target, DeviceState * state, const ApplyMode mode);
+
+#endif /* XRESTRICT_CALIBRATE_H_ */
@@ -0,0 +1,254 @@
+#ifdef HAVE_CONFIG_H
+#	include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/XInput2.h>
+#include <X11/extensions/Xrandr.h>
+
+#include "context.h"
+
+static int context_select_events(XRestrictContext * context) {
+	int rr_error_base, xi_event_base, xi_error_base;
+
+	if (!XRRQueryExtension(context->display, &context->rr_event_base, &rr_error_base) ||
+		!XQueryExtension(context->display, "XInputExtension", &context->xi_opcode, &xi_event_base, &xi_error_base)) {
+		return ECONTEXT_NO_EXTENSIONS;
+	}
+
+	XRRSelectInput(context->display, DefaultRootWindow(context->display), RRScreenChangeNotifyMask | RRCrtcChangeNotifyMask);
+
+	unsigned char mask_data[XIMaskLen(XI_HierarchyChanged)] = {0};
+	XIEventMask mask = {
+		.deviceid = XIAllDevices,
+		.mask_len = sizeof(mask_data),
+		.mask = mask_data
+	};
+	XISetMask(mask_data, XI_HierarchyChanged);
+	XISelectEvents(context->display, DefaultRootWindow(context->display), &mask, 1);
+	return 0;
+}
+
+int xrestrict_context_attach(XRestrictContext * context, Display * display, const bool use_cache) {
+	memset(context, 0, sizeof(*context));
+	context->display = display;
+	context->output = stdout;
+	context->topology.use_cache = use_cache;
+	context->topology_stale = true;
+
+	return context_select_events(context);
+}
+
+int xrestrict_context_open(XRestrictContext * context, const char * display_name, const bool use_cache) {
+	Display * display = XOpenDisplay(display_name);
+	if (!display) {
+		memset(context, 0, sizeof(*context));
+		return ECONTEXT_OPEN_FAILED;
+	}
+
+	int result = xrestrict_context_attach(context, display, use_cache);
+	if (result) {
+		XCloseDisplay(display);
+		memset(context, 0, sizeof(*context));
+		return result;
+	}
+
+	context->owns_display = true;
+	return 0;
+}
+
+void xrestrict_context_close(XRestrictContext * context) {
+	topology_free(&context->topology);
+	free(context->devices);
+	if (context->owns_display && context->display) {
+		XCloseDisplay(context->display);
+	}
+	memset(context, 0, sizeof(*context));
+}
+
+static DeviceState * context_find_device(XRestrictContext * context, const XID id) {
+	for (int i = 0; i < context->device_count; i++) {
+		if (context->devices[i].id == id) {
+			return context->devices + i;
+		}
+	}
+	return NULL;
+}
+
+static void context_remove_device(XRestrictContext * context, const XID id) {
+	DeviceState * device = context_find_device(context, id);
+	if (device) {
+		*device = context->devices[--context->device_count];
+	}
+}
+
+// Failing to remember a device only costs the next apply a query
+static void context_add_device(XRestrictContext * context, const DeviceState * state) {
+	if (context->device_count >= context->device_capacity) {
+		int capacity = context->device_capacity ? context->device_capacity * 2 : 8;
+		DeviceState * devices = realloc(context->devices, capacity * sizeof(*devices));
+		if (!devices) {
+			return;
+		}
+		context->devices = devices;
+		context->device_capacity = capacity;
+	}
+
+	context->devices[context->device_count++] = *state;
+}
+
+static void context_handle_hierarchy(XRestrictContext * context, const XIHierarchyEvent * event) {
+	for (int i = 0; i < event->num_info; i++) {
+		// Ids are reused, so a removed device is forgotten rather than kept around as invalid
+		if (event->info[i].flags & (XISlaveRemoved | XIDeviceDisabled | XIMasterRemoved)) {
+			context_remove_device(context, event->info[i].deviceid);
+		}
+	}
+}
+
+bool xrestrict_context_handle_event(XRestrictContext * context, XEvent * event) {
+	XGenericEventCookie * cookie = &event->xcookie;
+
+	if (event->type == context->rr_event_base + RRScreenChangeNotify) {
+		XRRUpdateConfiguration(event);
+		context->topology_stale = true;
+	} else if (event->type == context->rr_event_base + RRNotify) {
+		if (((XRRNotifyEvent *)event)->subtype == RRNotify_CrtcChange) {
+			context->topology_stale = true;
+		}
+	} else if (cookie->type == GenericEvent && cookie->extension == context->xi_opcode && cookie->data) {
+		if (cookie->evtype == XI_HierarchyChanged) {
+			context_handle_hierarchy(context, cookie->data);
+		} else if (cookie->evtype == XI_PropertyEvent) {
+			device_states_property_changed(context->display, context->devices, context->device_count, cookie->data);
+		} else {
+			return false;
+		}
+	} else {
+		return false;
+	}
+	return true;
+}
+
+void xrestrict_context_process_events(XRestrictContext * context) {
+	XEvent event;
+	XGenericEventCookie * cookie = &event.xcookie;
+
+	while (XPending(context->display)) {
+		XNextEvent(context->display, &event);
+
+		const bool data = cookie->type == GenericEvent && XGetEventData(context->display, cookie);
+		xrestrict_context_handle_event(context, &event);
+		if (data) {
+			XFreeEventData(context->display, cookie);
+		}
+	}
+}
+
+int xrestrict_context_refresh_topology(XRestrictContext * context) {
+	int result = topology_query(context->display, &context->topology);
+	context->topology_stale = result != 0;
+	return result;
+}
+
+void xrestrict_context_refresh_devices(XRestrictContext * context) {
+	context->device_count = 0;
+}
+
+int xrestrict_context_devices(XRestrictContext * context, const Target * targets, DeviceState * states, int * results, const int count) {
+	Target * missing = calloc(count ? count : 1, sizeof(*missing));
+	DeviceState * queried = calloc(count ? count : 1, sizeof(*queried));
+	int * query_results = calloc(count ? count : 1, sizeof(*query_results));
+	int missing_count = 0, failures = 0;
+
+	if (!missing || !queried || !query_results) {
+		for (int i = 0; i < count; i++) {
+			if (!results[i]) {
+				results[i] = ECONTEXT_ALLOCATION_FAILED;
+			}
+		}
+	}
+
+	for (int i = 0; missing && queried && query_results && i < count; i++) {
+		if (results[i] || context_find_device(context, targets[i].device_id)) {
+			continue;
+		}
+
+		bool listed = false;
+		for (int j = 0; j < missing_count && !listed; j++) {
+			listed = missing[j].device_id == targets[i].device_id;
+		}
+		if (!listed) {
+			missing[missing_count++] = targets[i];
+		}
+	}
+
+	// Every device the context hasn't seen yet is queried at once
+	if (missing_count) {
+		device_states_query(context->display, missing, queried, query_results, missing_count);
+		for (int j = 0; j < missing_count; j++) {
+			if (!query_results[j]) {
+				context_add_device(context, queried + j);
+			}
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (!results[i]) {
+			const DeviceState * device = context_find_device(context, targets[i].device_id);
+			if (device) {
+				states[i] = *device;
+			} else {
+				results[i] = EDEVICE_NOT_FOUND;
+				for (int j = 0; j < missing_count; j++) {
+					if (missing[j].device_id == targets[i].device_id) {
+						results[i] = query_results[j];
+						states[i] = queried[j];
+					}
+				}
+			}
+		}
+		if (results[i]) {
+			failures++;
+		}
+	}
+
+	free(missing);
+	free(queried);
+	free(query_results);
+	return failures;
+}
+
+int xrestrict_context_apply(XRestrictContext * context, const Target * targets, int * results, const int count, const ApplyMode mode) {
+	DeviceState * states = calloc(count ? count : 1, sizeof(*states));
+	int failures = 0;
+
+	xrestrict_context_process_events(context);
+
+	if (!states || (context->topology_stale && xrestrict_context_refresh_topology(context))) {
+		for (int i = 0; i < count; i++) {
+			if (!results[i]) {
+				results[i] = states ? ECONTEXT_TOPOLOGY_FAILED : ECONTEXT_ALLOCATION_FAILED;
+			}
+			failures++;
+		}
+		free(states);
+		return failures;
+	}
+
+	xrestrict_context_devices(context, targets, states, results, count);
+	failures = target_apply_batch(context->display, &context->topology, targets, states, results, count, mode, context->output);
+
+	// Remember which matrices the devices now hold, so the next apply can skip them
+	for (int i = 0; i < count; i++) {
+		DeviceState * device = states[i].valid ? context_find_device(context, states[i].id) : NULL;
+		if (device) {
+			*device = states[i];
+		}
+	}
+
+	free(states);
+	return failures;
+}
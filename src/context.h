@@ -0,0 +1,54 @@
+#ifndef XRESTRICT_CONTEXT_H_
+#define XRESTRICT_CONTEXT_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <X11/Xlib.h>
+
+#include "apply.h"
+
+// Everything libxrestrict keeps between applies on one display. A long lived process keeps its
+// context open, so later applies don't connect, intern atoms or query the layout and devices again.
+typedef struct XRestrictContext {
+	Display *     display;
+	bool          owns_display;
+	Topology      topology;
+	bool          topology_stale; // The layout changed, or was never queried
+	DeviceState * devices;        // Every device applied to so far
+	int           device_count, device_capacity;
+	int           rr_event_base, xi_opcode;
+	FILE *        output;         // Where applies print, stdout unless changed after opening
+} XRestrictContext;
+
+#define ECONTEXT_OPEN_FAILED       (-1)
+#define ECONTEXT_NO_EXTENSIONS     (-2)
+// Connects to display_name, or $DISPLAY when NULL. use_cache is as for Topology.
+int xrestrict_context_open(XRestrictContext * context, const char * display_name, const bool use_cache);
+// Same as xrestrict_context_open over a connection the caller already has, which
+// xrestrict_context_close leaves open
+int xrestrict_context_attach(XRestrictContext * context, Display * display, const bool use_cache);
+void xrestrict_context_close(XRestrictContext * context);
+
+// Handles every queued RandR and XInput event without blocking, noting which layout and devices changed.
+// The context selects these events itself, callers which select others on the same display should handle
+// their own events before calling this, since any other event is dropped.
+void xrestrict_context_process_events(XRestrictContext * context);
+// Same for a single event callers took from the queue themselves, whose cookie data they fetched.
+// Returns whether the event was one the context handles, callers may still look at it either way.
+bool xrestrict_context_handle_event(XRestrictContext * context, XEvent * event);
+// Queries the monitor layout, returns the error of topology_query
+int xrestrict_context_refresh_topology(XRestrictContext * context);
+// Forgets every device, so that the next apply queries them again
+void xrestrict_context_refresh_devices(XRestrictContext * context);
+
+// Results entries beyond the EDEVICE_* and ETARGET_* codes
+#define ECONTEXT_TOPOLOGY_FAILED   (-1024)
+#define ECONTEXT_ALLOCATION_FAILED (-2048)
+// Fills states for every target whose results entry is 0, querying devices the context hasn't seen with
+// a single request. Returns the number of failures, results receive EDEVICE_* codes.
+int xrestrict_context_devices(XRestrictContext * context, const Target * targets, DeviceState * states, int * results, const int count);
+// Applies every target whose results entry is 0 as target_apply_batch does, refreshing the layout first
+// when it changed. Matrices a device already holds aren't written again. Returns the number of failures.
+int xrestrict_context_apply(XRestrictContext * context, const Target * targets, int * results, const int count, const ApplyMode mode);
+
+#endif /* XRESTRICT_CONTEXT_H_ */
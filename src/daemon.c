@@ -0,0 +1,181 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/XInput2.h>
+
+#include "daemon.h"
+#include "context.h"
+#include "trace.h"
+
+static volatile sig_atomic_t daemon_stop = 0;
+
+static void daemon_signal_handler(int signal) {
+	daemon_stop = 1;
+}
+
+static void daemon_handle_hierarchy(const XIHierarchyEvent * event, DeviceState * states, const int count, bool * device_added) {
+	for (int i = 0; i < event->num_info; i++) {
+		const XIHierarchyInfo * info = event->info + i;
+
+		if (info->flags & (XISlaveRemoved | XIDeviceDisabled)) {
+			for (int j = 0; j < count; j++) {
+				if (states[j].valid && info->deviceid == states[j].id) {
+					states[j].valid = false;
+				}
+			}
+		}
+
+		if (info->flags & (XISlaveAdded | XIDeviceEnabled)) {
+			// Replugged devices usually come back with a new id so we can't filter by id
+			*device_added = true;
+		}
+	}
+}
+
+static void daemon_drain_events(XRestrictContext * context, DeviceState * states, const int count, bool * device_added) {
+	XEvent event;
+	XGenericEventCookie * cookie = &event.xcookie;
+
+	while (XPending(context->display)) {
+		XNextEvent(context->display, &event);
+
+		const bool data = cookie->type == GenericEvent && XGetEventData(context->display, cookie);
+		xrestrict_context_handle_event(context, &event);
+		// The context only forgets removed devices, the daemon looks for them again once devices are added
+		if (data && cookie->extension == context->xi_opcode && cookie->evtype == XI_HierarchyChanged) {
+			daemon_handle_hierarchy(cookie->data, states, count, device_added);
+		}
+		if (data) {
+			XFreeEventData(context->display, cookie);
+		}
+	}
+}
+
+// Find devices which went away again, by name if we've seen them before. Devices other states hold
+// are passed over, so two identical devices replugged together aren't both mapped onto one.
+static int daemon_reacquire_devices(Display * display, const Target * targets, DeviceState * states, const int count) {
+	int reacquired = 0;
+
+	for (int i = 0; i < count; i++) {
+		if (states[i].valid) {
+			continue;
+		}
+
+		int result;
+		if (states[i].name[0] != '\0') {
+			result = device_state_find_by_name(display, states[i].name, states, count, states + i);
+		} else {
+			result = device_state_query(display, targets[i].device_id, states + i);
+		}
+
+		if (!result) {
+			reacquired++;
+#			if DEBUG
+				printf("Device \"%s\" is now %lu\n", states[i].name, states[i].id);
+#			endif
+		}
+	}
+
+	return reacquired;
+}
+
+int daemon_run(XRestrictContext * context, const Target * targets, const int count, const ApplyMode mode) {
+	Display * display = context->display;
+	// Replugged devices get new ids, which our copy of the targets follows
+	Target * current = malloc((count ? count : 1) * sizeof(*current));
+	DeviceState * states = calloc(count ? count : 1, sizeof(*states));
+	int * results = calloc(count ? count : 1, sizeof(*results));
+	int result = 0;
+
+	if (!current || !states || !results) {
+		result = EDAEMON_ALLOCATION_FAILED;
+		goto done;
+	}
+	memcpy(current, targets, count * sizeof(*current));
+	// Events which arrived since the last apply are handled on the first pass of the loop
+	xrestrict_context_devices(context, current, states, results, count);
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = daemon_signal_handler;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	// A signal between checking daemon_stop and waiting would go unnoticed until the next event
+	sigset_t blocked, unblocked;
+	sigemptyset(&blocked);
+	sigaddset(&blocked, SIGINT);
+	sigaddset(&blocked, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &blocked, &unblocked);
+
+	while (!daemon_stop) {
+		bool device_added = false;
+
+		int wait_result = xlib_wait_for_events(display, -1, &unblocked);
+		if (wait_result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			result = EDAEMON_WAIT_FAILED;
+			break;
+		}
+
+		// Docking and hotplugging fire bursts of events, keep collecting until they settle
+		do {
+			daemon_drain_events(context, states, count, &device_added);
+		} while (!daemon_stop && xlib_wait_for_events(display, DAEMON_SETTLE_MS, &unblocked) > 0);
+
+		trace_begin("daemon_update");
+		int reacquired = 0;
+		if (device_added) {
+			reacquired = daemon_reacquire_devices(display, current, states, count);
+			for (int i = 0; i < count; i++) {
+				if (states[i].valid) {
+					current[i].device_id = states[i].id;
+				}
+			}
+		}
+
+		const bool topology_changed = context->topology_stale;
+		if (topology_changed && xrestrict_context_refresh_topology(context)) {
+			fprintf(stderr, "Failed to retrieve crtc region information.\n");
+		} else if (topology_changed || reacquired) {
+			// Only devices on a CRTC which changed, or which were just plugged in, need a new matrix
+			for (int i = 0; i < count; i++) {
+				results[i] = states[i].valid ? 0 : EDEVICE_NOT_FOUND;
+			}
+			xrestrict_context_devices(context, current, states, results, count);
+
+			int skipped = 0;
+			for (int i = 0; i < count; i++) {
+				if (!results[i] && !target_affected(&context->topology, current + i, states + i)) {
+					results[i] = ETARGET_UNAFFECTED;
+					skipped++;
+				}
+			}
+			xrestrict_context_apply(context, current, results, count, mode);
+			if (skipped) {
+				printf("Skipped %d of %d devices unaffected by the change.\n", skipped, count);
+			}
+			fflush(stdout);
+
+			// Devices the context found gone are looked for again on the next hotplug
+			for (int i = 0; i < count; i++) {
+				if (results[i] == EDEVICE_NOT_FOUND) {
+					states[i].valid = false;
+				}
+			}
+		}
+		trace_end();
+	}
+	pthread_sigmask(SIG_SETMASK, &unblocked, NULL);
+
+done:
+	free(current);
+	free(states);
+	free(results);
+	return result;
+}
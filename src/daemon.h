@@ -0,0 +1,19 @@
+#ifndef XRESTRICT_DAEMON_H_
+#define XRESTRICT_DAEMON_H_
+
+#include <stdbool.h>
+#include <X11/Xlib.h>
+
+#include "apply.h"
+#include "context.h"
+
+// Events arriving within this many milliseconds of each other are handled as one change
+#define DAEMON_SETTLE_MS 50
+
+#define EDAEMON_WAIT_FAILED       (-4)
+#define EDAEMON_ALLOCATION_FAILED (-8)
+// Reapplies every target whenever the monitor layout changes or its device is plugged in again, until
+// interrupted. Expects the context to hold the layout the targets were last applied to.
+int daemon_run(XRestrictContext * context, const Target * targets, const int count, const ApplyMode mode);
+
+#endif /* XRESTRICT_DAEMON_H_ */
@@ -1,5 +1,9 @@
 #include <limits.h>
+#include <stdlib.h>
 #include <stdio.h>
+#include <signal.h>
+#include <sys/select.h>
+#include <pthread.h>
 #include "display.h"
 
 void xlib_find_screen_size(Display * display, Rectangle * size) {
@@ -28,14 +32,11 @@ int xlib_get_crtc_output_density(Display * display, XRRScreenResources * resourc
 }
 
 int xlib_get_crtc_regions(Display * display, XRRScreenResources * resources, CRTCRegion * regions, const int max_regions) {
+	const CRTCRegion * regions_base = regions;
 	const CRTCRegion * regions_end = regions + max_regions;
 	const RRCrtc * crtcs_end = resources->crtcs + resources->ncrtc;
 	RRCrtc * crtc;
 	for (crtc = resources->crtcs; crtc < crtcs_end; crtc++) {
-		if (regions >= regions_end) {
-			return EREGIONS_OVERFLOW;
-		}
-
 		XRRCrtcInfo * crtc_info = XRRGetCrtcInfo(display, resources, *crtc);
 		if (!crtc_info) {
 			return ECRTC_INFO_REQUEST_FAILED;
@@ -43,7 +44,11 @@ int xlib_get_crtc_regions(Display * display, XRRScreenResources * resources, CRT
 
 		if (crtc_info->noutput < 1) {
 			// We only care about crtcs that are actually being displayed
+			XRRFreeCrtcInfo(crtc_info);
 			continue;
+		} else if (regions >= regions_end) {
+			XRRFreeCrtcInfo(crtc_info);
+			return EREGIONS_OVERFLOW;
 		} else if (crtc_info->noutput == 1) {
 			regions->output = crtc_info->outputs[0];
 		} else {
@@ -52,6 +57,8 @@ int xlib_get_crtc_regions(Display * display, XRRScreenResources * resources, CRT
 		}
 
 		regions->crtc = *crtc;
+		// Filled in on demand by xlib_get_crtc_output_density()
+		regions->width = regions->height = 0;
 
 		regions->region.top = crtc_info->y;
 		regions->region.left = crtc_info->x;
@@ -63,7 +70,7 @@ int xlib_get_crtc_regions(Display * display, XRRScreenResources * resources, CRT
 #		endif
 		XRRFreeCrtcInfo(crtc_info);
 	}
-	return crtc - resources->crtcs;
+	return regions - regions_base;
 }
 
 int find_containing_crtc(CRTCRegion * regions, const int region_count, const Point * point) {
@@ -76,3 +83,233 @@ int find_containing_crtc(CRTCRegion * regions, const int region_count, const Poi
 	}
 	return -1;
 }
+
+static int compare_ints(const void * a, const void * b) {
+	int left = *(const int *)a, right = *(const int *)b;
+	return (left > right) - (left < right);
+}
+
+static int sort_unique(int * values, const int count) {
+	if (count == 0) {
+		return 0;
+	}
+
+	qsort(values, count, sizeof(*values), compare_ints);
+
+	int unique = 1;
+	for (int i = 1; i < count; i++) {
+		if (values[i] != values[unique - 1]) {
+			values[unique++] = values[i];
+		}
+	}
+	return unique;
+}
+
+// Slot 2k + 1 is edge k itself, slot 2k is the open interval just below edge k
+static int crtc_index_slot(const int * edges, const int count, const double value) {
+	int low = 0, high = count;
+	while (low < high) {
+		int middle = (low + high) / 2;
+		if (edges[middle] < value) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+
+	if (low < count && edges[low] == value) {
+		return 2 * low + 1;
+	}
+	return 2 * low;
+}
+
+int crtc_index_build(CRTCIndex * index, const CRTCRegion * regions, const int region_count) {
+	index->xs = malloc((2 * region_count + 1) * sizeof(*index->xs));
+	index->ys = malloc((2 * region_count + 1) * sizeof(*index->ys));
+	index->cells = NULL;
+
+	if (!index->xs || !index->ys) {
+		crtc_index_free(index);
+		return EINDEX_ALLOCATION_FAILED;
+	}
+
+	for (int i = 0; i < region_count; i++) {
+		index->xs[2 * i] = regions[i].region.left;
+		index->xs[2 * i + 1] = regions[i].region.right;
+		index->ys[2 * i] = regions[i].region.top;
+		index->ys[2 * i + 1] = regions[i].region.bottom;
+	}
+	index->x_count = sort_unique(index->xs, 2 * region_count);
+	index->y_count = sort_unique(index->ys, 2 * region_count);
+
+	const int columns = 2 * index->x_count + 1;
+	const int rows = 2 * index->y_count + 1;
+	index->cells = malloc((size_t)columns * rows * sizeof(*index->cells));
+	if (!index->cells) {
+		crtc_index_free(index);
+		return EINDEX_ALLOCATION_FAILED;
+	}
+
+	for (int i = 0; i < columns * rows; i++) {
+		index->cells[i] = -1;
+	}
+
+	// Paint back to front so earlier regions win where they overlap, as in the linear scan
+	for (int i = region_count - 1; i >= 0; i--) {
+		const Rectangle * region = &regions[i].region;
+		int left = crtc_index_slot(index->xs, index->x_count, region->left);
+		int right = crtc_index_slot(index->xs, index->x_count, region->right);
+		int top = crtc_index_slot(index->ys, index->y_count, region->top);
+		int bottom = crtc_index_slot(index->ys, index->y_count, region->bottom);
+
+		for (int row = top; row <= bottom; row++) {
+			for (int column = left; column <= right; column++) {
+				index->cells[row * columns + column] = i;
+			}
+		}
+	}
+
+	return 0;
+}
+
+int crtc_index_find(const CRTCIndex * index, const Point * point) {
+	if (!index->cells) {
+		return -1;
+	}
+
+	int column = crtc_index_slot(index->xs, index->x_count, point->x);
+	int row = crtc_index_slot(index->ys, index->y_count, point->y);
+	return index->cells[row * (2 * index->x_count + 1) + column];
+}
+
+void crtc_index_free(CRTCIndex * index) {
+	free(index->xs);
+	free(index->ys);
+	free(index->cells);
+	index->xs = index->ys = index->cells = NULL;
+	index->x_count = index->y_count = 0;
+}
+
+int xlib_wait_for_events(Display * display, const int timeout_ms, const sigset_t * wait_mask) {
+	// Queued events skip the wait, but signals the caller blocked must still be let in
+	int queued = XPending(display);
+	if (queued && !wait_mask) {
+		return queued;
+	}
+
+	int fd = ConnectionNumber(display);
+	fd_set readable;
+	FD_ZERO(&readable);
+	if (fd >= 0) {
+		FD_SET(fd, &readable);
+	}
+
+	struct timespec timeout = {0, 0};
+	if (!queued && timeout_ms > 0) {
+		timeout.tv_sec = timeout_ms / 1000;
+		timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+	}
+
+	int result = pselect(fd + 1, &readable, NULL, NULL, queued || timeout_ms >= 0 ? &timeout : NULL, wait_mask);
+	if (result <= 0) {
+		return queued && result == 0 ? queued : result;
+	}
+
+	// Readable data may only have been replies or errors, XPending will process them
+	return XPending(display);
+}
+
+// Xlib has a single error handler per process, so it stays installed while any display has a trap
+static pthread_mutex_t trap_lock = PTHREAD_MUTEX_INITIALIZER;
+static XErrorTrap * active_traps = NULL;
+static XErrorHandler previous_handler = NULL;
+
+static int xlib_error_trap_handler(Display * display, XErrorEvent * error) {
+	pthread_mutex_lock(&trap_lock);
+	XErrorTrap * trap = active_traps;
+	while (trap && trap->display != display) {
+		trap = trap->next;
+	}
+	XErrorHandler previous = previous_handler;
+	pthread_mutex_unlock(&trap_lock);
+
+	// Only the thread which owns display reads its errors, so the trap itself needs no lock
+	if (!trap) {
+		return previous ? previous(display, error) : 0;
+	}
+
+	if (trap->count >= trap->capacity) {
+		int capacity = trap->capacity ? trap->capacity * 2 : 16;
+		unsigned long * serials = realloc(trap->serials, capacity * sizeof(*serials));
+		unsigned char * codes = realloc(trap->codes, capacity * sizeof(*codes));
+		if (serials) {
+			trap->serials = serials;
+		}
+		if (codes) {
+			trap->codes = codes;
+		}
+		if (!serials || !codes) {
+			return 0;
+		}
+		trap->capacity = capacity;
+	}
+
+	trap->serials[trap->count] = error->serial;
+	trap->codes[trap->count] = error->error_code;
+	trap->count++;
+	return 0;
+}
+
+void xlib_error_trap_push(Display * display, XErrorTrap * trap) {
+	trap->display = display;
+	trap->serials = NULL;
+	trap->codes = NULL;
+	trap->count = trap->capacity = 0;
+
+	// No XSync here: callers attribute errors by serial, so stale errors are simply never matched
+	pthread_mutex_lock(&trap_lock);
+	if (!active_traps) {
+		previous_handler = XSetErrorHandler(xlib_error_trap_handler);
+	}
+	trap->next = active_traps;
+	active_traps = trap;
+	pthread_mutex_unlock(&trap_lock);
+}
+
+int xlib_error_trap_pop(Display * display, XErrorTrap * trap) {
+	XSync(display, False);
+
+	pthread_mutex_lock(&trap_lock);
+	XErrorTrap ** link = &active_traps;
+	while (*link && *link != trap) {
+		link = &(*link)->next;
+	}
+	if (*link) {
+		*link = trap->next;
+	}
+	if (!active_traps) {
+		XSetErrorHandler(previous_handler);
+		previous_handler = NULL;
+	}
+	pthread_mutex_unlock(&trap_lock);
+
+	trap->next = NULL;
+	return trap->count;
+}
+
+int xlib_error_trap_find(const XErrorTrap * trap, const unsigned long first, const unsigned long end) {
+	for (int i = 0; i < trap->count; i++) {
+		if (first <= trap->serials[i] && trap->serials[i] < end) {
+			return trap->codes[i];
+		}
+	}
+	return Success;
+}
+
+void xlib_error_trap_free(XErrorTrap * trap) {
+	free(trap->serials);
+	free(trap->codes);
+	trap->serials = NULL;
+	trap->codes = NULL;
+	trap->count = trap->capacity = 0;
+}
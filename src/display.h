@@ -1,6 +1,7 @@
 #ifndef XRESTRICT_DISPLAY_H_
 #define XRESTRICT_DISPLAY_H_
 
+#include <signal.h>
 #include <X11/Xlib.h>
 #include <X11/extensions/Xrandr.h>
 
@@ -26,4 +27,39 @@ int xlib_get_crtc_output_density(Display * display, XRRScreenResources * resourc
 
 int find_containing_crtc(CRTCRegion * regions, const int region_count, const Point * point);
 
+// Answers find_containing_crtc() queries with two binary searches and a table lookup.
+// Each axis is split at every CRTC edge into slots which are either an edge itself or
+// the open interval between two edges; every cell of slots records the first region
+// containing it, so results are identical to the linear scan, including on shared edges.
+typedef struct CRTCIndex {
+	int * xs, * ys; // Sorted, unique edges
+	int x_count, y_count;
+	int * cells;    // (2 * x_count + 1) * (2 * y_count + 1) region indices or -1
+} CRTCIndex;
+
+#define EINDEX_ALLOCATION_FAILED (-32)
+int crtc_index_build(CRTCIndex * index, const CRTCRegion * regions, const int region_count);
+int crtc_index_find(const CRTCIndex * index, const Point * point);
+void crtc_index_free(CRTCIndex * index);
+
+// Returns > 0 when events are queued, 0 on timeout and < 0 on error (including EINTR).
+// A non-NULL wait_mask replaces the signal mask only while waiting, see pselect.
+int xlib_wait_for_events(Display * display, const int timeout_ms, const sigset_t * wait_mask);
+
+// Collects asynchronous X errors so that many requests can be checked with a single XSync.
+// Traps on different displays may be active at once from different threads.
+typedef struct XErrorTrap {
+	Display * display;
+	struct XErrorTrap * next;
+	unsigned long * serials;
+	unsigned char * codes;
+	int count, capacity;
+} XErrorTrap;
+
+void xlib_error_trap_push(Display * display, XErrorTrap * trap);
+int xlib_error_trap_pop(Display * display, XErrorTrap * trap);
+// Returns the error code of the first error caused by requests in [first, end), or Success
+int xlib_error_trap_find(const XErrorTrap * trap, const unsigned long first, const unsigned long end);
+void xlib_error_trap_free(XErrorTrap * trap);
+
 #endif /* XRESTRICT_DISPLAY_H_ */
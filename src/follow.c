@@ -0,0 +1,274 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/XInput2.h>
+#include <X11/extensions/Xrandr.h>
+
+#include "follow.h"
+#include "context.h"
+#include "trace.h"
+
+static volatile sig_atomic_t follow_stop = 0;
+
+static void follow_signal_handler(int signal) {
+	follow_stop = 1;
+}
+
+// Matrices for every target on every CRTC, so switching monitors is only a property write
+typedef struct FollowTable {
+	float (*matrices)[9]; // region_count rows of count matrices
+	int *   results;
+	int     region_count;
+} FollowTable;
+
+static void follow_table_free(FollowTable * table) {
+	free(table->matrices);
+	free(table->results);
+	table->matrices = NULL;
+	table->results = NULL;
+	table->region_count = 0;
+}
+
+static int follow_table_compute(Display * display, Topology * topology, const Target * targets, const DeviceState * states, const int count, FollowTable * table) {
+	follow_table_free(table);
+
+	const int cells = topology->region_count * count;
+	table->matrices = calloc(cells ? cells : 1, sizeof(*table->matrices));
+	table->results = calloc(cells ? cells : 1, sizeof(*table->results));
+	if (!table->matrices || !table->results) {
+		follow_table_free(table);
+		return EFOLLOW_ALLOCATION_FAILED;
+	}
+	table->region_count = topology->region_count;
+
+	trace_begin("compute_matrices");
+	XRRScreenResources * resources = NULL;
+	for (int i = 0; i < count && !resources; i++) {
+		if (targets[i].one_to_one) {
+			resources = XRRGetScreenResourcesCurrent(display, DefaultRootWindow(display));
+		}
+	}
+
+	for (int crtc = 0; crtc < table->region_count; crtc++) {
+		for (int i = 0; i < count; i++) {
+			Target target = targets[i];
+			target.crtc_index = crtc;
+			target.full_screen = false;
+
+			const int cell = crtc * count + i;
+			if (!states[i].valid) {
+				table->results[cell] = EDEVICE_NOT_FOUND;
+			} else {
+				table->results[cell] = target_compute_matrix(display, resources, topology, &target, states + i, table->matrices[cell]);
+			}
+		}
+	}
+
+	if (resources) {
+		XRRFreeScreenResources(resources);
+	}
+	trace_end();
+	return 0;
+}
+
+static bool follow_near_region(const Rectangle * region, const Point * point) {
+	return point->x >= region->left - FOLLOW_HYSTERESIS_PX && point->x <= region->right + FOLLOW_HYSTERESIS_PX &&
+		point->y >= region->top - FOLLOW_HYSTERESIS_PX && point->y <= region->bottom + FOLLOW_HYSTERESIS_PX;
+}
+
+static int follow_select_crtc(const Topology * topology, const int current, const Point * point) {
+	if (current >= 0 && current < topology->region_count && follow_near_region(&topology->regions[current].region, point)) {
+		return current;
+	}
+
+	int crtc = crtc_index_find(&topology->index, point);
+	// Gaps between monitors don't belong to any CRTC, stay where we were
+	return crtc >= 0 ? crtc : current;
+}
+
+static void follow_switch(Display * display, const FollowTable * table, DeviceState * states, int * results, const int count, const int crtc, const ApplyMode mode) {
+	float (*matrices)[9] = table->matrices + crtc * count;
+
+	for (int i = 0; i < count; i++) {
+		results[i] = states[i].valid ? table->results[crtc * count + i] : EDEVICE_NOT_FOUND;
+	}
+
+	if (mode == APPLY_DRY_RUN) {
+		for (int i = 0; i < count; i++) {
+			if (results[i]) {
+				continue;
+			}
+			printf("CRTC %d: Device %lu: Coordinate Transformation Matrix = ", crtc, states[i].id);
+			print_matrix(stdout, matrices[i]);
+			printf("\n");
+		}
+		fflush(stdout);
+		return;
+	}
+
+	trace_begin("follow_switch");
+	if (mode == APPLY_ATOMIC) {
+		double held_ms;
+		target_write_atomic(display, states, matrices, results, count, &held_ms);
+	} else {
+		target_write_batch(display, states, matrices, results, count);
+	}
+	trace_end();
+
+	// Most likely unplugged, stop writing to it
+	for (int i = 0; i < count; i++) {
+		if (results[i] == ETARGET_SET_FAILED) {
+			states[i].valid = false;
+		}
+	}
+}
+
+// Raw events are only delivered to the root window, and unlike XI_Motion they aren't affected by grabs
+// or by which client the cursor is over. The context already selects the layout and hierarchy events.
+static void follow_select_events(Display * display) {
+	unsigned char mask_data[XIMaskLen(XI_RawMotion)] = {0};
+	XIEventMask mask = {
+		.deviceid = XIAllMasterDevices,
+		.mask_len = sizeof(mask_data),
+		.mask = mask_data
+	};
+	XISetMask(mask_data, XI_RawMotion);
+	XISelectEvents(display, DefaultRootWindow(display), &mask, 1);
+	XFlush(display);
+}
+
+typedef struct FollowChanges {
+	bool moved;
+	int  pointer;
+} FollowChanges;
+
+static void follow_drain_events(XRestrictContext * context, DeviceState * states, const int count, FollowChanges * changes) {
+	XEvent event;
+	XGenericEventCookie * cookie = &event.xcookie;
+
+	while (XPending(context->display)) {
+		XNextEvent(context->display, &event);
+
+		const bool data = cookie->type == GenericEvent && XGetEventData(context->display, cookie);
+		xrestrict_context_handle_event(context, &event);
+		if (data && cookie->extension == context->xi_opcode && cookie->evtype == XI_RawMotion) {
+			changes->pointer = ((XIRawEvent *)cookie->data)->deviceid;
+			changes->moved = true;
+		} else if (data && cookie->extension == context->xi_opcode && cookie->evtype == XI_PropertyEvent) {
+			// Someone else wrote a matrix, write ours again on the next switch
+			device_states_property_changed(context->display, states, count, cookie->data);
+		}
+		if (data) {
+			XFreeEventData(context->display, cookie);
+		}
+	}
+}
+
+int follow_run(XRestrictContext * context, const Target * targets, const int count, const ApplyMode mode) {
+	Display * display = context->display;
+	Topology * topology = &context->topology;
+	FollowTable table = {0};
+	DeviceState * states = calloc(count ? count : 1, sizeof(*states));
+	int * results = calloc(count ? count : 1, sizeof(*results));
+	int result = 0;
+
+	if (!states || !results) {
+		result = EFOLLOW_ALLOCATION_FAILED;
+		goto done;
+	}
+	// Devices unplugged since the last apply are forgotten before their states are taken over
+	xrestrict_context_process_events(context);
+	xrestrict_context_devices(context, targets, states, results, count);
+	if (follow_table_compute(display, topology, targets, states, count, &table)) {
+		result = EFOLLOW_ALLOCATION_FAILED;
+		goto done;
+	}
+	follow_select_events(display);
+
+	int pointer;
+	if (!XIGetClientPointer(display, None, &pointer)) {
+		pointer = 2; // The virtual core pointer
+	}
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = follow_signal_handler;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	// Stop requests are only let in while waiting, where they interrupt the wait
+	sigset_t blocked, unblocked;
+	sigemptyset(&blocked);
+	sigaddset(&blocked, SIGINT);
+	sigaddset(&blocked, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &blocked, &unblocked);
+
+	int current = -1;
+	// Place the devices on the pointer's monitor right away instead of on the next motion
+	FollowChanges changes = {.moved = true, .pointer = pointer};
+
+	while (!follow_stop) {
+		const bool topology_changed = context->topology_stale;
+		if (topology_changed) {
+			trace_begin("follow_topology");
+			if (xrestrict_context_refresh_topology(context) || follow_table_compute(display, topology, targets, states, count, &table)) {
+				fprintf(stderr, "Failed to retrieve crtc region information.\n");
+			}
+			trace_end();
+			current = -1;
+		}
+
+		if (changes.moved || topology_changed) {
+			Window root, child;
+			double root_x, root_y, window_x, window_y;
+			XIButtonState buttons = {0};
+			XIModifierState modifiers;
+			XIGroupState group;
+
+			pointer = changes.pointer;
+			// However many motion events arrived, one query tells us where the pointer ended up
+			trace_begin("follow_query_pointer");
+			Bool on_screen = XIQueryPointer(display, pointer, DefaultRootWindow(display), &root, &child,
+				&root_x, &root_y, &window_x, &window_y, &buttons, &modifiers, &group);
+			trace_end();
+			free(buttons.mask);
+
+			if (on_screen) {
+				Point point = {root_x, root_y};
+				int crtc = follow_select_crtc(topology, current, &point);
+
+				if (crtc >= 0 && crtc != current && crtc < table.region_count) {
+#					if DEBUG
+						printf("Pointer at %.0f, %.0f is now on CRTC %d\n", root_x, root_y, crtc);
+#					endif
+					follow_switch(display, &table, states, results, count, crtc, mode);
+					current = crtc;
+				}
+			}
+		}
+
+		memset(&changes, 0, sizeof(changes));
+		changes.pointer = pointer;
+
+		int wait_result = xlib_wait_for_events(display, -1, &unblocked);
+		if (wait_result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			result = EFOLLOW_WAIT_FAILED;
+			break;
+		}
+
+		follow_drain_events(context, states, count, &changes);
+	}
+	pthread_sigmask(SIG_SETMASK, &unblocked, NULL);
+
+done:
+	follow_table_free(&table);
+	free(states);
+	free(results);
+	return result;
+}
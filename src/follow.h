@@ -0,0 +1,19 @@
+#ifndef XRESTRICT_FOLLOW_H_
+#define XRESTRICT_FOLLOW_H_
+
+#include <stdbool.h>
+#include <X11/Xlib.h>
+
+#include "apply.h"
+#include "context.h"
+
+// The pointer must be this far past the edge of the current monitor before we switch away from it
+#define FOLLOW_HYSTERESIS_PX 24
+
+#define EFOLLOW_WAIT_FAILED       (-4)
+#define EFOLLOW_ALLOCATION_FAILED (-8)
+// Restricts every target to whichever CRTC the pointer is on until interrupted. With APPLY_ATOMIC every
+// switch moves all devices inside one server grab, or none of them.
+int follow_run(XRestrictContext * context, const Target * targets, const int count, const ApplyMode mode);
+
+#endif /* XRESTRICT_FOLLOW_H_ */
@@ -0,0 +1,441 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "generate.h"
+
+// The descriptions one worker computes, and what it printed for them
+typedef struct GenerateShard {
+	GenerateTopology * topologies;
+	int                count;
+	char *             text;
+	size_t             size;
+	int                failures;
+	int                result;
+} GenerateShard;
+
+typedef struct GenerateReader {
+	FILE * input;
+	int    line_number;
+	bool   done;
+	bool   pending;                       // A "topology" line was read which starts the next chunk
+	char   pending_name[MAX_TOPOLOGY_NAME];
+} GenerateReader;
+
+static bool generate_grow(void ** items, int * capacity, const int count, const size_t size) {
+	if (count < *capacity) {
+		return true;
+	}
+
+	int new_capacity = *capacity ? *capacity * 2 : 4;
+	void * grown = realloc(*items, new_capacity * size);
+	if (!grown) {
+		return false;
+	}
+	*items = grown;
+	*capacity = new_capacity;
+	return true;
+}
+
+static bool generate_parse_size(const char * token, int * width, int * height) {
+	char extra;
+	return sscanf(token, "%dx%d%c", width, height, &extra) == 2 && *width > 0 && *height > 0;
+}
+
+// WIDTHxHEIGHT+X+Y as xrandr prints it, the offset may be left out
+static bool generate_parse_geometry(const char * token, Rectangle * region) {
+	int width, height, x = 0, y = 0;
+	char extra;
+	int fields = sscanf(token, "%dx%d%d%d%c", &width, &height, &x, &y, &extra);
+	if ((fields != 2 && fields != 4) || width <= 0 || height <= 0) {
+		return false;
+	}
+
+	region->left = x;
+	region->top = y;
+	region->right = x + width;
+	region->bottom = y + height;
+	return true;
+}
+
+static void generate_topology_free(GenerateTopology * topology) {
+	topology_free(&topology->topology);
+	free(topology->outputs);
+	free(topology->devices);
+	free(topology->list.targets);
+	free(topology->lines);
+	memset(topology, 0, sizeof(*topology));
+}
+
+static void generate_topology_start(GenerateTopology * topology, const char * name) {
+	memset(topology, 0, sizeof(*topology));
+	strcpy(topology->name, name);
+}
+
+static int generate_parse_crtc(GenerateTopology * topology, char ** tokens, const int token_count, const int line_number) {
+	Topology * layout = &topology->topology;
+	int capacity = layout->region_capacity;
+
+	if (token_count < 2 || token_count > 4) {
+		fprintf(stderr, "Line %d must look like \"crtc WIDTHxHEIGHT+X+Y [OUTPUT] [MM_WIDTHxMM_HEIGHT]\".\n", line_number);
+		return EGENERATE_PARSE;
+	}
+
+	if (!generate_grow((void **)&layout->regions, &capacity, layout->region_count, sizeof(*layout->regions)) ||
+		!generate_grow((void **)&topology->outputs, &layout->region_capacity, layout->region_count, sizeof(*topology->outputs))) {
+		return EGENERATE_ALLOCATION;
+	}
+
+	CRTCRegion * region = layout->regions + layout->region_count;
+	char * output = topology->outputs[layout->region_count];
+	memset(region, 0, sizeof(*region));
+	output[0] = '\0';
+
+	if (!generate_parse_geometry(tokens[1], &region->region)) {
+		fprintf(stderr, "Failed to parse CRTC geometry \"%s\" on line %d.\n", tokens[1], line_number);
+		return EGENERATE_PARSE;
+	}
+
+	// Stand-ins for the XIDs a server would hand out
+	region->crtc = region->output = layout->region_count + 1;
+
+	// Output names never look like a size, so either may come first or be left out
+	for (int i = 2; i < token_count; i++) {
+		if (generate_parse_size(tokens[i], &region->width, &region->height)) {
+			continue;
+		}
+		if (output[0] || strlen(tokens[i]) >= MAX_OUTPUT_NAME) {
+			fprintf(stderr, "Invalid output \"%s\" on line %d.\n", tokens[i], line_number);
+			return EGENERATE_PARSE;
+		}
+		strcpy(output, tokens[i]);
+	}
+
+	layout->region_count++;
+	return 0;
+}
+
+static int generate_parse_device(GenerateTopology * topology, char ** tokens, const int token_count, const int line_number) {
+	if (token_count < 3 || token_count > 4) {
+		fprintf(stderr, "Line %d must look like \"device DEVICEID WIDTHxHEIGHT[+MINX+MINY] [HRESxVRES]\".\n", line_number);
+		return EGENERATE_PARSE;
+	}
+
+	if (!generate_grow((void **)&topology->devices, &topology->device_capacity, topology->device_count, sizeof(*topology->devices))) {
+		return EGENERATE_ALLOCATION;
+	}
+
+	GenerateDevice * device = topology->devices + topology->device_count;
+	memset(device, 0, sizeof(*device));
+
+	if (parse_device_id(tokens[1], &device->id) != OPTION_CONSUMED) {
+		return EGENERATE_PARSE;
+	}
+	for (int i = 0; i < topology->device_count; i++) {
+		if (topology->devices[i].id == device->id) {
+			fprintf(stderr, "Device %d is described twice, again on line %d.\n", device->id, line_number);
+			return EGENERATE_PARSE;
+		}
+	}
+
+	if (!generate_parse_geometry(tokens[2], &device->region.region)) {
+		fprintf(stderr, "Failed to parse valuator range \"%s\" on line %d.\n", tokens[2], line_number);
+		return EGENERATE_PARSE;
+	}
+	if (token_count == 4 && !generate_parse_size(tokens[3], &device->region.hres, &device->region.vres)) {
+		fprintf(stderr, "Failed to parse resolution \"%s\" on line %d.\n", tokens[3], line_number);
+		return EGENERATE_PARSE;
+	}
+
+	topology->device_count++;
+	return 0;
+}
+
+static int generate_parse_target(GenerateTopology * topology, char * line, const int line_number) {
+	const int count = topology->list.count;
+	if (parse_target_line(line, line_number, &topology->list, &target_defaults) != OPTION_CONSUMED) {
+		return EGENERATE_PARSE;
+	}
+	if (topology->list.count == count) {
+		return 0;
+	}
+
+	if (topology->list.targets[count].device_id == INVALID_DEVICE_ID) {
+		fprintf(stderr, "Line %d must pick its device with -d, there is no server to match selectors against.\n", line_number);
+		return EGENERATE_PARSE;
+	}
+
+	if (!generate_grow((void **)&topology->lines, &topology->line_capacity, count, sizeof(*topology->lines))) {
+		return EGENERATE_ALLOCATION;
+	}
+	topology->lines[count] = line_number;
+	return 0;
+}
+
+// Reads descriptions until max of them are complete or the input ends. The "topology" line which
+// would start description max + 1 is kept for the next call.
+static int generate_read(GenerateReader * reader, GenerateTopology * topologies, const int max, int * count) {
+	char line[1024];
+	*count = 0;
+
+	if (reader->pending) {
+		generate_topology_start(topologies, reader->pending_name);
+		reader->pending = false;
+		*count = 1;
+	}
+
+	while (fgets(line, sizeof(line), reader->input)) {
+		const int line_number = ++reader->line_number;
+		GenerateTopology * current = *count ? topologies + *count - 1 : NULL;
+
+		const size_t start = strspn(line, " \t");
+		const size_t length = strcspn(line + start, " \t\r\n");
+		const char * keyword = line + start;
+
+		bool directive = false;
+		const char * directives[] = { "topology", "screen", "crtc", "device" };
+		for (int i = 0; i < sizeof(directives) / sizeof(*directives); i++) {
+			directive |= length == strlen(directives[i]) && strncmp(keyword, directives[i], length) == 0;
+		}
+
+		if (!directive) {
+			if (length == 0 || keyword[0] == '#') {
+				continue;
+			}
+			if (!current) {
+				fprintf(stderr, "Line %d comes before the first \"topology\" line.\n", line_number);
+				return EGENERATE_PARSE;
+			}
+			int result = generate_parse_target(current, line, line_number);
+			if (result) {
+				return result;
+			}
+			continue;
+		}
+
+		char * tokens[MAX_SPEC_TOKENS];
+		int token_count = 0;
+		for (char * token = strtok(line, " \t\r\n"); token && token_count < MAX_SPEC_TOKENS; token = strtok(NULL, " \t\r\n")) {
+			tokens[token_count++] = token;
+		}
+
+		if (token_count && strcmp(tokens[0], "topology") == 0) {
+			if (token_count != 2 || strlen(tokens[1]) >= MAX_TOPOLOGY_NAME) {
+				fprintf(stderr, "Line %d must look like \"topology NAME\", with NAME shorter than %d characters.\n", line_number, MAX_TOPOLOGY_NAME);
+				return EGENERATE_PARSE;
+			}
+
+			if (*count >= max) {
+				strcpy(reader->pending_name, tokens[1]);
+				reader->pending = true;
+				return 0;
+			}
+			generate_topology_start(topologies + (*count)++, tokens[1]);
+			continue;
+		}
+
+		if (!current) {
+			fprintf(stderr, "Line %d comes before the first \"topology\" line.\n", line_number);
+			return EGENERATE_PARSE;
+		}
+
+		int result;
+		if (strcmp(tokens[0], "crtc") == 0) {
+			result = generate_parse_crtc(current, tokens, token_count, line_number);
+		} else if (strcmp(tokens[0], "device") == 0) {
+			result = generate_parse_device(current, tokens, token_count, line_number);
+		} else if (token_count == 2 && generate_parse_size(tokens[1], &current->topology.screen_size.region.right, &current->topology.screen_size.region.bottom)) {
+			current->screen_set = true;
+			result = 0;
+		} else {
+			fprintf(stderr, "Line %d must look like \"screen WIDTHxHEIGHT\".\n", line_number);
+			result = EGENERATE_PARSE;
+		}
+		if (result) {
+			return result;
+		}
+	}
+
+	reader->done = true;
+	return 0;
+}
+
+static void generate_print_string(FILE * file, const char * string) {
+	fputc('"', file);
+	for (; *string; string++) {
+		if (*string == '"' || *string == '\\') {
+			fprintf(file, "\\%c", *string);
+		} else if ((unsigned char)*string < 0x20) {
+			fprintf(file, "\\u%04x", *string);
+		} else {
+			fputc(*string, file);
+		}
+	}
+	fputc('"', file);
+}
+
+static int generate_target(GenerateTopology * topology, const int index, float * matrix) {
+	Target target = topology->list.targets[index];
+
+	const GenerateDevice * device = NULL;
+	for (int i = 0; i < topology->device_count && !device; i++) {
+		if (topology->devices[i].id == target.device_id) {
+			device = topology->devices + i;
+		}
+	}
+	if (!device) {
+		return EDEVICE_NOT_FOUND;
+	}
+
+	if (target.output[0]) {
+		target.crtc_index = -1;
+		for (int i = 0; i < topology->topology.region_count && target.crtc_index < 0; i++) {
+			if (strcmp(topology->outputs[i], target.output) == 0) {
+				target.crtc_index = i;
+			}
+		}
+		if (target.crtc_index < 0) {
+			return ETARGET_OUTPUT_NOT_FOUND;
+		}
+	}
+
+	DeviceState state;
+	memset(&state, 0, sizeof(state));
+	state.id = device->id;
+	state.region = device->region;
+	state.valid = true;
+
+	// Every monitor size was read up front, so the display and resources are never needed
+	return target_compute_matrix(NULL, NULL, &topology->topology, &target, &state, matrix);
+}
+
+static void * generate_shard(void * argument) {
+	GenerateShard * shard = argument;
+
+	FILE * file = open_memstream(&shard->text, &shard->size);
+	if (!file) {
+		shard->result = EGENERATE_ALLOCATION;
+		return NULL;
+	}
+
+	for (int t = 0; t < shard->count; t++) {
+		GenerateTopology * topology = shard->topologies + t;
+		Topology * layout = &topology->topology;
+
+		// X screens start at the origin and cover every CRTC
+		if (!topology->screen_set) {
+			for (int i = 0; i < layout->region_count; i++) {
+				const Rectangle * region = &layout->regions[i].region;
+				if (region->right > layout->screen_size.region.right) {
+					layout->screen_size.region.right = region->right;
+				}
+				if (region->bottom > layout->screen_size.region.bottom) {
+					layout->screen_size.region.bottom = region->bottom;
+				}
+			}
+		}
+
+		for (int i = 0; i < topology->list.count; i++) {
+			float matrix[9];
+			int result = generate_target(topology, i, matrix);
+
+			fprintf(file, "{\"topology\": ");
+			generate_print_string(file, topology->name);
+			fprintf(file, ", \"line\": %d, \"device\": %d, ", topology->lines[i], topology->list.targets[i].device_id);
+
+			if (result) {
+				const char * error = result == EDEVICE_NOT_FOUND ? "no such device" :
+					result == ETARGET_OUTPUT_NOT_FOUND ? "no such output" :
+					result == ETARGET_CRTC_OUT_OF_RANGE ? "crtc out of range" :
+					result == ETARGET_OUTPUT_DENSITY ? "missing output or device size" : "failed";
+				fprintf(file, "\"error\": \"%s\"}\n", error);
+				shard->failures++;
+				continue;
+			}
+
+			fprintf(file, "\"matrix\": [");
+			for (int j = 0; j < 9; j++) {
+				fprintf(file, j ? ", %.9g" : "%.9g", matrix[j]);
+			}
+			fprintf(file, "]}\n");
+		}
+	}
+
+	if (fclose(file)) {
+		shard->result = EGENERATE_ALLOCATION;
+	}
+	return NULL;
+}
+
+int generate_run(FILE * input, FILE * output, const int jobs) {
+	const int max = GENERATE_CHUNK * jobs;
+	GenerateTopology * topologies = calloc(max, sizeof(*topologies));
+	GenerateShard * shards = calloc(jobs, sizeof(*shards));
+	pthread_t * threads = calloc(jobs, sizeof(*threads));
+	bool * started = calloc(jobs, sizeof(*started));
+	GenerateReader reader = { .input = input };
+	int result = 0, failures = 0;
+
+	if (!topologies || !shards || !threads || !started) {
+		result = EGENERATE_ALLOCATION;
+		goto done;
+	}
+
+	while (!result && !reader.done) {
+		int count;
+		result = generate_read(&reader, topologies, max, &count);
+
+		// Contiguous shards keep the output in input order
+		const int per_shard = (count + jobs - 1) / jobs;
+		for (int i = 0; i < jobs && !result; i++) {
+			GenerateShard * shard = shards + i;
+			memset(shard, 0, sizeof(*shard));
+			shard->topologies = topologies + i * per_shard;
+			shard->count = count - i * per_shard < per_shard ? count - i * per_shard : per_shard;
+			if (shard->count < 0) {
+				shard->count = 0;
+			}
+			started[i] = i > 0 && shard->count && !pthread_create(threads + i, NULL, generate_shard, shard);
+		}
+
+		// A shard without a thread is still computed, just not in parallel
+		for (int i = 0; i < jobs && !result; i++) {
+			if (started[i]) {
+				pthread_join(threads[i], NULL);
+			} else if (shards[i].count) {
+				generate_shard(shards + i);
+			}
+		}
+
+		for (int i = 0; i < jobs && !result; i++) {
+			if (shards[i].result) {
+				result = shards[i].result;
+			} else if (shards[i].size && fwrite(shards[i].text, 1, shards[i].size, output) != shards[i].size) {
+				result = EGENERATE_WRITE;
+			}
+			failures += shards[i].failures;
+		}
+		for (int i = 0; i < jobs; i++) {
+			free(shards[i].text);
+			shards[i].text = NULL;
+			shards[i].size = 0;
+		}
+
+		for (int i = 0; i < max; i++) {
+			generate_topology_free(topologies + i);
+		}
+	}
+
+	if (fflush(output) && !result) {
+		result = EGENERATE_WRITE;
+	}
+
+done:
+	free(topologies);
+	free(shards);
+	free(threads);
+	free(started);
+	return result ? result : failures ? EGENERATE_FAILED : 0;
+}
@@ -0,0 +1,56 @@
+#ifndef XRESTRICT_GENERATE_H_
+#define XRESTRICT_GENERATE_H_
+
+#include <stdio.h>
+
+#include "apply.h"
+#include "options.h"
+
+#define MAX_TOPOLOGY_NAME 64
+
+// How many descriptions are read before they are handed to the workers, per worker
+#define GENERATE_CHUNK 64
+
+// A monitor and device layout read from a description instead of queried from a server.
+// Descriptions are line based and look like
+//
+//   topology kiosk-17
+//   screen 3200x1080
+//   crtc 1920x1080+0+0 HDMI-1 477x268
+//   crtc 1280x1024+1920+0 DP-1 376x301
+//   device 12 44704x27940 200000x200000
+//   -d 12 -O DP-1 --one
+//
+// "screen" defaults to the bounding box of the CRTCs. A CRTC needs its output's size in mm only
+// for one-to-one targets, and may leave out its output name when no target uses -O. A device
+// gives its valuator range as WIDTHxHEIGHT[+MINX+MINY] and may add its resolution in units per
+// meter. Targets use the --stdin format, but must pick their device with -d.
+typedef struct GenerateDevice {
+	int           id;
+	PointerRegion region;
+} GenerateDevice;
+
+typedef struct GenerateTopology {
+	char             name[MAX_TOPOLOGY_NAME];
+	Topology         topology;
+	char          (* outputs)[MAX_OUTPUT_NAME]; // One per region
+	bool             screen_set;
+	GenerateDevice * devices;
+	int              device_count, device_capacity;
+	TargetList       list;
+	int *            lines;                     // The line each target was read from
+	int              line_capacity;
+} GenerateTopology;
+
+#define EGENERATE_PARSE      (-1)
+#define EGENERATE_ALLOCATION (-2)
+#define EGENERATE_WRITE      (-4)
+#define EGENERATE_FAILED     (-8)
+// Reads descriptions from input until its end and writes one JSON object per target to output, in
+// input order, either {"topology": ..., "line": ..., "device": ..., "matrix": [...]} or the same with
+// "error" in place of "matrix". Each chunk of descriptions is split among jobs threads. Stops at the
+// first line it can't parse, which is reported on stderr along with its line number, and returns
+// EGENERATE_FAILED when every description was read but some matrices couldn't be computed.
+int generate_run(FILE * input, FILE * output, const int jobs);
+
+#endif /* XRESTRICT_GENERATE_H_ */
@@ -1,6 +1,16 @@
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include "input.h"
+#include "display.h"
+#include "trace.h"
+#include <X11/Xatom.h>
 #include <X11/cursorfont.h>
 
 const float identity[9] = {
@@ -29,6 +39,63 @@ void calculate_coordinate_transform_matrix(const Rectangle * region, const Recta
 	matrix[8] = 1;
 }
 
+void calibration_fit_reset(CalibrationFit * fit) {
+	memset(fit, 0, sizeof(*fit));
+}
+
+void calibration_fit_add(CalibrationFit * fit, const Point * device, const Point * screen) {
+	const double values[4] = {device->x, device->y, screen->x, screen->y};
+	double deltas[4];
+
+	fit->count++;
+	for (int i = 0; i < 4; i++) {
+		deltas[i] = values[i] - fit->mean[i];
+		fit->mean[i] += deltas[i] / fit->count;
+	}
+
+	const double weight = (fit->count - 1) / fit->count;
+	for (int i = 0; i < 4; i++) {
+		for (int j = i; j < 4; j++) {
+			fit->moment[i][j] += deltas[i] * deltas[j] * weight;
+		}
+	}
+}
+
+int calibration_fit_solve(const CalibrationFit * fit, float * matrix, Point * residual) {
+	const double uu = fit->moment[0][0], uv = fit->moment[0][1], vv = fit->moment[1][1];
+	const double determinant = uu * vv - uv * uv;
+
+	// Samples along a single line leave the other direction undetermined
+	if (fit->count < 3 || uu <= 0 || vv <= 0 || determinant <= 1e-9 * uu * vv) {
+		return ECALIBRATION_DEGENERATE;
+	}
+
+	// Each screen axis is its own 2x2 system about the means, the offset follows from them
+	double rms[2];
+	for (int axis = 0; axis < 2; axis++) {
+		const double ux = fit->moment[0][2 + axis], vx = fit->moment[1][2 + axis];
+		const double a = (ux * vv - vx * uv) / determinant;
+		const double b = (vx * uu - ux * uv) / determinant;
+
+		matrix[axis * 3] = a;
+		matrix[axis * 3 + 1] = b;
+		matrix[axis * 3 + 2] = fit->mean[2 + axis] - a * fit->mean[0] - b * fit->mean[1];
+
+		double squares = fit->moment[2 + axis][2 + axis] - a * ux - b * vx;
+		rms[axis] = sqrt((squares > 0 ? squares : 0) / fit->count);
+	}
+
+	matrix[6] = 0;
+	matrix[7] = 0;
+	matrix[8] = 1;
+
+	if (residual) {
+		residual->x = rms[0];
+		residual->y = rms[1];
+	}
+	return 0;
+}
+
 void rectangle_scale(const Rectangle * rectangle, const float x, const float y, Rectangle * result) {
 	result->left = rectangle->left * x;
 	result->right = rectangle->right * x;
@@ -111,11 +178,223 @@ void rectangle_align(const Rectangle * reference,
 	}
 }
 
-int xi2_device_set_matrix(Display * display, const XID id, const float * matrix) {
-	static Atom atoms[2] = {0};
+int rectangle_batch_alloc(RectangleBatch * batch, const int count) {
+	const int padded = count > 0 ? RECTANGLE_BATCH_PADDED(count) : RECTANGLE_BATCH_LANES;
+	int * values = malloc(4 * padded * sizeof(*values));
+
+	memset(batch, 0, sizeof(*batch));
+	if (!values) {
+		return EBATCH_ALLOCATION_FAILED;
+	}
+
+	batch->top = values;
+	batch->left = values + padded;
+	batch->bottom = values + 2 * padded;
+	batch->right = values + 3 * padded;
+	batch->count = count;
+
+	const Rectangle unit = {.top = 0, .left = 0, .bottom = 1, .right = 1};
+	for (int i = 0; i < padded; i++) {
+		rectangle_batch_set(batch, i, &unit);
+	}
+	return 0;
+}
+
+void rectangle_batch_free(RectangleBatch * batch) {
+	free(batch->top);
+	memset(batch, 0, sizeof(*batch));
+}
+
+void rectangle_batch_set(RectangleBatch * batch, const int index, const Rectangle * rectangle) {
+	batch->top[index] = rectangle->top;
+	batch->left[index] = rectangle->left;
+	batch->bottom[index] = rectangle->bottom;
+	batch->right[index] = rectangle->right;
+}
+
+void rectangle_batch_get(const RectangleBatch * batch, const int index, Rectangle * rectangle) {
+	rectangle->top = batch->top[index];
+	rectangle->left = batch->left[index];
+	rectangle->bottom = batch->bottom[index];
+	rectangle->right = batch->right[index];
+}
+
+int matrix_batch_alloc(MatrixBatch * batch, const int count) {
+	const int padded = count > 0 ? RECTANGLE_BATCH_PADDED(count) : RECTANGLE_BATCH_LANES;
+	float * values = calloc(4 * padded, sizeof(*values));
+
+	memset(batch, 0, sizeof(*batch));
+	if (!values) {
+		return EBATCH_ALLOCATION_FAILED;
+	}
+
+	batch->x_scale = values;
+	batch->x_offset = values + padded;
+	batch->y_scale = values + 2 * padded;
+	batch->y_offset = values + 3 * padded;
+	batch->count = count;
+	return 0;
+}
+
+void matrix_batch_free(MatrixBatch * batch) {
+	free(batch->x_scale);
+	memset(batch, 0, sizeof(*batch));
+}
+
+void matrix_batch_get(const MatrixBatch * batch, const int index, float * matrix) {
+	memcpy(matrix, identity, sizeof(identity));
+	matrix[0] = batch->x_scale[index];
+	matrix[2] = batch->x_offset[index];
+	matrix[4] = batch->y_scale[index];
+	matrix[5] = batch->y_offset[index];
+}
+
+// Each kernel works on one block of RECTANGLE_BATCH_LANES entries at a time. With a constant trip count
+// and restrict pointers the compiler replaces every loop over a block by vector instructions, as long as
+// no loop selects on a setting shared by the whole batch, such as the aspect type or the affinity.
+static inline void rectangle_ratio_block(const int * restrict target_top, const int * restrict target_left,
+										 const int * restrict target_bottom, const int * restrict target_right,
+										 const int * restrict original_top, const int * restrict original_left,
+										 const int * restrict original_bottom, const int * restrict original_right,
+										 const CTMAspectPreserveType type, float * restrict ratios) {
+	float horizontal_ratios[RECTANGLE_BATCH_LANES], vertical_ratios[RECTANGLE_BATCH_LANES];
+
+	// The same operations in the same order as rectangle_select_ratio_preserve_aspect, so results match exactly
+	for (int i = 0; i < RECTANGLE_BATCH_LANES; i++) {
+		horizontal_ratios[i] = (float)(target_right[i] - target_left[i]) / (original_right[i] - original_left[i]);
+		vertical_ratios[i] = (float)(target_bottom[i] - target_top[i]) / (original_bottom[i] - original_top[i]);
+	}
+
+	if (type == CTM_Fit) {
+		for (int i = 0; i < RECTANGLE_BATCH_LANES; i++) {
+			ratios[i] = horizontal_ratios[i] > vertical_ratios[i] ? horizontal_ratios[i] : vertical_ratios[i];
+		}
+	} else if (type == CTM_MatchWidth) {
+		memcpy(ratios, horizontal_ratios, sizeof(horizontal_ratios));
+	} else if (type == CTM_MatchHeight) {
+		memcpy(ratios, vertical_ratios, sizeof(vertical_ratios));
+	} else {
+		for (int i = 0; i < RECTANGLE_BATCH_LANES; i++) {
+			ratios[i] = 1;
+		}
+	}
+}
+
+void rectangle_select_ratio_preserve_aspect_batch(const RectangleBatch * targets, const RectangleBatch * originals, const CTMAspectPreserveType type, float * ratios) {
+	for (int block = 0; block < targets->count; block += RECTANGLE_BATCH_LANES) {
+		rectangle_ratio_block(targets->top + block, targets->left + block, targets->bottom + block, targets->right + block,
+							  originals->top + block, originals->left + block, originals->bottom + block, originals->right + block,
+							  type, ratios + block);
+	}
+}
+
+static inline void rectangle_scale_block(const int * restrict target_top, const int * restrict target_left,
+										 const int * restrict target_bottom, const int * restrict target_right,
+										 const int * restrict original_top, const int * restrict original_left,
+										 const int * restrict original_bottom, const int * restrict original_right,
+										 const CTMAspectPreserveType type,
+										 int * restrict result_top, int * restrict result_left,
+										 int * restrict result_bottom, int * restrict result_right) {
+	float ratios[RECTANGLE_BATCH_LANES];
+	rectangle_ratio_block(target_top, target_left, target_bottom, target_right,
+						  original_top, original_left, original_bottom, original_right, type, ratios);
+
+	// As rectangle_scale truncates the scaled origin sized rectangle
+	for (int i = 0; i < RECTANGLE_BATCH_LANES; i++) {
+		result_top[i] = 0;
+		result_left[i] = 0;
+		result_bottom[i] = (original_bottom[i] - original_top[i]) * ratios[i];
+		result_right[i] = (original_right[i] - original_left[i]) * ratios[i];
+	}
+}
+
+void rectangle_scale_preserve_aspect_batch(const RectangleBatch * targets, const RectangleBatch * originals, const CTMAspectPreserveType type, RectangleBatch * results) {
+	for (int block = 0; block < targets->count; block += RECTANGLE_BATCH_LANES) {
+		rectangle_scale_block(targets->top + block, targets->left + block, targets->bottom + block, targets->right + block,
+							  originals->top + block, originals->left + block, originals->bottom + block, originals->right + block,
+							  type, results->top + block, results->left + block, results->bottom + block, results->right + block);
+	}
+}
+
+static inline void rectangle_align_block(const int * restrict reference_top, const int * restrict reference_left,
+										 const int * restrict reference_bottom, const int * restrict reference_right,
+										 const int * restrict alignee_top, const int * restrict alignee_left,
+										 const int * restrict alignee_bottom, const int * restrict alignee_right,
+										 const CTMHorizontalAffinity horizontal, const CTMVerticalAffinity vertical,
+										 int * restrict result_top, int * restrict result_left,
+										 int * restrict result_bottom, int * restrict result_right) {
+	// All ones or all zeroes, selecting the shift rectangle_align applies for the affinity
+	const int right = -(horizontal == HA_Right), x_centered = -(horizontal == HA_Centered);
+	const int bottom = -(vertical == VA_Bottom), y_centered = -(vertical == VA_Centered);
+
+	for (int i = 0; i < RECTANGLE_BATCH_LANES; i++) {
+		const int width = alignee_right[i] - alignee_left[i];
+		const int height = alignee_bottom[i] - alignee_top[i];
+		const int x_offset = width - (reference_right[i] - reference_left[i]);
+		const int y_offset = height - (reference_bottom[i] - reference_top[i]);
+		const int x_shift = (x_offset & right) | ((x_offset / 2) & x_centered);
+		const int y_shift = (y_offset & bottom) | ((y_offset / 2) & y_centered);
+
+		result_top[i] = reference_top[i] - y_shift;
+		result_left[i] = reference_left[i] - x_shift;
+		result_bottom[i] = reference_top[i] + height - y_shift;
+		result_right[i] = reference_left[i] + width - x_shift;
+	}
+}
+
+void rectangle_align_batch(const RectangleBatch * references, const RectangleBatch * alignees, const CTMAffinity * affinity, RectangleBatch * results) {
+	const CTMHorizontalAffinity horizontal = affinity ? affinity->horizontal : HA_Left;
+	const CTMVerticalAffinity vertical = affinity ? affinity->vertical : VA_Top;
+
+	for (int block = 0; block < references->count; block += RECTANGLE_BATCH_LANES) {
+		rectangle_align_block(references->top + block, references->left + block, references->bottom + block, references->right + block,
+							  alignees->top + block, alignees->left + block, alignees->bottom + block, alignees->right + block,
+							  horizontal, vertical, results->top + block, results->left + block, results->bottom + block, results->right + block);
+	}
+}
+
+static inline void ctm_block(const int * restrict top, const int * restrict left,
+							 const int * restrict bottom, const int * restrict right,
+							 const float screen_width, const float screen_height,
+							 float * restrict x_scale, float * restrict x_offset,
+							 float * restrict y_scale, float * restrict y_offset) {
+	for (int i = 0; i < RECTANGLE_BATCH_LANES; i++) {
+		x_scale[i] = (right[i] - left[i]) / screen_width;
+		y_scale[i] = (bottom[i] - top[i]) / screen_height;
+		x_offset[i] = left[i] / screen_width;
+		y_offset[i] = top[i] / screen_height;
+	}
+}
+
+void calculate_coordinate_transform_matrix_batch(const RectangleBatch * regions, const Rectangle * screen_size, MatrixBatch * matrices) {
+	const float screen_width = RECT_WIDTH(*screen_size), screen_height = RECT_HEIGHT(*screen_size);
+
+	for (int block = 0; block < regions->count; block += RECTANGLE_BATCH_LANES) {
+		ctm_block(regions->top + block, regions->left + block, regions->bottom + block, regions->right + block,
+				  screen_width, screen_height, matrices->x_scale + block, matrices->x_offset + block,
+				  matrices->y_scale + block, matrices->y_offset + block);
+	}
+}
+
+// Looking up the matrix atoms costs a round trip, so only do it once per connection
+int xi2_matrix_atoms(Display * display, Atom * atoms) {
 	static char * names[] = {"Coordinate Transformation Matrix", "FLOAT"};
 
-	if (!XInternAtoms(display, names, 2, True, atoms)) {
+	// Xlib caches interned atoms per display, so only the first call makes a round trip
+	trace_begin("intern_atoms");
+	Status interned = XInternAtoms(display, names, 2, True, atoms);
+	trace_end();
+
+	if (!interned) {
+		return EINTERN_FAILED;
+	}
+	return 0;
+}
+
+int xi2_device_set_matrix(Display * display, const XID id, const float * matrix) {
+	Atom atoms[2];
+
+	if (xi2_matrix_atoms(display, atoms)) {
 		return EINTERN_FAILED;
 	}
 
@@ -130,10 +409,9 @@ int xi2_device_set_matrix(Display * display, const XID id, const float * matrix)
 }
 
 int xi2_device_get_matrix(Display * display, const XID id, float * matrix) {
-	static Atom atoms[2] = {0};
-	static char * names[] = {"Coordinate Transformation Matrix", "FLOAT"};
+	Atom atoms[2];
 
-	if (!XInternAtoms(display, names, 2, True, atoms)) {
+	if (xi2_matrix_atoms(display, atoms)) {
 		return EINTERN_FAILED;
 	}
 
@@ -165,28 +443,119 @@ int xi2_device_get_matrix(Display * display, const XID id, float * matrix) {
 	}
 }
 
+int xi2_identity_atoms(Display * display, Atom * atoms) {
+	static char * names[] = {"Device Product ID", "Device Node"};
+
+	trace_begin("intern_atoms");
+	Status interned = XInternAtoms(display, names, 2, True, atoms);
+	trace_end();
+
+	// A missing atom only means no device has the property
+	return interned || atoms[0] || atoms[1] ? 0 : EINTERN_FAILED;
+}
+
+int xi2_device_get_identifier(Display * display, const XID id, DeviceIdentifier * identifier) {
+	Atom atoms[2], type_return;
+	int format_return;
+	unsigned long num_items_return, bytes_after_return;
+	unsigned char * data = NULL;
+
+	if (xi2_identity_atoms(display, atoms) || atoms[0] == None) {
+		return EINTERN_FAILED;
+	}
+
+	Status result = XIGetProperty(display, id, atoms[0], 0, 2, False, XA_INTEGER,
+			&type_return, &format_return, &num_items_return, &bytes_after_return, &data);
+
+	if (result != Success || format_return != 32 || num_items_return != 2) {
+		if (data) {
+			XFree(data);
+		}
+		return EGET_PROPERTY_FAILED;
+	}
+
+	// XI2 returns 32 bit items packed, unlike XGetWindowProperty
+	const int32_t * values = (const int32_t *)data;
+	identifier->vendor = values[0];
+	identifier->product = values[1];
+	XFree(data);
+	return 0;
+}
+
+int xi2_device_get_node(Display * display, const XID id, char * node, const int node_size) {
+	Atom atoms[2], type_return;
+	int format_return;
+	unsigned long num_items_return, bytes_after_return;
+	unsigned char * data = NULL;
+
+	if (xi2_identity_atoms(display, atoms) || atoms[1] == None) {
+		return EINTERN_FAILED;
+	}
+
+	Status result = XIGetProperty(display, id, atoms[1], 0, node_size / 4, False, XA_STRING,
+			&type_return, &format_return, &num_items_return, &bytes_after_return, &data);
+
+	if (result != Success || format_return != 8 || num_items_return == 0 || num_items_return >= (unsigned long)node_size) {
+		if (data) {
+			XFree(data);
+		}
+		return EGET_PROPERTY_FAILED;
+	}
+
+	memcpy(node, data, num_items_return);
+	node[num_items_return] = '\0';
+	XFree(data);
+	return 0;
+}
+
 int xi2_device_check_matrix(Display * display, const XID id, const float * matrix) {
 	float retrieved_matrix[9];
 	int result = xi2_device_get_matrix(display, id, retrieved_matrix);
 
-	if (!result) {
+	if (result) {
 		return result;
 	}
 
+	return xi2_matrix_equal(retrieved_matrix, matrix) ? 0 : EMATRIX_NOT_EQUAL;
+}
+
+bool xi2_matrix_equal(const float * a, const float * b) {
 	for (int i = 0; i < 9; i++) {
-		if (retrieved_matrix[i] != matrix[i]) {
-			return EMATRIX_NOT_EQUAL; // TODO: select error code
+		float difference = a[i] - b[i];
+		if (difference > MATRIX_TOLERANCE || difference < -MATRIX_TOLERANCE) {
+			return false;
 		}
 	}
+	return true;
+}
 
-	return 0;
+void xi2_select_property_events(Display * display, const XID * ids, const int count) {
+	unsigned char mask[XIMaskLen(XI_LASTEVENT)] = {0};
+	XIEventMask * masks = calloc(count ? count : 1, sizeof(*masks));
+
+	if (!masks) {
+		return;
+	}
+
+	XISetMask(mask, XI_PropertyEvent);
+	for (int i = 0; i < count; i++) {
+		masks[i].deviceid = ids[i];
+		masks[i].mask_len = sizeof(mask);
+		masks[i].mask = mask;
+	}
+
+	XISelectEvents(display, DefaultRootWindow(display), masks, count);
+	free(masks);
 }
 
 int xi2_device_info_find_xy_valuators(Display * display, const XIDeviceInfo * info, ValuatorIndices * valuator_indices) {
 	Atom atoms[2] = {0};
 	char * names[] = {"Abs X", "Abs Y"};
 
-	if (!XInternAtoms(display, names, 2, True, atoms)) {
+	trace_begin("intern_atoms");
+	Status interned = XInternAtoms(display, names, 2, True, atoms);
+	trace_end();
+	if (!interned) {
 		return EINTERN_FAILED;
 	}
 
@@ -248,89 +617,210 @@ int xi2_device_get_region(XIDeviceInfo * device, const ValuatorIndices * valuato
 	}
 }
 
+static int popcount8(unsigned int bits) {
+	bits = (bits & 0x55) + ((bits >> 1) & 0x55);
+	bits = (bits & 0x33) + ((bits >> 2) & 0x33);
+	return (bits & 0x0f) + (bits >> 4);
+}
+
+int xi2_valuator_offset(const unsigned char * mask, const int mask_len, const int index) {
+	// mask_len counts bytes, not valuators
+	if (index < 0 || index >= mask_len * 8) {
+		return EVALUATOR_NOT_SET;
+	}
+
+	const int byte = index >> 3;
+	const unsigned int bit = 1u << (index & 7);
+	if (!(mask[byte] & bit)) {
+		return EVALUATOR_NOT_SET;
+	}
+
+	// values only holds the valuators which are set, so count the set bits below index
+	int offset = popcount8(mask[byte] & (bit - 1));
+	for (int i = 0; i < byte; i++) {
+		offset += popcount8(mask[i]);
+	}
+	return offset;
+}
+
 // Extract x and y values from a set of valuators
 int xi2_read_point(const XIValuatorState * valuators, const ValuatorIndices * valuator_indices, Point * result) {
-	bool found_x = false, found_y = false;
-	double * value = valuators->values;
-	for (int i = 0; i < valuators->mask_len; i++) {
-		if (valuators->mask[i >> 3] & (1 << i)) {
-			if (i == valuator_indices->x) {
-				found_x = true;
-				result->x = *value;
-			} else if (i == valuator_indices->y) {
-				found_y = true;
-				result->y = *value;
-			}
-			value++;
+	int x = xi2_valuator_offset(valuators->mask, valuators->mask_len, valuator_indices->x);
+	int y = xi2_valuator_offset(valuators->mask, valuators->mask_len, valuator_indices->y);
+
+	if (x < 0 || y < 0) {
+		return EVALUATOR_NOT_SET;
+	}
+
+	result->x = valuators->values[x];
+	result->y = valuators->values[y];
+	return 0;
+}
+
+int xi2_read_points(const XIValuatorState * const * valuators, const int count, const ValuatorIndices * valuator_indices, Point * last, Point * points) {
+	int complete = 0;
+
+	for (int i = 0; i < count; i++) {
+		const XIValuatorState * state = valuators[i];
+		int x = xi2_valuator_offset(state->mask, state->mask_len, valuator_indices->x);
+		int y = xi2_valuator_offset(state->mask, state->mask_len, valuator_indices->y);
+
+		if (x >= 0) {
+			last->x = state->values[x];
+		}
+		if (y >= 0) {
+			last->y = state->values[y];
 		}
+		if (x >= 0 && y >= 0) {
+			complete++;
+		}
+		points[i] = *last;
 	}
-	if (!(found_x && found_y)) {
-		return -1;
-	} else {
-		return 0;
+
+	return complete;
+}
+
+static volatile sig_atomic_t click_interrupted = 0;
+
+static void click_signal_handler(int signal) {
+	click_interrupted = 1;
+}
+
+static int click_remaining_ms(const struct timespec * deadline) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	long remaining = (deadline->tv_sec - now.tv_sec) * 1000L + (deadline->tv_nsec - now.tv_nsec) / 1000000L;
+	return remaining > 0 ? remaining : 0;
+}
+
+// Handles every queued event, returns how many masters clicked for the first time
+static int click_drain_events(Display * display, const XID * masters, XID * sources, Point * points, const int count) {
+	XEvent event;
+	XGenericEventCookie * cookie = &event.xcookie;
+	int clicked = 0;
+
+	while (XPending(display)) {
+		XNextEvent(display, &event);
+
+		if (cookie->type != GenericEvent || !XGetEventData(display, cookie)) {
+			continue;
+		}
+
+		if (cookie->evtype == XI_ButtonRelease) {
+			const XIDeviceEvent * device_event = (XIDeviceEvent *)cookie->data;
+
+			// Grabbed events arrive from the master, sourceid is the slave which was used
+			for (int i = 0; i < count; i++) {
+				if (masters[i] == (XID)device_event->deviceid && !sources[i]) {
+					points[i].x = device_event->root_x;
+					points[i].y = device_event->root_y;
+					sources[i] = device_event->sourceid;
+					clicked++;
+					break;
+				}
+			}
+		}
+		XFreeEventData(display, cookie);
 	}
+
+	return clicked;
 }
 
-int xi2_pointer_get_next_click(Display * display, XID * deviceid, Point * point) {
-	unsigned char mask_data[4] = {0};
+int xi2_pointers_get_clicks(Display * display, const XID * masters, XID * sources, Point * points, const int count, const int timeout_ms) {
+	// Only button releases, so the pen's motion doesn't wake us up while waiting
+	unsigned char mask_data[XIMaskLen(XI_ButtonRelease)] = {0};
 	XIEventMask mask = {
-		.deviceid = *deviceid,
-		.mask_len = 1,
+		.mask_len = sizeof(mask_data),
 		.mask = mask_data
 	};
 
-	XISetMask(mask_data, XI_Motion);
 	XISetMask(mask_data, XI_ButtonRelease);
 
-	Cursor cross = XCreateFontCursor(display, XC_crosshair);
+	for (int i = 0; i < count; i++) {
+		sources[i] = 0;
+	}
 
-	Status grab_result = XIGrabDevice(display, *deviceid,
-		 DefaultRootWindow(display),
-		 CurrentTime,
-		 cross, /* cursor */
-		 XIGrabModeAsync, /* XXX: might not want this */
-		 XIGrabModeAsync, /* XXX: paired_device_mode: might not want this */
-		 XINoOwnerEvents, /* XXX: not sure */
-		 &mask
-	);
-
-	if (grab_result != Success) {
-		switch (grab_result) {
-			case XIGrabSuccess:
-			case XIAlreadyGrabbed:
-			case XIGrabInvalidTime:
-			case XIGrabNotViewable:
-			case XIGrabFrozen:
-			default:
-				return -1; // TODO: specific return codes?
+	Cursor cross = XCreateFontCursor(display, XC_crosshair);
+	int grabbed = 0;
+
+	for (; grabbed < count; grabbed++) {
+		mask.deviceid = masters[grabbed];
+
+		Status grab_result = XIGrabDevice(display, masters[grabbed],
+			 DefaultRootWindow(display),
+			 CurrentTime,
+			 cross, /* cursor */
+			 XIGrabModeAsync, /* XXX: might not want this */
+			 XIGrabModeAsync, /* XXX: paired_device_mode: might not want this */
+			 XINoOwnerEvents, /* XXX: not sure */
+			 &mask
+		);
+
+		if (grab_result != Success) {
+			break;
 		}
 	}
 
-	XEvent event;
-	XGenericEventCookie *cookie = (XGenericEventCookie*)&event.xcookie;
+	int result = 0;
+	if (grabbed < count) {
+		result = ECLICK_GRAB_FAILED;
+		goto ungrab;
+	}
 
-	while (true) {
-		if (XNextEvent(display, (XEvent *)&event) != Success) {
-			return -1; // TODO: Specific return value
+	// Interrupting the selection must still release the grabs and let the caller restore matrices
+	struct sigaction action, previous;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = click_signal_handler;
+	sigemptyset(&action.sa_mask);
+	click_interrupted = 0;
+	sigaction(SIGINT, &action, &previous);
+
+	// SIGINT stays blocked outside the wait, so it can't slip in between the check and the wait
+	sigset_t blocked, unblocked;
+	sigemptyset(&blocked);
+	sigaddset(&blocked, SIGINT);
+	pthread_sigmask(SIG_BLOCK, &blocked, &unblocked);
+
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += timeout_ms / 1000;
+	deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+
+	// Every master is waited on at once, so users may click in any order
+	int remaining = count;
+	while ((remaining -= click_drain_events(display, masters, sources, points, count)) > 0) {
+		if (click_interrupted) {
+			result = ECLICK_INTERRUPTED;
+			break;
 		}
-		if (XGetEventData(display, cookie)) {
-			if (cookie->type == GenericEvent) {
-				if (cookie->evtype == XI_ButtonRelease) {
-					XIDeviceEvent * device_event = (XIDeviceEvent *)cookie->data;
 
-					XIUngrabDevice(display, *deviceid, CurrentTime);
+		int wait_timeout = timeout_ms < 0 ? -1 : click_remaining_ms(&deadline);
+		if (timeout_ms >= 0 && wait_timeout == 0) {
+			result = ECLICK_TIMEOUT;
+			break;
+		}
 
-					point->x = device_event->root_x;
-					point->y = device_event->root_y;
-					*deviceid = device_event->sourceid;
-					return 0;
-				}
-			}
-			XFreeEventData(display, cookie);
+		int wait_result = xlib_wait_for_events(display, wait_timeout, &unblocked);
+		if (wait_result < 0 && errno != EINTR) {
+			result = ECLICK_WAIT_FAILED;
+			break;
 		}
 	}
-	
-	return -1;
+
+	pthread_sigmask(SIG_SETMASK, &unblocked, NULL);
+	sigaction(SIGINT, &previous, NULL);
+
+ungrab:
+	for (int i = 0; i < grabbed; i++) {
+		XIUngrabDevice(display, masters[i], CurrentTime);
+	}
+	XFreeCursor(display, cross);
+	XFlush(display);
+	return result;
 }
 
 int xi2_find_absolute_pointers(Display *display, XIDeviceInfo * info, const XIDeviceInfo * info_end, XID * pointers, const int max_pointers) {
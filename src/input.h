@@ -1,6 +1,7 @@
 #ifndef XRESTRICT_INPUT_H_
 #define XRESTRICT_INPUT_H_
 
+#include <stdbool.h>
 #include <X11/Xlib.h>
 #include <X11/extensions/XInput2.h>
 
@@ -35,11 +36,24 @@ typedef struct CTMConfiguration {
 	CTMAffinity			  affinity;
 } CTMConfiguration;
 
+#define DEVICE_ANY (-1)
+
 typedef struct DeviceIdentifier {
 	int vendor;
 	int product;
 } DeviceIdentifier;
 
+#define MAX_SELECTOR_NAME   64
+#define MAX_SELECTOR_SERIAL 64
+#define MAX_DEVICE_NODE     64
+
+// Picks devices by what they are rather than by XID, which changes whenever they are plugged in
+typedef struct DeviceSelector {
+	DeviceIdentifier identifier;               // Either may be DEVICE_ANY
+	char             name[MAX_SELECTOR_NAME];  // Extended regular expression, matches any name when empty
+	char             serial[MAX_SELECTOR_SERIAL];
+} DeviceSelector;
+
 typedef struct PointerRegion {
 	Rectangle region;
 	int hres, vres; // Units per meter in horizontal and vertical dir
@@ -67,16 +81,89 @@ float rectangle_scale_preserve_aspect(const Rectangle * target, const Rectangle
 
 void calculate_coordinate_transform_matrix(const Rectangle * region, const Rectangle * screen_size, float * matrix);
 
+// The batch versions below work on many rectangles at once and give the same results as the functions
+// above, bit for bit. Kernels run over whole blocks of RECTANGLE_BATCH_LANES entries, a trip count the
+// compiler can vectorize without a scalar remainder loop, so batches are padded to a multiple of it.
+#define RECTANGLE_BATCH_LANES 8
+#define RECTANGLE_BATCH_PADDED(count) (((count) + RECTANGLE_BATCH_LANES - 1) / RECTANGLE_BATCH_LANES * RECTANGLE_BATCH_LANES)
+
+// Rectangles as structure of arrays. Entries past count hold a unit rectangle, which every kernel can divide by.
+typedef struct RectangleBatch {
+	int * top, * left;
+	int * bottom, * right;
+	int count;
+} RectangleBatch;
+
+// Only the entries calculate_coordinate_transform_matrix sets to something other than 0 or 1
+typedef struct MatrixBatch {
+	float * x_scale, * x_offset;
+	float * y_scale, * y_offset;
+	int count;
+} MatrixBatch;
+
+#define EBATCH_ALLOCATION_FAILED (-1)
+int rectangle_batch_alloc(RectangleBatch * batch, const int count);
+void rectangle_batch_free(RectangleBatch * batch);
+void rectangle_batch_set(RectangleBatch * batch, const int index, const Rectangle * rectangle);
+void rectangle_batch_get(const RectangleBatch * batch, const int index, Rectangle * rectangle);
+int matrix_batch_alloc(MatrixBatch * batch, const int count);
+void matrix_batch_free(MatrixBatch * batch);
+void matrix_batch_get(const MatrixBatch * batch, const int index, float * matrix);
+
+// Every batch must hold the same count, results may not be one of the inputs. ratios needs
+// room for RECTANGLE_BATCH_PADDED(count) entries.
+void rectangle_select_ratio_preserve_aspect_batch(const RectangleBatch * targets, const RectangleBatch * originals, const CTMAspectPreserveType type, float * ratios);
+void rectangle_scale_preserve_aspect_batch(const RectangleBatch * targets, const RectangleBatch * originals, const CTMAspectPreserveType type, RectangleBatch * results);
+void rectangle_align_batch(const RectangleBatch * references, const RectangleBatch * alignees, const CTMAffinity * affinity, RectangleBatch * results);
+void calculate_coordinate_transform_matrix_batch(const RectangleBatch * regions, const Rectangle * screen_size, MatrixBatch * matrices);
+
+// Fits the affine matrix which best maps normalized device positions onto normalized screen positions
+// in the least squares sense, one sample at a time in constant memory. Products are summed about the
+// running means, as in Welford's algorithm, so thousands of nearly equal samples don't cancel out.
+typedef struct CalibrationFit {
+	double count;
+	double mean[4];      // Device x and y, then screen x and y
+	double moment[4][4]; // Sums of products of deviations from the means, upper triangle only
+} CalibrationFit;
+
+void calibration_fit_reset(CalibrationFit * fit);
+void calibration_fit_add(CalibrationFit * fit, const Point * device, const Point * screen);
+// residual, if not NULL, receives the RMS distance of the samples from the fit on each axis in normalized screen units
+int calibration_fit_solve(const CalibrationFit * fit, float * matrix, Point * residual);
+
 int xi2_device_info_find_xy_valuators(Display * display, const XIDeviceInfo * info, ValuatorIndices * valuator_indices);
 int xi2_find_absolute_pointers(Display *display, XIDeviceInfo * info, const XIDeviceInfo * info_end, XID * pointers, const int max_pointers);
 int xi2_device_get_region(XIDeviceInfo * device, const ValuatorIndices * valuator_indices, PointerRegion * region);
 
+// Fills atoms with "Coordinate Transformation Matrix" and "FLOAT"
+int xi2_matrix_atoms(Display * display, Atom * atoms);
 int xi2_device_get_matrix(Display * display, const XID id, float * matrix);
 int xi2_device_set_matrix(Display * display, const XID id, const float * matrix);
 int xi2_device_check_matrix(Display * display, const XID id, const float * matrix);
+// The server stores matrices as floats, but they round trip through clients which print and parse them
+#define MATRIX_TOLERANCE 1e-5f
+bool xi2_matrix_equal(const float * a, const float * b);
+// Selects XI_PropertyEvent for every device in ids on the root window, replacing any earlier selection for them
+void xi2_select_property_events(Display * display, const XID * ids, const int count);
+
+// Fills atoms with "Device Product ID" and "Device Node", which are None without the evdev or libinput driver
+int xi2_identity_atoms(Display * display, Atom * atoms);
+int xi2_device_get_identifier(Display * display, const XID id, DeviceIdentifier * identifier);
+// node receives the device file, e.g. "/dev/input/event5"
+int xi2_device_get_node(Display * display, const XID id, char * node, const int node_size);
+
+// Returns the position of valuator index within values, or EVALUATOR_NOT_SET
+int xi2_valuator_offset(const unsigned char * mask, const int mask_len, const int index);
+int xi2_read_point(const XIValuatorState * valuators, const ValuatorIndices * valuator_indices, Point * result);
+// Decodes a batch of XIRawEvent or XIDeviceEvent valuators. Events only carry the axes which
+// changed, so missing axes keep their value from the previous event, or from last for the
+// first one; last is updated. Returns the number of events which carried both axes.
+int xi2_read_points(const XIValuatorState * const * valuators, const int count, const ValuatorIndices * valuator_indices, Point * last, Point * points);
 
 int xi2_find_master_pointers(XIDeviceInfo * info, const XIDeviceInfo * info_end, XID * pointers, const int max_pointers);
-int xi2_pointer_get_next_click(Display * display, XID * deviceid, Point * point);
+// Grabs every master pointer until each had a button released. sources[i] receives the slave
+// device masters[i] was clicked with, or 0 if it wasn't. A timeout_ms < 0 waits forever.
+int xi2_pointers_get_clicks(Display * display, const XID * masters, XID * sources, Point * points, const int count, const int timeout_ms);
 
 const extern float identity[9];
 
@@ -93,4 +180,16 @@ const extern float identity[9];
 #define EDEVICES_OVERFLOW (-256)
 #define EMATRIX_NOT_EQUAL (-512)
 
+// Error codes for xi2_pointer_get_next_click()
+#define ECLICK_GRAB_FAILED (-1024)
+#define ECLICK_TIMEOUT (-2048)
+#define ECLICK_INTERRUPTED (-4096)
+#define ECLICK_WAIT_FAILED (-8192)
+
+// Error codes for xi2_valuator_offset() and xi2_read_point()
+#define EVALUATOR_NOT_SET (-1)
+
+// Error codes for calibration_fit_solve()
+#define ECALIBRATION_DEGENERATE (-1)
+
 #endif /* XRESTRICT_INPUT_H_ */
@@ -0,0 +1,367 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "xrestrict.h"
+#include "display.h"
+#include "input.h"
+
+// Each benchmark prints one JSON object per line, and main's return value
+// reports whether the optimized paths disagreed with the reference ones.
+
+static int mismatches = 0;
+
+static double now_ns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+// xorshift64, deterministic so runs are comparable
+static uint64_t random_state = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t random_next(void) {
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 7;
+	random_state ^= random_state << 17;
+	return random_state;
+}
+
+static double random_range(const double low, const double high) {
+	return low + (high - low) * ((random_next() >> 11) * (1.0 / 9007199254740992.0));
+}
+
+static void report(const char * benchmark, const char * variant, const int size, const long operations, const double elapsed_ns) {
+	printf("{\"benchmark\": \"%s\", \"variant\": \"%s\", \"size\": %d, \"operations\": %ld, \"ns_per_op\": %.2f, \"ops_per_sec\": %.0f}\n",
+		   benchmark, variant, size, operations, elapsed_ns / operations, operations / (elapsed_ns / 1e9));
+}
+
+#define CRTC_LOOKUP_QUERIES 2000000
+
+// Lays out count 1920x1080 CRTCs in a grid, as on a video wall
+static void crtc_grid(CRTCRegion * regions, const int count) {
+	int columns = 1;
+	while (columns * columns < count) {
+		columns++;
+	}
+
+	for (int i = 0; i < count; i++) {
+		regions[i].crtc = i + 1;
+		regions[i].output = i + 1;
+		regions[i].width = 527;
+		regions[i].height = 296;
+		regions[i].region.left = (i % columns) * 1920;
+		regions[i].region.top = (i / columns) * 1080;
+		regions[i].region.right = regions[i].region.left + 1920;
+		regions[i].region.bottom = regions[i].region.top + 1080;
+	}
+}
+
+static void bench_crtc_lookup(void) {
+	const int sizes[] = {1, 2, 4, 8, 16, 24, 32, 64};
+	Point * points = malloc(CRTC_LOOKUP_QUERIES * sizeof(*points));
+	int * scan = malloc(CRTC_LOOKUP_QUERIES * sizeof(*scan));
+	int * found = malloc(CRTC_LOOKUP_QUERIES * sizeof(*found));
+
+	for (unsigned int s = 0; s < sizeof(sizes) / sizeof(*sizes); s++) {
+		const int count = sizes[s];
+		CRTCRegion * regions = malloc(count * sizeof(*regions));
+		crtc_grid(regions, count);
+
+		Rectangle bounds = regions[0].region;
+		for (int i = 1; i < count; i++) {
+			if (regions[i].region.right > bounds.right) {
+				bounds.right = regions[i].region.right;
+			}
+			if (regions[i].region.bottom > bounds.bottom) {
+				bounds.bottom = regions[i].region.bottom;
+			}
+		}
+
+		// Mostly inside, with some misses and exact edge hits
+		for (int i = 0; i < CRTC_LOOKUP_QUERIES; i++) {
+			points[i].x = random_range(-10, bounds.right + 10);
+			points[i].y = random_range(-10, bounds.bottom + 10);
+			if (i % 16 == 0) {
+				points[i].x = regions[i % count].region.right;
+			}
+		}
+
+		CRTCIndex index;
+		if (crtc_index_build(&index, regions, count)) {
+			fprintf(stderr, "Failed to build CRTC index.\n");
+			exit(-1);
+		}
+
+		double start = now_ns();
+		for (int i = 0; i < CRTC_LOOKUP_QUERIES; i++) {
+			scan[i] = find_containing_crtc(regions, count, points + i);
+		}
+		report("crtc_lookup", "scan", count, CRTC_LOOKUP_QUERIES, now_ns() - start);
+
+		start = now_ns();
+		for (int i = 0; i < CRTC_LOOKUP_QUERIES; i++) {
+			found[i] = crtc_index_find(&index, points + i);
+		}
+		report("crtc_lookup", "index", count, CRTC_LOOKUP_QUERIES, now_ns() - start);
+
+		for (int i = 0; i < CRTC_LOOKUP_QUERIES; i++) {
+			if (scan[i] != found[i]) {
+				fprintf(stderr, "crtc_lookup: index finds %d instead of %d at %.2f,%.2f for %d CRTCs.\n",
+						found[i], scan[i], points[i].x, points[i].y, count);
+				mismatches++;
+				break;
+			}
+		}
+
+		crtc_index_free(&index);
+		free(regions);
+	}
+
+	free(points);
+	free(scan);
+	free(found);
+}
+
+#define VALUATOR_EVENTS 4096
+#define VALUATOR_ROUNDS 500
+
+// The previous decoder, walking the mask one bit at a time
+static int read_point_bitwise(const XIValuatorState * valuators, const ValuatorIndices * indices, Point * result) {
+	int found = 0;
+	const double * value = valuators->values;
+	for (int i = 0; i < valuators->mask_len * 8; i++) {
+		if (valuators->mask[i >> 3] & (1 << (i & 7))) {
+			if (i == indices->x) {
+				result->x = *value;
+				found |= 1;
+			} else if (i == indices->y) {
+				result->y = *value;
+				found |= 2;
+			}
+			value++;
+		}
+	}
+	return found == 3 ? 0 : -1;
+}
+
+static void bench_valuator_decode(void) {
+	// x, y, pressure, tilt x, tilt y and wheel, as reported by most pen tablets
+	const int sizes[] = {2, 3, 6};
+	const ValuatorIndices indices = {.x = 0, .y = 1};
+
+	unsigned char (*masks)[4] = calloc(VALUATOR_EVENTS, sizeof(*masks));
+	double (*values)[6] = calloc(VALUATOR_EVENTS, sizeof(*values));
+	XIValuatorState * states = calloc(VALUATOR_EVENTS, sizeof(*states));
+	const XIValuatorState ** batch = calloc(VALUATOR_EVENTS, sizeof(*batch));
+	Point * points = calloc(VALUATOR_EVENTS, sizeof(*points));
+	Point * bitwise = calloc(VALUATOR_EVENTS, sizeof(*bitwise));
+	Point * offset = calloc(VALUATOR_EVENTS, sizeof(*offset));
+	int * bitwise_results = calloc(VALUATOR_EVENTS, sizeof(*bitwise_results));
+	int * offset_results = calloc(VALUATOR_EVENTS, sizeof(*offset_results));
+
+	for (unsigned int s = 0; s < sizeof(sizes) / sizeof(*sizes); s++) {
+		const int valuator_count = sizes[s];
+
+		for (int i = 0; i < VALUATOR_EVENTS; i++) {
+			masks[i][0] = (1 << valuator_count) - 1;
+			for (int v = 0; v < valuator_count; v++) {
+				values[i][v] = random_range(0, 65536);
+			}
+			states[i].mask_len = sizeof(masks[i]);
+			states[i].mask = masks[i];
+			states[i].values = values[i];
+			batch[i] = states + i;
+		}
+
+		const long operations = (long)VALUATOR_EVENTS * VALUATOR_ROUNDS;
+
+		double start = now_ns();
+		for (int round = 0; round < VALUATOR_ROUNDS; round++) {
+			for (int i = 0; i < VALUATOR_EVENTS; i++) {
+				bitwise_results[i] = read_point_bitwise(states + i, &indices, bitwise + i);
+			}
+		}
+		report("valuator_decode", "bitwise", valuator_count, operations, now_ns() - start);
+
+		start = now_ns();
+		for (int round = 0; round < VALUATOR_ROUNDS; round++) {
+			for (int i = 0; i < VALUATOR_EVENTS; i++) {
+				offset_results[i] = xi2_read_point(states + i, &indices, offset + i);
+			}
+		}
+		report("valuator_decode", "popcount", valuator_count, operations, now_ns() - start);
+
+		start = now_ns();
+		for (int round = 0; round < VALUATOR_ROUNDS; round++) {
+			Point last = {0, 0};
+			xi2_read_points(batch, VALUATOR_EVENTS, &indices, &last, points);
+		}
+		report("valuator_decode", "batch", valuator_count, operations, now_ns() - start);
+
+		// Every event sets x and y, so all three decoders must read the same point from each
+		for (int i = 0; i < VALUATOR_EVENTS; i++) {
+			if (bitwise_results[i] || offset_results[i] ||
+				bitwise[i].x != offset[i].x || bitwise[i].y != offset[i].y ||
+				bitwise[i].x != points[i].x || bitwise[i].y != points[i].y) {
+				fprintf(stderr, "valuator_decode: decoders disagree on event %d for %d valuators.\n", i, valuator_count);
+				mismatches++;
+				break;
+			}
+		}
+	}
+
+	free(masks);
+	free(values);
+	free(states);
+	free(batch);
+	free(points);
+	free(bitwise);
+	free(offset);
+	free(bitwise_results);
+	free(offset_results);
+}
+
+#define GEOMETRY_RECTANGLES 8000000
+
+// The full calc_matrix chain, once a rectangle at a time and once in batches as plan_build uses it
+static void bench_geometry(void) {
+	const int sizes[] = {16, 256, 4096};
+	const CTMAffinity affinity = {.horizontal = HA_Centered, .vertical = VA_Centered};
+	const Rectangle screen = {.left = 0, .top = 0, .right = 7680, .bottom = 4320};
+
+	for (unsigned int s = 0; s < sizeof(sizes) / sizeof(*sizes); s++) {
+		const int count = sizes[s];
+		const int rounds = GEOMETRY_RECTANGLES / count;
+		RectangleBatch crtcs, inputs, scaled, aligned;
+		MatrixBatch matrices;
+
+		if (rectangle_batch_alloc(&crtcs, count) || rectangle_batch_alloc(&inputs, count) ||
+			rectangle_batch_alloc(&scaled, count) || rectangle_batch_alloc(&aligned, count) ||
+			matrix_batch_alloc(&matrices, count)) {
+			fprintf(stderr, "Failed to allocate rectangle batches.\n");
+			exit(-1);
+		}
+
+		for (int i = 0; i < count; i++) {
+			const Rectangle crtc = {
+				.left = (i % 4) * 1920, .top = (i / 4 % 4) * 1080,
+				.right = (i % 4) * 1920 + 1920, .bottom = (i / 4 % 4) * 1080 + 1080
+			};
+			const Rectangle input = {.left = 0, .top = 0, .right = random_range(1000, 65536), .bottom = random_range(1000, 65536)};
+			rectangle_batch_set(&crtcs, i, &crtc);
+			rectangle_batch_set(&inputs, i, &input);
+		}
+
+		double checksum_scalar = 0, checksum_batch = 0;
+		float matrix[9];
+
+		double start = now_ns();
+		for (int round = 0; round < rounds; round++) {
+			for (int i = 0; i < count; i++) {
+				Rectangle crtc, input, scaled_one, aligned_one;
+				rectangle_batch_get(&crtcs, i, &crtc);
+				rectangle_batch_get(&inputs, i, &input);
+				rectangle_scale_preserve_aspect(&crtc, &input, CTM_Fit, &scaled_one);
+				rectangle_align(&crtc, &scaled_one, &affinity, &aligned_one);
+				calculate_coordinate_transform_matrix(&aligned_one, &screen, matrix);
+				checksum_scalar += matrix[0] + matrix[2] + matrix[4] + matrix[5];
+			}
+		}
+		report("geometry", "scalar", count, (long)rounds * count, now_ns() - start);
+
+		start = now_ns();
+		for (int round = 0; round < rounds; round++) {
+			rectangle_scale_preserve_aspect_batch(&crtcs, &inputs, CTM_Fit, &scaled);
+			rectangle_align_batch(&crtcs, &scaled, &affinity, &aligned);
+			calculate_coordinate_transform_matrix_batch(&aligned, &screen, &matrices);
+			for (int i = 0; i < count; i++) {
+				checksum_batch += matrices.x_scale[i] + matrices.x_offset[i] + matrices.y_scale[i] + matrices.y_offset[i];
+			}
+		}
+		report("geometry", "batch", count, (long)rounds * count, now_ns() - start);
+
+		if (checksum_scalar != checksum_batch) {
+			fprintf(stderr, "geometry: batch disagrees with scalar for %d rectangles.\n", count);
+			mismatches++;
+		}
+
+		rectangle_batch_free(&crtcs);
+		rectangle_batch_free(&inputs);
+		rectangle_batch_free(&scaled);
+		rectangle_batch_free(&aligned);
+		matrix_batch_free(&matrices);
+	}
+}
+
+#define CALIBRATION_SAMPLES 2000000
+#define CALIBRATION_SOLVES  1000000
+
+// Calibration fits run per touch sample, so they are measured against the fixed rectangle math they replace
+static void bench_calibration(void) {
+	const float expected[9] = {
+		0.98f, -0.02f, 0.015f,
+		0.03f, 1.01f, -0.02f,
+		0, 0, 1
+	};
+	const Rectangle screen = {.left = 0, .top = 0, .right = 3840, .bottom = 2160};
+	const Rectangle region = {.left = 1920, .top = 0, .right = 3840, .bottom = 1080};
+	float matrix[9];
+	double checksum = 0;
+
+	double start = now_ns();
+	for (int i = 0; i < CALIBRATION_SOLVES; i++) {
+		calculate_coordinate_transform_matrix(&region, &screen, matrix);
+		checksum += matrix[2];
+	}
+	report("calibration", "rectangle", 0, CALIBRATION_SOLVES, now_ns() - start);
+
+	// Touches jitter by about a pixel around where the matrix puts them
+	Point * devices = malloc(CALIBRATION_SAMPLES * sizeof(*devices));
+	Point * screens = malloc(CALIBRATION_SAMPLES * sizeof(*screens));
+	for (int i = 0; i < CALIBRATION_SAMPLES; i++) {
+		devices[i].x = random_range(0, 1);
+		devices[i].y = random_range(0, 1);
+		screens[i].x = expected[0] * devices[i].x + expected[1] * devices[i].y + expected[2] + random_range(-2e-4, 2e-4);
+		screens[i].y = expected[3] * devices[i].x + expected[4] * devices[i].y + expected[5] + random_range(-4e-4, 4e-4);
+	}
+
+	CalibrationFit fit;
+	calibration_fit_reset(&fit);
+	start = now_ns();
+	for (int i = 0; i < CALIBRATION_SAMPLES; i++) {
+		calibration_fit_add(&fit, devices + i, screens + i);
+	}
+	report("calibration", "fit_add", 0, CALIBRATION_SAMPLES, now_ns() - start);
+
+	Point residual;
+	start = now_ns();
+	for (int i = 0; i < CALIBRATION_SOLVES; i++) {
+		calibration_fit_solve(&fit, matrix, &residual);
+		checksum += matrix[2];
+	}
+	report("calibration", "fit_solve", 0, CALIBRATION_SOLVES, now_ns() - start);
+
+	// The jitter averages out over this many samples, but not down to MATRIX_TOLERANCE
+	for (int i = 0; i < 9; i++) {
+		if (fabs(matrix[i] - expected[i]) > 1e-3) {
+			fprintf(stderr, "calibration: fit disagrees with the matrix the samples were made with (checksum %g).\n", checksum);
+			mismatches++;
+			break;
+		}
+	}
+
+	free(devices);
+	free(screens);
+}
+
+int main(int argc, char ** argv) {
+	bench_crtc_lookup();
+	bench_valuator_decode();
+	bench_geometry();
+	bench_calibration();
+
+	return mismatches ? -1 : 0;
+}
@@ -0,0 +1,442 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "context.h"
+#include "mockx.h"
+
+// Runs libxrestrict against random monitor layouts and devices on the in-memory server of mockx.h,
+// checking what the devices end up with and how many requests it took to get there.
+
+#define DEFAULT_SCENARIOS 20000
+#define MAX_SCENARIO_CRTCS   4
+#define MAX_SCENARIO_DEVICES 4
+
+static int scenario = 0;
+static int success = 0;
+static int failed = 0;
+static MockStats totals;
+// libxrestrict reports to stdout and stderr like the command line tool does, tests report here
+static FILE * report;
+
+#define ASSERT(test) do { \
+	if (test) { \
+		success++; \
+	} else { \
+		if (failed < 20) { \
+			fprintf(report, "E: scenario %d: " #test " failed!\n", scenario); \
+		} \
+		failed++; \
+	} \
+} while (0);
+
+// xorshift32, seeded so that every run checks the same scenarios
+static unsigned int random_state = 0x2545f491;
+
+static int random_between(const int low, const int high) {
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 17;
+	random_state ^= random_state << 5;
+	return low + random_state % (unsigned int)(high - low + 1);
+}
+
+typedef struct Scenario {
+	Rectangle      screen;
+	Rectangle      crtcs[MAX_SCENARIO_CRTCS];
+	int            mm_widths[MAX_SCENARIO_CRTCS], mm_heights[MAX_SCENARIO_CRTCS];
+	int            crtc_count;
+	MockDeviceInfo devices[MAX_SCENARIO_DEVICES];
+	Target         targets[MAX_SCENARIO_DEVICES]; // One per device
+	int            device_count;
+} Scenario;
+
+static void scenario_update_screen(Scenario * s) {
+	s->screen = (Rectangle) {0, 0, 0, 0};
+	for (int i = 0; i < s->crtc_count; i++) {
+		if (s->crtcs[i].bottom > s->screen.bottom) {
+			s->screen.bottom = s->crtcs[i].bottom;
+		}
+		if (s->crtcs[i].right > s->screen.right) {
+			s->screen.right = s->crtcs[i].right;
+		}
+	}
+}
+
+static void scenario_random_device(MockDeviceInfo * device) {
+	device->name = "Mock Pen";
+	device->range = (Rectangle) {
+		.top = 0,
+		.left = 0,
+		.bottom = random_between(1000, 40000),
+		.right = random_between(1000, 60000)
+	};
+	// Some devices don't know their size, which one to one targets can't do without
+	const bool sized = random_between(0, 7) != 0;
+	device->hres = sized ? random_between(10000, 200000) : 0;
+	device->vres = sized ? random_between(10000, 200000) : 0;
+}
+
+// Monitors side by side, devices each restricted to one of them or the whole screen
+static void scenario_generate(Scenario * s) {
+	memset(s, 0, sizeof(*s));
+
+	s->crtc_count = random_between(1, MAX_SCENARIO_CRTCS);
+	for (int i = 0, left = 0; i < s->crtc_count; i++) {
+		Rectangle * crtc = s->crtcs + i;
+		crtc->left = left;
+		crtc->top = random_between(0, 400);
+		crtc->right = left + random_between(640, 3840);
+		crtc->bottom = crtc->top + random_between(480, 2160);
+		left = crtc->right;
+
+		s->mm_widths[i] = RECT_WIDTH(*crtc) * random_between(200, 300) / 960;
+		s->mm_heights[i] = RECT_HEIGHT(*crtc) * random_between(200, 300) / 960;
+	}
+	scenario_update_screen(s);
+
+	s->device_count = random_between(1, MAX_SCENARIO_DEVICES);
+	for (int i = 0; i < s->device_count; i++) {
+		scenario_random_device(s->devices + i);
+
+		Target * target = s->targets + i;
+		target->crtc_index = random_between(0, s->crtc_count - 1);
+		target->full_screen = random_between(0, 4) == 0;
+		target->one_to_one = random_between(0, 3) == 0;
+		target->config.type = random_between(CTM_None, CTM_MatchHeight);
+		target->config.affinity.horizontal = random_between(HA_Left, HA_Centered);
+		target->config.affinity.vertical = random_between(VA_Top, VA_Centered);
+	}
+}
+
+static int scenario_expected_matrix(const Scenario * s, const int i, float * matrix) {
+	const Target * target = s->targets + i;
+	const MockDeviceInfo * device = s->devices + i;
+	Rectangle screen = s->screen;
+	CRTCRegion region = {.region = target->full_screen ? s->screen : s->crtcs[target->crtc_index]};
+	Rectangle input_region = device->range;
+
+	// Device units map onto millimeters of the monitor
+	if (target->one_to_one && !target->full_screen) {
+		if (device->hres <= 0 || device->vres <= 0) {
+			return ETARGET_OUTPUT_DENSITY;
+		}
+		input_region = region.region;
+		input_region.right = input_region.left + 1000L * RECT_WIDTH(region.region) * RECT_WIDTH(device->range) / device->hres / s->mm_widths[target->crtc_index];
+		input_region.bottom = input_region.top + 1000L * RECT_HEIGHT(region.region) * RECT_HEIGHT(device->range) / device->vres / s->mm_heights[target->crtc_index];
+	}
+
+	calc_matrix(target->device_id, &target->config, &screen, &region, &input_region, matrix);
+	return 0;
+}
+
+// Checks every device holds the matrix it should, returns how many targets could be applied
+static int scenario_check_matrices(const Scenario * s, const int * results) {
+	int applied = 0;
+
+	for (int i = 0; i < s->device_count; i++) {
+		float expected[9], actual[9];
+		const int expected_result = scenario_expected_matrix(s, i, expected);
+
+		ASSERT(results[i] == expected_result);
+		if (!expected_result && !results[i]) {
+			ASSERT(!mockx_device_matrix(s->targets[i].device_id, actual) && xi2_matrix_equal(expected, actual));
+			applied++;
+		}
+	}
+	return applied;
+}
+
+// Statistics since the last call, which also count towards the totals
+static void phase_stats(MockStats * stats) {
+	mockx_get_stats(stats);
+	mockx_reset_stats();
+
+	for (int i = 0; i < MOCKX_REQUEST_TYPES; i++) {
+		totals.requests[i] += stats->requests[i];
+	}
+	totals.total_requests += stats->total_requests;
+	totals.round_trips += stats->round_trips;
+	totals.errors += stats->errors;
+	totals.unhandled_errors += stats->unhandled_errors;
+	totals.events += stats->events;
+	totals.latency_ms += stats->latency_ms;
+}
+
+static int apply(XRestrictContext * context, const Scenario * s, int * results, const ApplyMode mode) {
+	memset(results, 0, MAX_SCENARIO_DEVICES * sizeof(*results));
+	return xrestrict_context_apply(context, s->targets, results, s->device_count, mode);
+}
+
+// Another client overwrites a matrix, only that device is written again
+static void perturb_foreign_write(XRestrictContext * context, Scenario * s, const int applied) {
+	const float foreign[9] = {0.5, 0, 0.25, 0, 0.5, 0.25, 0, 0, 1};
+	int results[MAX_SCENARIO_DEVICES];
+	MockStats stats;
+
+	mockx_device_write_matrix(s->targets[0].device_id, foreign);
+	apply(context, s, results, APPLY_WRITE);
+	phase_stats(&stats);
+
+	float expected[9];
+	const bool rewritten = !scenario_expected_matrix(s, 0, expected) && !xi2_matrix_equal(expected, foreign);
+	ASSERT(scenario_check_matrices(s, results) == applied);
+	ASSERT(stats.requests[MOCKX_XI_CHANGE_PROPERTY] == (rewritten ? 1 : 0));
+}
+
+// Another client overwrites a matrix while only the other devices are being written, which the next
+// apply of all devices still has to notice
+static void perturb_foreign_write_elsewhere(XRestrictContext * context, Scenario * s, const int applied) {
+	const float foreign[9] = {0.5, 0, 0.25, 0, 0.5, 0.25, 0, 0, 1};
+	int results[MAX_SCENARIO_DEVICES] = {0};
+	float expected[9];
+
+	if (s->device_count < 2 || scenario_expected_matrix(s, 0, expected) || xi2_matrix_equal(expected, foreign) ||
+		scenario_expected_matrix(s, 1, expected) || xi2_matrix_equal(expected, foreign)) {
+		return;
+	}
+
+	// Device 1 needs writing, and device 0 changes while that write is in flight
+	mockx_device_write_matrix(s->targets[1].device_id, foreign);
+	mockx_device_write_matrix_during(MOCKX_XI_CHANGE_PROPERTY, s->targets[0].device_id, foreign);
+	xrestrict_context_apply(context, s->targets + 1, results, s->device_count - 1, APPLY_WRITE);
+
+	float actual[9];
+	ASSERT(!mockx_device_matrix(s->targets[0].device_id, actual) && xi2_matrix_equal(actual, foreign));
+
+	apply(context, s, results, APPLY_WRITE);
+	ASSERT(scenario_check_matrices(s, results) == applied);
+}
+
+// A monitor moves, possibly growing the screen, and only the matrices which changed are written
+static void perturb_move_crtc(XRestrictContext * context, Scenario * s) {
+	float before[MAX_SCENARIO_DEVICES][9];
+	int results[MAX_SCENARIO_DEVICES];
+	bool known[MAX_SCENARIO_DEVICES];
+	MockStats stats;
+
+	for (int i = 0; i < s->device_count; i++) {
+		known[i] = !scenario_expected_matrix(s, i, before[i]);
+	}
+
+	const int index = random_between(0, s->crtc_count - 1);
+	const int offset = random_between(-200, 600);
+	s->crtcs[index].top = s->crtcs[index].top + offset > 0 ? s->crtcs[index].top + offset : 0;
+	s->crtcs[index].bottom = s->crtcs[index].top + random_between(480, 2160);
+	const Rectangle screen = s->screen;
+	scenario_update_screen(s);
+
+	mockx_set_crtc(index, s->crtcs + index);
+	if (RECT_WIDTH(screen) != RECT_WIDTH(s->screen) || RECT_HEIGHT(screen) != RECT_HEIGHT(s->screen)) {
+		mockx_set_screen_size(RECT_WIDTH(s->screen), RECT_HEIGHT(s->screen));
+	}
+
+	apply(context, s, results, APPLY_WRITE);
+	phase_stats(&stats);
+	scenario_check_matrices(s, results);
+
+	unsigned long changed = 0;
+	for (int i = 0; i < s->device_count; i++) {
+		float after[9];
+		if (known[i] && !scenario_expected_matrix(s, i, after) && !xi2_matrix_equal(before[i], after)) {
+			changed++;
+		}
+	}
+	// Output sizes are forgotten with the old layout, one to one targets need them again
+	unsigned long resources = 1;
+	for (int i = 0; i < s->device_count; i++) {
+		if (s->targets[i].one_to_one && !s->targets[i].full_screen) {
+			resources = 2;
+		}
+	}
+	ASSERT(stats.requests[MOCKX_XI_CHANGE_PROPERTY] == changed);
+	ASSERT(stats.requests[MOCKX_RR_SCREEN_RESOURCES] == resources);
+}
+
+// One device refuses its write in the middle of an atomic apply, every other one gets its old matrix back
+static void perturb_atomic_failure(XRestrictContext * context, Scenario * s) {
+	const float foreign[9] = {0.5, 0, 0.25, 0, 0.5, 0.25, 0, 0, 1};
+	int results[MAX_SCENARIO_DEVICES];
+	MockStats stats;
+
+	// The failing device must be one which gets written at all
+	int failing = random_between(0, s->device_count - 1);
+	float expected[9];
+	while (failing < s->device_count && scenario_expected_matrix(s, failing, expected)) {
+		failing++;
+	}
+	if (failing == s->device_count) {
+		return;
+	}
+
+	for (int i = 0; i < s->device_count; i++) {
+		mockx_device_write_matrix(s->targets[i].device_id, foreign);
+	}
+	mockx_device_fail_writes(s->targets[failing].device_id, true);
+
+	apply(context, s, results, APPLY_ATOMIC);
+	phase_stats(&stats);
+
+	for (int i = 0; i < s->device_count; i++) {
+		float expected[9], actual[9];
+		const int expected_result = scenario_expected_matrix(s, i, expected);
+
+		mockx_device_matrix(s->targets[i].device_id, actual);
+		ASSERT(xi2_matrix_equal(actual, foreign));
+		if (expected_result) {
+			ASSERT(results[i] == expected_result);
+		} else if (i == failing) {
+			ASSERT(results[i] == ETARGET_SET_FAILED);
+		} else {
+			ASSERT(results[i] == ETARGET_ROLLED_BACK);
+		}
+	}
+	// Nothing is grabbed when the failing device was the only one with a matrix to write
+	ASSERT(stats.requests[MOCKX_GRAB_SERVER] == stats.requests[MOCKX_UNGRAB_SERVER]);
+	mockx_device_fail_writes(s->targets[failing].device_id, false);
+}
+
+// Atomic applies to devices which already hold their matrices succeed without grabbing the server
+static void perturb_atomic_unchanged(XRestrictContext * context, Scenario * s, const int applied) {
+	int results[MAX_SCENARIO_DEVICES];
+	MockStats stats;
+
+	for (int repeat = 0; repeat < 2; repeat++) {
+		apply(context, s, results, APPLY_ATOMIC);
+		phase_stats(&stats);
+		ASSERT(scenario_check_matrices(s, results) == applied);
+		ASSERT(stats.requests[MOCKX_GRAB_SERVER] == 0);
+		ASSERT(stats.requests[MOCKX_XI_CHANGE_PROPERTY] == 0);
+	}
+}
+
+// A device is unplugged and another one plugged in, which the server gives the same id
+static void perturb_replug(XRestrictContext * context, Scenario * s, const int applied) {
+	int results[MAX_SCENARIO_DEVICES];
+	MockStats stats;
+
+	mockx_remove_device(s->targets[0].device_id);
+	scenario_random_device(s->devices);
+	const int id = mockx_add_device(s->devices);
+	ASSERT(id == s->targets[0].device_id);
+
+	apply(context, s, results, APPLY_WRITE);
+	phase_stats(&stats);
+	scenario_check_matrices(s, results);
+	ASSERT(stats.requests[MOCKX_XI_QUERY_DEVICE] == 1);
+}
+
+// Two devices with the same name are unplugged and plugged in again, and each is found by name for one state
+static void perturb_replug_identical(XRestrictContext * context, Scenario * s) {
+	DeviceState states[2];
+
+	if (s->device_count < 2) {
+		return;
+	}
+
+	memset(states, 0, sizeof(states));
+	for (int i = 0; i < 2; i++) {
+		mockx_remove_device(s->targets[i].device_id);
+		strncpy(states[i].name, s->devices[0].name, MAX_DEVICE_NAME - 1);
+	}
+	for (int i = 0; i < 2; i++) {
+		s->devices[i].name = s->devices[0].name;
+		s->targets[i].device_id = mockx_add_device(s->devices + i);
+	}
+
+	for (int i = 0; i < 2; i++) {
+		ASSERT(!device_state_find_by_name(context->display, states[i].name, states, 2, states + i));
+	}
+	ASSERT(states[0].id != states[1].id);
+	ASSERT(states[0].id == (XID)s->targets[0].device_id || states[0].id == (XID)s->targets[1].device_id);
+	ASSERT(states[1].id == (XID)s->targets[0].device_id || states[1].id == (XID)s->targets[1].device_id);
+}
+
+static void run_scenario(void) {
+	XRestrictContext context;
+	Scenario s;
+	int results[MAX_SCENARIO_DEVICES];
+	MockStats stats;
+
+	scenario_generate(&s);
+	mockx_reset(RECT_WIDTH(s.screen), RECT_HEIGHT(s.screen));
+	for (int i = 0; i < s.crtc_count; i++) {
+		char output[16];
+		snprintf(output, sizeof(output), "DP-%d", i + 1);
+		mockx_add_crtc(s.crtcs + i, output, s.mm_widths[i], s.mm_heights[i]);
+	}
+	for (int i = 0; i < s.device_count; i++) {
+		s.targets[i].device_id = mockx_add_device(s.devices + i);
+	}
+
+	ASSERT(!xrestrict_context_open(&context, NULL, false));
+	apply(&context, &s, results, APPLY_WRITE);
+	const int applied = scenario_check_matrices(&s, results);
+	phase_stats(&stats);
+
+	// Nothing changed, so nothing is asked of the server
+	apply(&context, &s, results, APPLY_WRITE);
+	phase_stats(&stats);
+	ASSERT(scenario_check_matrices(&s, results) == applied);
+	ASSERT(stats.total_requests == 0);
+
+	switch (scenario % 7) {
+	case 0:
+		perturb_foreign_write(&context, &s, applied);
+		break;
+	case 1:
+		perturb_move_crtc(&context, &s);
+		break;
+	case 2:
+		perturb_atomic_failure(&context, &s);
+		break;
+	case 3:
+		perturb_replug(&context, &s, applied);
+		break;
+	case 4:
+		perturb_atomic_unchanged(&context, &s, applied);
+		break;
+	case 5:
+		perturb_foreign_write_elsewhere(&context, &s, applied);
+		break;
+	case 6:
+		perturb_replug_identical(&context, &s);
+		break;
+	}
+
+	xrestrict_context_close(&context);
+	phase_stats(&stats);
+	ASSERT(stats.unhandled_errors == 0);
+}
+
+static double now_ms(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+int main(int argc, char ** argv) {
+	const int scenarios = argc > 1 ? atoi(argv[1]) : DEFAULT_SCENARIOS;
+
+	report = fdopen(dup(STDOUT_FILENO), "w");
+	if (!report || !freopen("/dev/null", "w", stdout) || !freopen("/dev/null", "w", stderr)) {
+		return -1;
+	}
+
+	const double start = now_ms();
+	for (scenario = 0; scenario < scenarios; scenario++) {
+		run_scenario();
+	}
+	const double elapsed = now_ms() - start;
+
+	fprintf(report, "%d scenarios in %.0f ms, %.0f per second.\n", scenarios, elapsed, scenarios / (elapsed / 1000));
+	fprintf(report, "%lu requests, %lu round trips, %lu errors, %lu events.\n", totals.total_requests, totals.round_trips, totals.errors, totals.events);
+	for (int i = 0; i < MOCKX_REQUEST_TYPES; i++) {
+		if (totals.requests[i]) {
+			fprintf(report, "  %-28s %lu\n", mockx_request_name(i), totals.requests[i]);
+		}
+	}
+	fprintf(report, "%d successes, %d failures.\n", success, failed);
+	return failed ? -1 : 0;
+}
@@ -0,0 +1,1268 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/extensions/XI.h>
+#include <X11/extensions/XInput2.h>
+#include <X11/extensions/Xrandr.h>
+
+#include "mockx.h"
+
+#define MOCKX_ROOT           0x1e0
+#define MOCKX_FIRST_ATOM     300
+#define MOCKX_FIRST_CRTC     0x40
+#define MOCKX_FIRST_OUTPUT   0x80
+#define MOCKX_FIRST_CURSOR   0x600
+#define MOCKX_MASTER_POINTER 2
+#define MOCKX_MASTER_KEYBOARD 3
+// Ids 4 and 5 belong to the XTEST devices on a real server
+#define MOCKX_FIRST_SLAVE    6
+#define MOCKX_MAX_DEVICE_ID  (MOCKX_FIRST_SLAVE + MOCKX_MAX_DEVICES)
+
+// What a typical server hands out, so that traces look familiar
+#define MOCKX_XI_OPCODE      131
+#define MOCKX_XI_EVENT_BASE  66
+#define MOCKX_XI_ERROR_BASE  129
+#define MOCKX_RR_OPCODE      140
+#define MOCKX_RR_EVENT_BASE  89
+#define MOCKX_RR_ERROR_BASE  147
+
+#define MOCKX_NAME_SIZE      64
+
+static const struct {
+	const char *  name;
+	unsigned char major, minor;
+} mockx_requests[MOCKX_REQUEST_TYPES] = {
+	[MOCKX_INTERN_ATOM]         = {"InternAtom", 16, 0},
+	[MOCKX_QUERY_EXTENSION]     = {"QueryExtension", 98, 0},
+	[MOCKX_SYNC]                = {"GetInputFocus", 43, 0},
+	[MOCKX_GRAB_SERVER]         = {"GrabServer", 36, 0},
+	[MOCKX_UNGRAB_SERVER]       = {"UngrabServer", 37, 0},
+	[MOCKX_CURSOR]              = {"CreateGlyphCursor", 94, 0},
+	[MOCKX_RR_SELECT_INPUT]     = {"RRSelectInput", MOCKX_RR_OPCODE, 4},
+	[MOCKX_RR_SCREEN_RESOURCES] = {"RRGetScreenResourcesCurrent", MOCKX_RR_OPCODE, 25},
+	[MOCKX_RR_CRTC_INFO]        = {"RRGetCrtcInfo", MOCKX_RR_OPCODE, 20},
+	[MOCKX_RR_OUTPUT_INFO]      = {"RRGetOutputInfo", MOCKX_RR_OPCODE, 9},
+	[MOCKX_XI_QUERY_DEVICE]     = {"XIQueryDevice", MOCKX_XI_OPCODE, 48},
+	[MOCKX_XI_SELECT_EVENTS]    = {"XISelectEvents", MOCKX_XI_OPCODE, 46},
+	[MOCKX_XI_GET_PROPERTY]     = {"XIGetProperty", MOCKX_XI_OPCODE, 59},
+	[MOCKX_XI_CHANGE_PROPERTY]  = {"XIChangeProperty", MOCKX_XI_OPCODE, 57},
+	[MOCKX_XI_GRAB_DEVICE]      = {"XIGrabDevice", MOCKX_XI_OPCODE, 51},
+	[MOCKX_XI_UNGRAB_DEVICE]    = {"XIUngrabDevice", MOCKX_XI_OPCODE, 52},
+};
+
+// Atoms every server running the evdev or libinput driver has
+static const char * const mockx_predefined_atoms[] = {
+	"Coordinate Transformation Matrix", "FLOAT", "Abs X", "Abs Y", "Rel X", "Rel Y", "Device Product ID", "Device Node"
+};
+enum {MOCKX_ATOM_MATRIX, MOCKX_ATOM_FLOAT, MOCKX_ATOM_ABS_X, MOCKX_ATOM_ABS_Y, MOCKX_ATOM_REL_X, MOCKX_ATOM_REL_Y, MOCKX_ATOM_PRODUCT, MOCKX_ATOM_NODE};
+
+typedef struct MockCrtc {
+	Rectangle region;
+	bool      enabled;
+	char      output[MOCKX_NAME_SIZE];
+	int       mm_width, mm_height;
+} MockCrtc;
+
+typedef struct MockDevice {
+	bool      used;
+	char      name[MOCKX_NAME_SIZE];
+	char      node[MOCKX_NAME_SIZE];
+	Rectangle range;
+	int       hres, vres;
+	int       vendor, product;
+	float     matrix[9];
+	bool      fail_writes;
+} MockDevice;
+
+typedef struct MockEvent {
+	XEvent event;
+	void * data; // What XGetEventData hands out for generic events
+} MockEvent;
+
+typedef struct MockConnection {
+	_XPrivDisplay display;
+	Screen        screen;
+	char          name[MOCKX_NAME_SIZE];
+	int           (*after)(Display *);
+	bool          atoms_cached[MOCKX_MAX_ATOMS];
+	bool          randr_initialized;
+	int           rr_mask;
+	unsigned char xi_masks[MOCKX_MAX_DEVICE_ID][XIMaskLen(XI_LASTEVENT)];
+	MockEvent *   events;
+	int           event_head, event_count, event_capacity;
+	XErrorEvent * errors;
+	int           error_count, error_capacity;
+	unsigned int  cookie;           // Cookie of the last generic event handed out
+	void *        unclaimed;        // Its data, until XGetEventData claims it or the next event is taken
+	struct MockConnection * next;
+} MockConnection;
+
+static struct {
+	int            width, height;
+	MockCrtc       crtcs[MOCKX_MAX_CRTCS];
+	int            crtc_count;
+	MockDevice     devices[MOCKX_MAX_DEVICES];
+	char           atoms[MOCKX_MAX_ATOMS][MOCKX_NAME_SIZE];
+	int            atom_count;
+	Time           config_time;
+	Cursor         next_cursor;
+	MockConnection * connections;
+	XErrorHandler  error_handler;
+	struct {
+		unsigned long skip, count;
+	}              failures[MOCKX_REQUEST_TYPES];
+	struct {
+		bool        pending;
+		MockRequest request;
+		int         id;
+		float       matrix[9];
+	}              foreign_write;    // See mockx_device_write_matrix_during
+	double         latency_ms;
+	bool           sleep;
+	MockStats      stats;
+} server;
+
+static MockConnection * mockx_connection(Display * display) {
+	for (MockConnection * connection = server.connections; connection; connection = connection->next) {
+		if ((Display *)connection->display == display) {
+			return connection;
+		}
+	}
+
+	fprintf(stderr, "mockx: %p is not a mock display.\n", (void *)display);
+	abort();
+}
+
+static MockDevice * mockx_device(const int id) {
+	const int index = id - MOCKX_FIRST_SLAVE;
+
+	if (index < 0 || index >= MOCKX_MAX_DEVICES || !server.devices[index].used) {
+		return NULL;
+	}
+	return server.devices + index;
+}
+
+static bool mockx_device_exists(const int id) {
+	return id == MOCKX_MASTER_POINTER || id == MOCKX_MASTER_KEYBOARD || mockx_device(id);
+}
+
+static void mockx_reset_atoms(void) {
+	server.atom_count = sizeof(mockx_predefined_atoms) / sizeof(*mockx_predefined_atoms);
+	for (int i = 0; i < server.atom_count; i++) {
+		snprintf(server.atoms[i], MOCKX_NAME_SIZE, "%s", mockx_predefined_atoms[i]);
+	}
+}
+
+static int mockx_atom_index(const char * name) {
+	if (!server.atom_count) {
+		mockx_reset_atoms();
+	}
+
+	for (int i = 0; i < server.atom_count; i++) {
+		if (strcmp(server.atoms[i], name) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static Atom mockx_atom(const int index) {
+	return MOCKX_FIRST_ATOM + index;
+}
+
+// Counts a request, returns true when mockx_fail says it must fail
+static bool mockx_request(MockConnection * connection, const MockRequest request) {
+	connection->display->request++;
+	server.stats.requests[request]++;
+	server.stats.total_requests++;
+
+	if (server.foreign_write.pending && server.foreign_write.request == request) {
+		server.foreign_write.pending = false;
+		mockx_device_write_matrix(server.foreign_write.id, server.foreign_write.matrix);
+	}
+
+	if (server.failures[request].skip) {
+		server.failures[request].skip--;
+		return false;
+	} else if (server.failures[request].count) {
+		server.failures[request].count--;
+		return true;
+	}
+	return false;
+}
+
+// The error is for the request just counted, and reaches the client the next time it reads from the server
+static void mockx_error(MockConnection * connection, const MockRequest request, const unsigned char code, const XID resource) {
+	server.stats.errors++;
+
+	if (connection->error_count >= connection->error_capacity) {
+		int capacity = connection->error_capacity ? connection->error_capacity * 2 : 8;
+		XErrorEvent * errors = realloc(connection->errors, capacity * sizeof(*errors));
+		if (!errors) {
+			return;
+		}
+		connection->errors = errors;
+		connection->error_capacity = capacity;
+	}
+
+	connection->errors[connection->error_count++] = (XErrorEvent) {
+		.type = 0,
+		.display = (Display *)connection->display,
+		.resourceid = resource,
+		.serial = connection->display->request,
+		.error_code = code,
+		.request_code = mockx_requests[request].major,
+		.minor_code = mockx_requests[request].minor
+	};
+}
+
+static void mockx_deliver_errors(MockConnection * connection) {
+	for (int i = 0; i < connection->error_count; i++) {
+		if (server.error_handler) {
+			server.error_handler((Display *)connection->display, connection->errors + i);
+		} else {
+			server.stats.unhandled_errors++;
+		}
+	}
+	connection->error_count = 0;
+}
+
+// Waits for the reply to the last request, which every error caused by earlier requests arrives before
+static void mockx_round_trip(MockConnection * connection) {
+	connection->display->last_request_read = connection->display->request;
+	server.stats.round_trips++;
+	server.stats.latency_ms += server.latency_ms;
+
+	if (server.sleep && server.latency_ms > 0) {
+		struct timespec latency = {
+			.tv_sec = (time_t)(server.latency_ms / 1000),
+			.tv_nsec = (long)((server.latency_ms - (time_t)(server.latency_ms / 1000) * 1000.0) * 1000000.0)
+		};
+		nanosleep(&latency, NULL);
+	}
+
+	mockx_deliver_errors(connection);
+}
+
+// Xlib calls the after function at the end of every call which issued a request
+static void mockx_after(MockConnection * connection) {
+	if (connection->after) {
+		connection->after((Display *)connection->display);
+	}
+}
+
+static void mockx_queue_event(MockConnection * connection, const XEvent * event, void * data) {
+	if (connection->event_head == connection->event_count) {
+		connection->event_head = connection->event_count = 0;
+	}
+
+	if (connection->event_count >= connection->event_capacity) {
+		int capacity = connection->event_capacity ? connection->event_capacity * 2 : 16;
+		MockEvent * events = realloc(connection->events, capacity * sizeof(*events));
+		if (!events) {
+			free(data);
+			return;
+		}
+		connection->events = events;
+		connection->event_capacity = capacity;
+	}
+
+	MockEvent * queued = connection->events + connection->event_count++;
+	queued->event = *event;
+	queued->event.xany.display = (Display *)connection->display;
+	queued->data = data;
+	server.stats.events++;
+}
+
+static void mockx_take_event(MockConnection * connection, const int index, XEvent * event) {
+	// Like Xlib, data nobody asked for is gone once the next event is taken
+	free(connection->unclaimed);
+	connection->unclaimed = NULL;
+
+	MockEvent * taken = connection->events + index;
+	*event = taken->event;
+	// Like Xlib, reading an event tells the client the server processed every request up to its serial
+	if (event->xany.serial > connection->display->last_request_read) {
+		connection->display->last_request_read = event->xany.serial;
+	}
+	if (taken->data) {
+		connection->cookie = event->xcookie.cookie = connection->cookie + 1;
+		connection->unclaimed = taken->data;
+	}
+
+	if (index == connection->event_head) {
+		connection->event_head++;
+	} else {
+		memmove(taken, taken + 1, (connection->event_count - index - 1) * sizeof(*taken));
+		connection->event_count--;
+	}
+}
+
+static bool mockx_selected(const MockConnection * connection, const int id, const int evtype) {
+	return XIMaskIsSet(connection->xi_masks[XIAllDevices], evtype) ||
+		(id >= 0 && id < MOCKX_MAX_DEVICE_ID && XIMaskIsSet(connection->xi_masks[id], evtype));
+}
+
+// Every client sees the serial of the last request it sent, which for the writer is the write itself
+static void mockx_property_event(const int id, const Atom property, const int what) {
+	for (MockConnection * connection = server.connections; connection; connection = connection->next) {
+		if (!mockx_selected(connection, id, XI_PropertyEvent)) {
+			continue;
+		}
+
+		XIPropertyEvent * data = malloc(sizeof(*data));
+		if (!data) {
+			continue;
+		}
+		*data = (XIPropertyEvent) {
+			.type = GenericEvent,
+			.serial = connection->display->request,
+			.display = (Display *)connection->display,
+			.extension = MOCKX_XI_OPCODE,
+			.evtype = XI_PropertyEvent,
+			.deviceid = id,
+			.property = property,
+			.what = what
+		};
+
+		XEvent event;
+		memset(&event, 0, sizeof(event));
+		event.xcookie.type = GenericEvent;
+		event.xcookie.serial = data->serial;
+		event.xcookie.extension = MOCKX_XI_OPCODE;
+		event.xcookie.evtype = XI_PropertyEvent;
+		mockx_queue_event(connection, &event, data);
+	}
+}
+
+static void mockx_hierarchy_event(const int id, const int flags) {
+	for (MockConnection * connection = server.connections; connection; connection = connection->next) {
+		if (!XIMaskIsSet(connection->xi_masks[XIAllDevices], XI_HierarchyChanged)) {
+			continue;
+		}
+
+		// The info entry lives in the same block, so XFreeEventData frees both
+		XIHierarchyEvent * data = malloc(sizeof(*data) + sizeof(XIHierarchyInfo));
+		if (!data) {
+			continue;
+		}
+		XIHierarchyInfo * info = (XIHierarchyInfo *)(data + 1);
+		*info = (XIHierarchyInfo) {
+			.deviceid = id,
+			.attachment = MOCKX_MASTER_POINTER,
+			.use = flags & XISlaveRemoved ? 0 : XISlavePointer,
+			.enabled = !(flags & XISlaveRemoved),
+			.flags = flags
+		};
+		*data = (XIHierarchyEvent) {
+			.type = GenericEvent,
+			.serial = connection->display->request,
+			.display = (Display *)connection->display,
+			.extension = MOCKX_XI_OPCODE,
+			.evtype = XI_HierarchyChanged,
+			.flags = flags,
+			.num_info = 1,
+			.info = info
+		};
+
+		XEvent event;
+		memset(&event, 0, sizeof(event));
+		event.xcookie.type = GenericEvent;
+		event.xcookie.serial = data->serial;
+		event.xcookie.extension = MOCKX_XI_OPCODE;
+		event.xcookie.evtype = XI_HierarchyChanged;
+		mockx_queue_event(connection, &event, data);
+	}
+}
+
+// Setup
+
+int mockx_reset(const int width, const int height) {
+	if (server.connections) {
+		return EMOCKX_CONNECTED;
+	}
+
+	XErrorHandler error_handler = server.error_handler;
+	memset(&server, 0, sizeof(server));
+	server.error_handler = error_handler;
+	server.width = width;
+	server.height = height;
+	server.next_cursor = MOCKX_FIRST_CURSOR;
+	mockx_reset_atoms();
+	return 0;
+}
+
+int mockx_add_crtc(const Rectangle * region, const char * output, const int mm_width, const int mm_height) {
+	if (server.crtc_count >= MOCKX_MAX_CRTCS) {
+		return EMOCKX_FULL;
+	}
+
+	MockCrtc * crtc = server.crtcs + server.crtc_count;
+	crtc->region = *region;
+	crtc->enabled = true;
+	snprintf(crtc->output, sizeof(crtc->output), "%s", output);
+	crtc->mm_width = mm_width;
+	crtc->mm_height = mm_height;
+	server.config_time++;
+	return server.crtc_count++;
+}
+
+int mockx_set_crtc(const int index, const Rectangle * region) {
+	if (index < 0 || index >= server.crtc_count) {
+		return EMOCKX_NO_SUCH;
+	}
+
+	MockCrtc * crtc = server.crtcs + index;
+	crtc->enabled = region != NULL;
+	if (region) {
+		crtc->region = *region;
+	}
+	server.config_time++;
+
+	for (MockConnection * connection = server.connections; connection; connection = connection->next) {
+		if (!(connection->rr_mask & RRCrtcChangeNotifyMask)) {
+			continue;
+		}
+
+		XEvent event;
+		memset(&event, 0, sizeof(event));
+		XRRCrtcChangeNotifyEvent * notify = (XRRCrtcChangeNotifyEvent *)&event;
+		notify->type = MOCKX_RR_EVENT_BASE + RRNotify;
+		notify->serial = connection->display->request;
+		notify->window = MOCKX_ROOT;
+		notify->subtype = RRNotify_CrtcChange;
+		notify->crtc = MOCKX_FIRST_CRTC + index;
+		notify->mode = crtc->enabled ? MOCKX_FIRST_CRTC + index : None;
+		notify->rotation = RR_Rotate_0;
+		notify->x = crtc->enabled ? crtc->region.left : 0;
+		notify->y = crtc->enabled ? crtc->region.top : 0;
+		notify->width = crtc->enabled ? RECT_WIDTH(crtc->region) : 0;
+		notify->height = crtc->enabled ? RECT_HEIGHT(crtc->region) : 0;
+		mockx_queue_event(connection, &event, NULL);
+	}
+	return 0;
+}
+
+void mockx_set_screen_size(const int width, const int height) {
+	server.width = width;
+	server.height = height;
+	server.config_time++;
+
+	for (MockConnection * connection = server.connections; connection; connection = connection->next) {
+		if (!(connection->rr_mask & RRScreenChangeNotifyMask)) {
+			continue;
+		}
+
+		XEvent event;
+		memset(&event, 0, sizeof(event));
+		XRRScreenChangeNotifyEvent * notify = (XRRScreenChangeNotifyEvent *)&event;
+		notify->type = MOCKX_RR_EVENT_BASE + RRScreenChangeNotify;
+		notify->serial = connection->display->request;
+		notify->window = notify->root = MOCKX_ROOT;
+		notify->timestamp = notify->config_timestamp = server.config_time;
+		notify->rotation = RR_Rotate_0;
+		notify->width = width;
+		notify->height = height;
+		// 96 dpi
+		notify->mwidth = width * 254 / 960;
+		notify->mheight = height * 254 / 960;
+		mockx_queue_event(connection, &event, NULL);
+	}
+}
+
+int mockx_add_device(const MockDeviceInfo * info) {
+	// Like a real server, the lowest free id is handed out again
+	for (int i = 0; i < MOCKX_MAX_DEVICES; i++) {
+		MockDevice * device = server.devices + i;
+		if (device->used) {
+			continue;
+		}
+
+		memset(device, 0, sizeof(*device));
+		device->used = true;
+		snprintf(device->name, sizeof(device->name), "%s", info->name ? info->name : "");
+		snprintf(device->node, sizeof(device->node), "%s", info->node ? info->node : "");
+		device->range = info->range;
+		device->hres = info->hres;
+		device->vres = info->vres;
+		device->vendor = info->vendor;
+		device->product = info->product;
+		device->matrix[0] = device->matrix[4] = device->matrix[8] = 1;
+
+		mockx_hierarchy_event(MOCKX_FIRST_SLAVE + i, XISlaveAdded);
+		return MOCKX_FIRST_SLAVE + i;
+	}
+	return EMOCKX_FULL;
+}
+
+int mockx_remove_device(const int id) {
+	MockDevice * device = mockx_device(id);
+	if (!device) {
+		return EMOCKX_NO_SUCH;
+	}
+
+	device->used = false;
+	for (MockConnection * connection = server.connections; connection; connection = connection->next) {
+		memset(connection->xi_masks[id], 0, sizeof(connection->xi_masks[id]));
+	}
+	mockx_hierarchy_event(id, XISlaveRemoved);
+	return 0;
+}
+
+int mockx_device_matrix(const int id, float * matrix) {
+	const MockDevice * device = mockx_device(id);
+	if (!device) {
+		return EMOCKX_NO_SUCH;
+	}
+
+	memcpy(matrix, device->matrix, sizeof(device->matrix));
+	return 0;
+}
+
+int mockx_device_write_matrix(const int id, const float * matrix) {
+	MockDevice * device = mockx_device(id);
+	if (!device) {
+		return EMOCKX_NO_SUCH;
+	}
+
+	memcpy(device->matrix, matrix, sizeof(device->matrix));
+	mockx_property_event(id, mockx_atom(MOCKX_ATOM_MATRIX), XIPropertyModified);
+	return 0;
+}
+
+int mockx_device_write_matrix_during(const MockRequest request, const int id, const float * matrix) {
+	if (!mockx_device(id)) {
+		return EMOCKX_NO_SUCH;
+	}
+
+	server.foreign_write.pending = true;
+	server.foreign_write.request = request;
+	server.foreign_write.id = id;
+	memcpy(server.foreign_write.matrix, matrix, sizeof(server.foreign_write.matrix));
+	return 0;
+}
+
+int mockx_device_fail_writes(const int id, const bool fail) {
+	MockDevice * device = mockx_device(id);
+	if (!device) {
+		return EMOCKX_NO_SUCH;
+	}
+
+	device->fail_writes = fail;
+	return 0;
+}
+
+void mockx_fail(const MockRequest request, const unsigned long skip, const unsigned long count) {
+	server.failures[request].skip = skip;
+	server.failures[request].count = count;
+}
+
+void mockx_set_latency(const double round_trip_ms, const bool sleep) {
+	server.latency_ms = round_trip_ms;
+	server.sleep = sleep;
+}
+
+void mockx_get_stats(MockStats * stats) {
+	*stats = server.stats;
+}
+
+void mockx_reset_stats(void) {
+	memset(&server.stats, 0, sizeof(server.stats));
+}
+
+const char * mockx_request_name(const MockRequest request) {
+	return request >= 0 && request < MOCKX_REQUEST_TYPES ? mockx_requests[request].name : "Unknown";
+}
+
+// Xlib
+
+Display * XOpenDisplay(_Xconst char * display_name) {
+	MockConnection * connection = calloc(1, sizeof(*connection));
+	_XPrivDisplay display = calloc(1, sizeof(*display));
+
+	if (!connection || !display) {
+		free(connection);
+		free(display);
+		return NULL;
+	}
+
+	snprintf(connection->name, sizeof(connection->name), "%s", display_name ? display_name : ":0");
+	connection->display = display;
+	connection->screen.display = (Display *)display;
+	connection->screen.root = MOCKX_ROOT;
+	connection->screen.width = server.width;
+	connection->screen.height = server.height;
+	connection->screen.mwidth = server.width * 254 / 960;
+	connection->screen.mheight = server.height * 254 / 960;
+	connection->screen.root_depth = 24;
+	connection->screen.white_pixel = 0xffffff;
+	connection->screen.black_pixel = 0;
+
+	// There is no socket, xlib_wait_for_events only ever finds queued events
+	display->fd = -1;
+	display->display_name = connection->name;
+	display->default_screen = 0;
+	display->nscreens = 1;
+	display->screens = &connection->screen;
+
+	connection->next = server.connections;
+	server.connections = connection;
+	return (Display *)display;
+}
+
+int XCloseDisplay(Display * display) {
+	MockConnection * connection = mockx_connection(display);
+
+	MockConnection ** link = &server.connections;
+	while (*link != connection) {
+		link = &(*link)->next;
+	}
+	*link = connection->next;
+
+	for (int i = connection->event_head; i < connection->event_count; i++) {
+		free(connection->events[i].data);
+	}
+	free(connection->events);
+	free(connection->errors);
+	free(connection->unclaimed);
+	free(connection->display);
+	free(connection);
+	return 0;
+}
+
+int (*XSetAfterFunction(Display * display, int (*procedure)(Display *)))(Display *) {
+	MockConnection * connection = mockx_connection(display);
+	int (*previous)(Display *) = connection->after;
+
+	connection->after = procedure;
+	return previous;
+}
+
+XErrorHandler XSetErrorHandler(XErrorHandler handler) {
+	XErrorHandler previous = server.error_handler;
+
+	server.error_handler = handler;
+	return previous;
+}
+
+int XFree(void * data) {
+	free(data);
+	return 1;
+}
+
+int XFlush(Display * display) {
+	return 1;
+}
+
+int XSync(Display * display, Bool discard) {
+	MockConnection * connection = mockx_connection(display);
+
+	mockx_request(connection, MOCKX_SYNC);
+	mockx_round_trip(connection);
+	if (discard) {
+		while (connection->event_head < connection->event_count) {
+			free(connection->events[connection->event_head++].data);
+		}
+	}
+	mockx_after(connection);
+	return 1;
+}
+
+int XGrabServer(Display * display) {
+	MockConnection * connection = mockx_connection(display);
+
+	if (mockx_request(connection, MOCKX_GRAB_SERVER)) {
+		mockx_error(connection, MOCKX_GRAB_SERVER, BadAccess, None);
+	}
+	mockx_after(connection);
+	return 1;
+}
+
+int XUngrabServer(Display * display) {
+	MockConnection * connection = mockx_connection(display);
+
+	if (mockx_request(connection, MOCKX_UNGRAB_SERVER)) {
+		mockx_error(connection, MOCKX_UNGRAB_SERVER, BadAccess, None);
+	}
+	mockx_after(connection);
+	return 1;
+}
+
+Bool XQueryExtension(Display * display, _Xconst char * name, int * major_opcode, int * first_event, int * first_error) {
+	MockConnection * connection = mockx_connection(display);
+	Bool present = False;
+
+	if (mockx_request(connection, MOCKX_QUERY_EXTENSION)) {
+		mockx_error(connection, MOCKX_QUERY_EXTENSION, BadImplementation, None);
+	} else if (strcmp(name, "XInputExtension") == 0) {
+		*major_opcode = MOCKX_XI_OPCODE;
+		*first_event = MOCKX_XI_EVENT_BASE;
+		*first_error = MOCKX_XI_ERROR_BASE;
+		present = True;
+	} else if (strcmp(name, "RANDR") == 0) {
+		*major_opcode = MOCKX_RR_OPCODE;
+		*first_event = MOCKX_RR_EVENT_BASE;
+		*first_error = MOCKX_RR_ERROR_BASE;
+		present = True;
+	}
+
+	mockx_round_trip(connection);
+	mockx_after(connection);
+	return present;
+}
+
+Status XInternAtoms(Display * display, char ** names, int count, Bool only_if_exists, Atom * atoms_return) {
+	MockConnection * connection = mockx_connection(display);
+	Status status = 1;
+	bool waited = false;
+
+	for (int i = 0; i < count; i++) {
+		int index = mockx_atom_index(names[i]);
+		if (index >= 0 && connection->atoms_cached[index]) {
+			atoms_return[i] = mockx_atom(index);
+			continue;
+		}
+
+		// Every name Xlib hasn't cached yet is sent at once, and their replies waited on together
+		waited = true;
+		if (mockx_request(connection, MOCKX_INTERN_ATOM)) {
+			mockx_error(connection, MOCKX_INTERN_ATOM, BadAlloc, None);
+			index = -1;
+		} else if (index < 0 && !only_if_exists && server.atom_count < MOCKX_MAX_ATOMS) {
+			index = server.atom_count++;
+			snprintf(server.atoms[index], MOCKX_NAME_SIZE, "%s", names[i]);
+		}
+
+		if (index < 0) {
+			atoms_return[i] = None;
+			status = 0;
+		} else {
+			connection->atoms_cached[index] = true;
+			atoms_return[i] = mockx_atom(index);
+		}
+	}
+
+	if (waited) {
+		mockx_round_trip(connection);
+		mockx_after(connection);
+	}
+	return status;
+}
+
+Cursor XCreateFontCursor(Display * display, unsigned int shape) {
+	MockConnection * connection = mockx_connection(display);
+
+	mockx_request(connection, MOCKX_CURSOR);
+	mockx_after(connection);
+	return server.next_cursor++;
+}
+
+int XFreeCursor(Display * display, Cursor cursor) {
+	MockConnection * connection = mockx_connection(display);
+
+	mockx_request(connection, MOCKX_CURSOR);
+	mockx_after(connection);
+	return 1;
+}
+
+int XPending(Display * display) {
+	MockConnection * connection = mockx_connection(display);
+
+	// Reading the events from the connection also reads any error sent before them
+	mockx_deliver_errors(connection);
+	return connection->event_count - connection->event_head;
+}
+
+int XNextEvent(Display * display, XEvent * event) {
+	MockConnection * connection = mockx_connection(display);
+
+	// A real client would block forever, give it an event no handler matches instead
+	if (connection->event_head == connection->event_count) {
+		memset(event, 0, sizeof(*event));
+		return 0;
+	}
+
+	mockx_take_event(connection, connection->event_head, event);
+	return 0;
+}
+
+Bool XCheckIfEvent(Display * display, XEvent * event, Bool (*predicate)(Display *, XEvent *, XPointer), XPointer argument) {
+	MockConnection * connection = mockx_connection(display);
+
+	mockx_deliver_errors(connection);
+	for (int i = connection->event_head; i < connection->event_count; i++) {
+		if (predicate(display, &connection->events[i].event, argument)) {
+			mockx_take_event(connection, i, event);
+			return True;
+		}
+	}
+	return False;
+}
+
+int XPutBackEvent(Display * display, XEvent * event) {
+	MockConnection * connection = mockx_connection(display);
+	void * data = NULL;
+
+	// Like Xlib, claimed data is copied so the caller may still free its own
+	if (event->type == GenericEvent && event->xcookie.data) {
+		const size_t size = event->xcookie.evtype == XI_PropertyEvent ? sizeof(XIPropertyEvent) : 0;
+		if (!size || !(data = malloc(size))) {
+			return 0;
+		}
+		memcpy(data, event->xcookie.data, size);
+	}
+
+	if (!connection->event_head) {
+		const int count = connection->event_count;
+		mockx_queue_event(connection, event, data);
+		if (connection->event_count == count) {
+			return 0;
+		}
+		// Nothing new came from the server
+		server.stats.events--;
+		MockEvent queued = connection->events[connection->event_count - 1];
+		memmove(connection->events + 1, connection->events, (connection->event_count - 1) * sizeof(*connection->events));
+		connection->events[0] = queued;
+	} else {
+		MockEvent * queued = connection->events + --connection->event_head;
+		queued->event = *event;
+		queued->data = data;
+	}
+	connection->events[connection->event_head].event.xcookie.data = NULL;
+	return 0;
+}
+
+Bool XGetEventData(Display * display, XGenericEventCookie * cookie) {
+	MockConnection * connection = mockx_connection(display);
+
+	if (!connection->unclaimed || cookie->cookie != connection->cookie) {
+		return False;
+	}
+
+	cookie->data = connection->unclaimed;
+	connection->unclaimed = NULL;
+	return True;
+}
+
+void XFreeEventData(Display * display, XGenericEventCookie * cookie) {
+	free(cookie->data);
+	cookie->data = NULL;
+}
+
+// XRandR
+
+Bool XRRQueryExtension(Display * display, int * event_base, int * error_base) {
+	MockConnection * connection = mockx_connection(display);
+
+	// libXrandr looks the extension up once per display
+	if (!connection->randr_initialized) {
+		mockx_request(connection, MOCKX_QUERY_EXTENSION);
+		mockx_round_trip(connection);
+		connection->randr_initialized = true;
+		mockx_after(connection);
+	}
+
+	*event_base = MOCKX_RR_EVENT_BASE;
+	*error_base = MOCKX_RR_ERROR_BASE;
+	return True;
+}
+
+void XRRSelectInput(Display * display, Window window, int mask) {
+	MockConnection * connection = mockx_connection(display);
+
+	if (mockx_request(connection, MOCKX_RR_SELECT_INPUT)) {
+		mockx_error(connection, MOCKX_RR_SELECT_INPUT, BadValue, window);
+	} else {
+		connection->rr_mask = mask;
+	}
+	mockx_after(connection);
+}
+
+int XRRUpdateConfiguration(XEvent * event) {
+	if (event->type != MOCKX_RR_EVENT_BASE + RRScreenChangeNotify) {
+		return 0;
+	}
+
+	MockConnection * connection = mockx_connection(event->xany.display);
+	const XRRScreenChangeNotifyEvent * notify = (const XRRScreenChangeNotifyEvent *)event;
+	connection->screen.width = notify->width;
+	connection->screen.height = notify->height;
+	connection->screen.mwidth = notify->mwidth;
+	connection->screen.mheight = notify->mheight;
+	return 1;
+}
+
+XRRScreenResources * XRRGetScreenResourcesCurrent(Display * display, Window window) {
+	MockConnection * connection = mockx_connection(display);
+
+	if (mockx_request(connection, MOCKX_RR_SCREEN_RESOURCES)) {
+		mockx_error(connection, MOCKX_RR_SCREEN_RESOURCES, BadImplementation, window);
+		mockx_round_trip(connection);
+		mockx_after(connection);
+		return NULL;
+	}
+	mockx_round_trip(connection);
+
+	// One block, as XRRFreeScreenResources frees it with a single call
+	XRRScreenResources * resources = calloc(1, sizeof(*resources) + server.crtc_count * (sizeof(RRCrtc) + sizeof(RROutput)));
+	if (resources) {
+		resources->timestamp = resources->configTimestamp = server.config_time;
+		resources->ncrtc = resources->noutput = server.crtc_count;
+		resources->crtcs = (RRCrtc *)(resources + 1);
+		resources->outputs = (RROutput *)(resources->crtcs + server.crtc_count);
+		for (int i = 0; i < server.crtc_count; i++) {
+			resources->crtcs[i] = MOCKX_FIRST_CRTC + i;
+			resources->outputs[i] = MOCKX_FIRST_OUTPUT + i;
+		}
+	}
+
+	mockx_after(connection);
+	return resources;
+}
+
+void XRRFreeScreenResources(XRRScreenResources * resources) {
+	free(resources);
+}
+
+XRRCrtcInfo * XRRGetCrtcInfo(Display * display, XRRScreenResources * resources, RRCrtc crtc) {
+	MockConnection * connection = mockx_connection(display);
+	const int index = crtc - MOCKX_FIRST_CRTC;
+
+	if (mockx_request(connection, MOCKX_RR_CRTC_INFO) || index < 0 || index >= server.crtc_count) {
+		mockx_error(connection, MOCKX_RR_CRTC_INFO, MOCKX_RR_ERROR_BASE + BadRRCrtc, crtc);
+		mockx_round_trip(connection);
+		mockx_after(connection);
+		return NULL;
+	}
+	mockx_round_trip(connection);
+
+	const MockCrtc * mock = server.crtcs + index;
+	XRRCrtcInfo * info = calloc(1, sizeof(*info) + 2 * sizeof(RROutput));
+	if (info) {
+		info->timestamp = server.config_time;
+		info->rotation = info->rotations = RR_Rotate_0;
+		info->outputs = (RROutput *)(info + 1);
+		info->possible = info->outputs + 1;
+		info->npossible = 1;
+		info->possible[0] = MOCKX_FIRST_OUTPUT + index;
+
+		if (mock->enabled) {
+			info->x = mock->region.left;
+			info->y = mock->region.top;
+			info->width = RECT_WIDTH(mock->region);
+			info->height = RECT_HEIGHT(mock->region);
+			info->mode = crtc;
+			info->noutput = 1;
+			info->outputs[0] = MOCKX_FIRST_OUTPUT + index;
+		}
+	}
+
+	mockx_after(connection);
+	return info;
+}
+
+void XRRFreeCrtcInfo(XRRCrtcInfo * info) {
+	free(info);
+}
+
+XRROutputInfo * XRRGetOutputInfo(Display * display, XRRScreenResources * resources, RROutput output) {
+	MockConnection * connection = mockx_connection(display);
+	const int index = output - MOCKX_FIRST_OUTPUT;
+
+	if (mockx_request(connection, MOCKX_RR_OUTPUT_INFO) || index < 0 || index >= server.crtc_count) {
+		mockx_error(connection, MOCKX_RR_OUTPUT_INFO, MOCKX_RR_ERROR_BASE + BadRROutput, output);
+		mockx_round_trip(connection);
+		mockx_after(connection);
+		return NULL;
+	}
+	mockx_round_trip(connection);
+
+	const MockCrtc * mock = server.crtcs + index;
+	const size_t name_length = strlen(mock->output);
+	XRROutputInfo * info = calloc(1, sizeof(*info) + sizeof(RRCrtc) + name_length + 1);
+	if (info) {
+		info->timestamp = server.config_time;
+		info->crtc = mock->enabled ? MOCKX_FIRST_CRTC + index : None;
+		info->mm_width = mock->mm_width;
+		info->mm_height = mock->mm_height;
+		info->connection = mock->enabled ? RR_Connected : RR_Disconnected;
+		info->ncrtc = 1;
+		info->crtcs = (RRCrtc *)(info + 1);
+		info->crtcs[0] = MOCKX_FIRST_CRTC + index;
+		info->name = (char *)(info->crtcs + 1);
+		info->nameLen = name_length;
+		memcpy(info->name, mock->output, name_length + 1);
+	}
+
+	mockx_after(connection);
+	return info;
+}
+
+void XRRFreeOutputInfo(XRROutputInfo * info) {
+	free(info);
+}
+
+// XInput2
+
+#define MOCKX_ALIGN(size) (((size) + 15) & ~(size_t)15)
+
+static int mockx_device_classes(const int id) {
+	return id == MOCKX_MASTER_KEYBOARD ? 0 : 2;
+}
+
+static const char * mockx_device_name(const int id) {
+	const MockDevice * device = mockx_device(id);
+
+	if (device) {
+		return device->name;
+	}
+	return id == MOCKX_MASTER_POINTER ? "Virtual core pointer" : "Virtual core keyboard";
+}
+
+static void mockx_fill_device_info(const int id, XIDeviceInfo * info, XIAnyClassInfo ** classes, XIValuatorClassInfo * valuators, char * name) {
+	const MockDevice * device = mockx_device(id);
+
+	info->deviceid = id;
+	info->name = strcpy(name, mockx_device_name(id));
+	info->enabled = True;
+	info->num_classes = mockx_device_classes(id);
+	info->classes = classes;
+
+	if (id == MOCKX_MASTER_POINTER) {
+		info->use = XIMasterPointer;
+		info->attachment = MOCKX_MASTER_KEYBOARD;
+	} else if (id == MOCKX_MASTER_KEYBOARD) {
+		info->use = XIMasterKeyboard;
+		info->attachment = MOCKX_MASTER_POINTER;
+	} else {
+		info->use = XISlavePointer;
+		info->attachment = MOCKX_MASTER_POINTER;
+	}
+
+	for (int axis = 0; axis < info->num_classes; axis++) {
+		XIValuatorClassInfo * valuator = valuators + axis;
+		classes[axis] = (XIAnyClassInfo *)valuator;
+		valuator->type = XIValuatorClass;
+		valuator->sourceid = id;
+		valuator->number = axis;
+
+		if (device) {
+			valuator->label = mockx_atom(axis ? MOCKX_ATOM_ABS_Y : MOCKX_ATOM_ABS_X);
+			valuator->mode = XIModeAbsolute;
+			valuator->min = axis ? device->range.top : device->range.left;
+			valuator->max = axis ? device->range.bottom : device->range.right;
+			valuator->resolution = axis ? device->vres : device->hres;
+		} else {
+			valuator->label = mockx_atom(axis ? MOCKX_ATOM_REL_Y : MOCKX_ATOM_REL_X);
+			valuator->mode = XIModeRelative;
+			valuator->min = valuator->max = -1;
+		}
+	}
+}
+
+XIDeviceInfo * XIQueryDevice(Display * display, int deviceid, int * ndevices_return) {
+	MockConnection * connection = mockx_connection(display);
+	int ids[MOCKX_MAX_DEVICES + 2], count = 0;
+
+	*ndevices_return = 0;
+	if (mockx_request(connection, MOCKX_XI_QUERY_DEVICE) ||
+		(deviceid != XIAllDevices && deviceid != XIAllMasterDevices && !mockx_device_exists(deviceid))) {
+		mockx_error(connection, MOCKX_XI_QUERY_DEVICE, MOCKX_XI_ERROR_BASE + XI_BadDevice, deviceid);
+		mockx_round_trip(connection);
+		mockx_after(connection);
+		return NULL;
+	}
+	mockx_round_trip(connection);
+
+	for (int id = MOCKX_MASTER_POINTER; id < MOCKX_MAX_DEVICE_ID; id++) {
+		const bool master = id == MOCKX_MASTER_POINTER || id == MOCKX_MASTER_KEYBOARD;
+		if (mockx_device_exists(id) && (deviceid == id || deviceid == XIAllDevices || (deviceid == XIAllMasterDevices && master))) {
+			ids[count++] = id;
+		}
+	}
+
+	// One block, as XIFreeDeviceInfo frees it with a single call
+	size_t infos_size = MOCKX_ALIGN((count + 1) * sizeof(XIDeviceInfo)), classes_size = 0, valuators_size = 0, names_size = 0;
+	for (int i = 0; i < count; i++) {
+		classes_size += mockx_device_classes(ids[i]) * sizeof(XIAnyClassInfo *);
+		valuators_size += mockx_device_classes(ids[i]) * sizeof(XIValuatorClassInfo);
+		names_size += strlen(mockx_device_name(ids[i])) + 1;
+	}
+	classes_size = MOCKX_ALIGN(classes_size);
+	valuators_size = MOCKX_ALIGN(valuators_size);
+
+	char * block = calloc(1, infos_size + classes_size + valuators_size + names_size);
+	if (!block) {
+		mockx_after(connection);
+		return NULL;
+	}
+
+	XIDeviceInfo * infos = (XIDeviceInfo *)block;
+	XIAnyClassInfo ** classes = (XIAnyClassInfo **)(block + infos_size);
+	XIValuatorClassInfo * valuators = (XIValuatorClassInfo *)(block + infos_size + classes_size);
+	char * names = block + infos_size + classes_size + valuators_size;
+
+	for (int i = 0; i < count; i++) {
+		mockx_fill_device_info(ids[i], infos + i, classes, valuators, names);
+		classes += infos[i].num_classes;
+		valuators += infos[i].num_classes;
+		names += strlen(names) + 1;
+	}
+
+	*ndevices_return = count;
+	mockx_after(connection);
+	return infos;
+}
+
+void XIFreeDeviceInfo(XIDeviceInfo * info) {
+	free(info);
+}
+
+int XISelectEvents(Display * display, Window window, XIEventMask * masks, int num_masks) {
+	MockConnection * connection = mockx_connection(display);
+
+	if (mockx_request(connection, MOCKX_XI_SELECT_EVENTS)) {
+		mockx_error(connection, MOCKX_XI_SELECT_EVENTS, BadValue, window);
+		mockx_after(connection);
+		return Success;
+	}
+
+	for (int i = 0; i < num_masks; i++) {
+		const int id = masks[i].deviceid;
+		if (id < 0 || id >= MOCKX_MAX_DEVICE_ID || (id > XIAllMasterDevices && !mockx_device_exists(id))) {
+			mockx_error(connection, MOCKX_XI_SELECT_EVENTS, MOCKX_XI_ERROR_BASE + XI_BadDevice, id);
+			continue;
+		}
+
+		// A selection replaces the previous one for the same device
+		unsigned char * selected = connection->xi_masks[id];
+		const size_t length = (size_t)masks[i].mask_len < sizeof(connection->xi_masks[id]) ? (size_t)masks[i].mask_len : sizeof(connection->xi_masks[id]);
+		memset(selected, 0, sizeof(connection->xi_masks[id]));
+		memcpy(selected, masks[i].mask, length);
+	}
+
+	mockx_after(connection);
+	return Success;
+}
+
+// Finds the property, returning its type and format and pointing data at its items
+static bool mockx_device_property(MockDevice * device, const Atom property, Atom * type, int * format, unsigned long * items, void ** data, int32_t * scratch) {
+	if (property == mockx_atom(MOCKX_ATOM_MATRIX)) {
+		*type = mockx_atom(MOCKX_ATOM_FLOAT);
+		*format = 32;
+		*items = 9;
+		*data = device->matrix;
+	} else if (property == mockx_atom(MOCKX_ATOM_PRODUCT) && (device->vendor || device->product)) {
+		*type = XA_INTEGER;
+		*format = 32;
+		*items = 2;
+		scratch[0] = device->vendor;
+		scratch[1] = device->product;
+		*data = scratch;
+	} else if (property == mockx_atom(MOCKX_ATOM_NODE) && device->node[0]) {
+		*type = XA_STRING;
+		*format = 8;
+		*items = strlen(device->node);
+		*data = device->node;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+Status XIGetProperty(Display * display, int deviceid, Atom property, long offset, long length, Bool delete_property,
+					 Atom type, Atom * type_return, int * format_return, unsigned long * num_items_return,
+					 unsigned long * bytes_after_return, unsigned char ** data) {
+	MockConnection * connection = mockx_connection(display);
+	MockDevice * device = mockx_device(deviceid);
+
+	*type_return = None;
+	*format_return = 0;
+	*num_items_return = *bytes_after_return = 0;
+	*data = NULL;
+
+	if (mockx_request(connection, MOCKX_XI_GET_PROPERTY) || !device) {
+		mockx_error(connection, MOCKX_XI_GET_PROPERTY, MOCKX_XI_ERROR_BASE + XI_BadDevice, deviceid);
+		mockx_round_trip(connection);
+		mockx_after(connection);
+		return BadRequest;
+	}
+	mockx_round_trip(connection);
+
+	int format;
+	unsigned long items;
+	void * values;
+	int32_t scratch[2];
+	Atom actual_type;
+	if (mockx_device_property(device, property, &actual_type, &format, &items, &values, scratch)) {
+		const unsigned long size = items * (format / 8);
+		const unsigned long start = offset * 4 < (long)size ? offset * 4 : size;
+		const unsigned long returned = type == AnyPropertyType || type == actual_type ?
+			(size - start < (unsigned long)length * 4 ? size - start : (unsigned long)length * 4) : 0;
+
+		*type_return = actual_type;
+		*format_return = format;
+		*num_items_return = returned / (format / 8);
+		*bytes_after_return = size - start - returned;
+		// XI2 returns 32 bit items packed, and strings with a terminator like XGetWindowProperty
+		if (returned && (*data = malloc(returned + 1))) {
+			memcpy(*data, (unsigned char *)values + start, returned);
+			(*data)[returned] = '\0';
+		}
+	}
+
+	mockx_after(connection);
+	return Success;
+}
+
+void XIChangeProperty(Display * display, int deviceid, Atom property, Atom type, int format, int mode, unsigned char * data, int num_items) {
+	MockConnection * connection = mockx_connection(display);
+	MockDevice * device = mockx_device(deviceid);
+
+	if (mockx_request(connection, MOCKX_XI_CHANGE_PROPERTY)) {
+		mockx_error(connection, MOCKX_XI_CHANGE_PROPERTY, BadImplementation, deviceid);
+	} else if (!device) {
+		mockx_error(connection, MOCKX_XI_CHANGE_PROPERTY, MOCKX_XI_ERROR_BASE + XI_BadDevice, deviceid);
+	} else if (device->fail_writes || property != mockx_atom(MOCKX_ATOM_MATRIX)) {
+		// The driver refuses the write, only the matrix is writable here
+		mockx_error(connection, MOCKX_XI_CHANGE_PROPERTY, BadAccess, deviceid);
+	} else if (type != mockx_atom(MOCKX_ATOM_FLOAT) || format != 32 || mode != PropModeReplace || num_items != 9) {
+		mockx_error(connection, MOCKX_XI_CHANGE_PROPERTY, BadMatch, deviceid);
+	} else {
+		memcpy(device->matrix, data, sizeof(device->matrix));
+		mockx_property_event(deviceid, property, XIPropertyModified);
+	}
+
+	mockx_after(connection);
+}
+
+Status XIGrabDevice(Display * display, int deviceid, Window grab_window, Time time, Cursor cursor, int grab_mode,
+					int paired_device_mode, Bool owner_events, XIEventMask * mask) {
+	MockConnection * connection = mockx_connection(display);
+	Status status = GrabSuccess;
+
+	if (mockx_request(connection, MOCKX_XI_GRAB_DEVICE)) {
+		status = AlreadyGrabbed;
+	} else if (!mockx_device_exists(deviceid)) {
+		mockx_error(connection, MOCKX_XI_GRAB_DEVICE, MOCKX_XI_ERROR_BASE + XI_BadDevice, deviceid);
+		status = BadRequest;
+	}
+
+	mockx_round_trip(connection);
+	mockx_after(connection);
+	return status;
+}
+
+Status XIUngrabDevice(Display * display, int deviceid, Time time) {
+	MockConnection * connection = mockx_connection(display);
+
+	if (mockx_request(connection, MOCKX_XI_UNGRAB_DEVICE) || !mockx_device_exists(deviceid)) {
+		mockx_error(connection, MOCKX_XI_UNGRAB_DEVICE, MOCKX_XI_ERROR_BASE + XI_BadDevice, deviceid);
+	}
+	mockx_after(connection);
+	return Success;
+}
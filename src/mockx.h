@@ -0,0 +1,94 @@
+#ifndef XRESTRICT_MOCKX_H_
+#define XRESTRICT_MOCKX_H_
+
+#include <stdbool.h>
+#include <X11/Xlib.h>
+
+#include "xrestrict.h"
+
+// An X server kept in memory. mockx.c defines every Xlib, XRandR and XInput2 function libxrestrict calls,
+// so linking it instead of the X libraries runs the unchanged code against monitors and devices a test
+// describes. There is one server per process, any number of XOpenDisplay connections may talk to it.
+// Nothing is thread safe.
+
+#define MOCKX_MAX_CRTCS   16
+#define MOCKX_MAX_DEVICES 32
+#define MOCKX_MAX_ATOMS   32
+
+// Every kind of request the server counts, and can be told to fail
+typedef enum MockRequest {
+	MOCKX_INTERN_ATOM,
+	MOCKX_QUERY_EXTENSION,
+	MOCKX_SYNC,
+	MOCKX_GRAB_SERVER,
+	MOCKX_UNGRAB_SERVER,
+	MOCKX_CURSOR,
+	MOCKX_RR_SELECT_INPUT,
+	MOCKX_RR_SCREEN_RESOURCES,
+	MOCKX_RR_CRTC_INFO,
+	MOCKX_RR_OUTPUT_INFO,
+	MOCKX_XI_QUERY_DEVICE,
+	MOCKX_XI_SELECT_EVENTS,
+	MOCKX_XI_GET_PROPERTY,
+	MOCKX_XI_CHANGE_PROPERTY,
+	MOCKX_XI_GRAB_DEVICE,
+	MOCKX_XI_UNGRAB_DEVICE,
+	MOCKX_REQUEST_TYPES
+} MockRequest;
+
+typedef struct MockStats {
+	unsigned long requests[MOCKX_REQUEST_TYPES];
+	unsigned long total_requests;
+	unsigned long round_trips;      // Requests a client waited on, XSync included
+	unsigned long errors;
+	unsigned long unhandled_errors; // Errors no handler was installed for, which would have ended a real client
+	unsigned long events;           // Events queued for clients
+	double        latency_ms;       // Round trips times the latency set by mockx_set_latency
+} MockStats;
+
+// How a device looks to XIQueryDevice and XIGetProperty
+typedef struct MockDeviceInfo {
+	const char * name;
+	Rectangle    range;           // Minimum and maximum of the absolute X and Y valuators
+	int          hres, vres;      // Valuator resolution in units per meter, 0 when unknown
+	int          vendor, product; // "Device Product ID", which the device lacks when both are 0
+	const char * node;            // "Device Node", may be NULL
+} MockDeviceInfo;
+
+#define EMOCKX_FULL        (-1)
+#define EMOCKX_NO_SUCH     (-2)
+#define EMOCKX_CONNECTED   (-4)
+
+// Forgets every monitor, device and statistic and gives the screen a new size. Fails with
+// EMOCKX_CONNECTED while any connection is open.
+int mockx_reset(const int width, const int height);
+
+// Returns the index of the new CRTC, which drives an output of its own called output
+int mockx_add_crtc(const Rectangle * region, const char * output, const int mm_width, const int mm_height);
+// Moves a CRTC, or turns it off when region is NULL, and tells clients which selected RRCrtcChangeNotifyMask
+int mockx_set_crtc(const int index, const Rectangle * region);
+// Tells clients which selected RRScreenChangeNotifyMask, whose DisplayWidth() changes once they call XRRUpdateConfiguration
+void mockx_set_screen_size(const int width, const int height);
+
+// Returns the id of the new slave pointer, which starts out with the identity matrix
+int mockx_add_device(const MockDeviceInfo * info);
+int mockx_remove_device(const int id);
+int mockx_device_matrix(const int id, float * matrix);
+// Changes a matrix the way another client would, with the XI_PropertyEvent that causes
+int mockx_device_write_matrix(const int id, const float * matrix);
+// Same as mockx_device_write_matrix, but only once the next request of a kind arrives from any client,
+// e.g. in the middle of a batch of writes to other devices
+int mockx_device_write_matrix_during(const MockRequest request, const int id, const float * matrix);
+// Makes every matrix write to the device fail with BadAccess until called again with false
+int mockx_device_fail_writes(const int id, const bool fail);
+
+// Lets skip requests of a kind through, then fails the next count of them
+void mockx_fail(const MockRequest request, const unsigned long skip, const unsigned long count);
+// Every round trip adds round_trip_ms to the statistics, and takes that long too when sleep is set
+void mockx_set_latency(const double round_trip_ms, const bool sleep);
+
+void mockx_get_stats(MockStats * stats);
+void mockx_reset_stats(void);
+const char * mockx_request_name(const MockRequest request);
+
+#endif /* XRESTRICT_MOCKX_H_ */
@@ -0,0 +1,311 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/extensions/XInput2.h>
+#include <X11/extensions/Xrandr.h>
+
+#include "monitor.h"
+
+static volatile sig_atomic_t monitor_stop = 0;
+
+static void monitor_signal_handler(int signal) {
+	monitor_stop = 1;
+}
+
+typedef struct MonitorDevice {
+	const DeviceState * state;
+	Rectangle           region;         // Where the target restricts the device to
+	float               matrix[9];      // The device's matrix as the server holds it
+	Point               last;
+	bool                position_known; // Both axes were reported since we started
+	MonitorStats        interval, total;
+} MonitorDevice;
+
+static double monitor_elapsed(const struct timespec * start, const struct timespec * end) {
+	return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static uint32_t monitor_now_ms(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000UL + now.tv_nsec / 1000000L;
+}
+
+// Event times are the server's milliseconds, which needn't come from our clock, e.g. on a remote display.
+// Appending nothing to a property of our own window makes the server send us its current time.
+static uint32_t monitor_server_offset(Display * display) {
+	XSetWindowAttributes attributes = { .event_mask = PropertyChangeMask };
+	Window window = XCreateWindow(display, DefaultRootWindow(display), 0, 0, 1, 1, 0, CopyFromParent,
+								  InputOnly, CopyFromParent, CWEventMask, &attributes);
+	Atom atom = XInternAtom(display, "_XRESTRICT_MONITOR", False);
+	XEvent event;
+
+	uint32_t before = monitor_now_ms();
+	XChangeProperty(display, window, atom, XA_INTEGER, 32, PropModeAppend, NULL, 0);
+	XWindowEvent(display, window, PropertyChangeMask, &event);
+	uint32_t after = monitor_now_ms();
+
+	XDestroyWindow(display, window);
+	// The server read its clock somewhere within the round trip
+	return before + (after - before) / 2 - (uint32_t)event.xproperty.time;
+}
+
+static void monitor_transform(const float * matrix, const PointerRegion * device, const Rectangle * screen, const Point * value, Point * result) {
+	// The server applies the matrix to valuators normalized to [0, 1], then scales to the screen
+	double x = (value->x - device->region.left) / RECT_WIDTH(device->region);
+	double y = (value->y - device->region.top) / RECT_HEIGHT(device->region);
+	double w = matrix[6] * x + matrix[7] * y + matrix[8];
+
+	result->x = (matrix[0] * x + matrix[1] * y + matrix[2]) / w * RECT_WIDTH(*screen) + screen->left;
+	result->y = (matrix[3] * x + matrix[4] * y + matrix[5]) / w * RECT_HEIGHT(*screen) + screen->top;
+}
+
+// The matrix is only single precision, so samples on an edge may land a fraction of a pixel past it
+static bool monitor_contains(const Rectangle * region, const double x, const double y) {
+	return region->left - 0.5 <= x && x <= region->right + 0.5 && region->top - 0.5 <= y && y <= region->bottom + 0.5;
+}
+
+static void monitor_handle_raw(MonitorDevice * device, const Rectangle * screen, const XIRawEvent * raw, const uint32_t now) {
+	MonitorStats * stats = &device->interval;
+	stats->raw_events++;
+
+	// Clocks which disagree by less than the offset's error would make early events look negative
+	int32_t latency = (int32_t)(now - (uint32_t)raw->time);
+	stats->latency[latency < 0 ? 0 : latency >= MONITOR_LATENCY_BUCKETS ? MONITOR_LATENCY_BUCKETS - 1 : latency]++;
+
+	const XIValuatorState * valuators = &raw->valuators;
+	Point value, position;
+	device->position_known |= xi2_read_points((const XIValuatorState * const *)&valuators, 1, &device->state->valuators, &device->last, &value) > 0;
+	if (!device->position_known) {
+		return;
+	}
+
+	monitor_transform(device->matrix, &device->state->region, screen, &value, &position);
+	if (!monitor_contains(&device->region, position.x, position.y)) {
+		stats->outside++;
+		return;
+	}
+
+	// Edges belong to the outermost columns and rows
+	int column = (position.x - device->region.left) * MONITOR_GRID / RECT_WIDTH(device->region);
+	int row = (position.y - device->region.top) * MONITOR_GRID / RECT_HEIGHT(device->region);
+	column = column < 0 ? 0 : column < MONITOR_GRID ? column : MONITOR_GRID - 1;
+	row = row < 0 ? 0 : row < MONITOR_GRID ? row : MONITOR_GRID - 1;
+	stats->cells[row * MONITOR_GRID + column]++;
+}
+
+static void monitor_drain_events(Display * display, const int xi_opcode, const Atom matrix_atom, const uint32_t offset, const Rectangle * screen, MonitorDevice * devices, const int count) {
+	XEvent event;
+	XGenericEventCookie * cookie = &event.xcookie;
+
+	while (XPending(display)) {
+		XNextEvent(display, &event);
+
+		if (cookie->type != GenericEvent || cookie->extension != xi_opcode || !XGetEventData(display, cookie)) {
+			continue;
+		}
+
+		// Every event type we select starts out like XIRawEvent
+		const XIRawEvent * raw = (XIRawEvent *)cookie->data;
+		MonitorDevice * device = NULL;
+		for (int i = 0; i < count && !device; i++) {
+			if (devices[i].state->id == (XID)raw->deviceid) {
+				device = devices + i;
+			}
+		}
+
+		if (!device) {
+			// Not one of ours
+		} else if (cookie->evtype == XI_RawMotion) {
+			monitor_handle_raw(device, screen, raw, monitor_now_ms() - offset);
+		} else if (cookie->evtype == XI_Motion) {
+			const XIDeviceEvent * motion = (XIDeviceEvent *)cookie->data;
+			device->interval.motion_events++;
+			if (!monitor_contains(&device->region, motion->root_x, motion->root_y)) {
+				device->interval.motion_outside++;
+			}
+		} else if (cookie->evtype == XI_PropertyEvent && ((XIPropertyEvent *)cookie->data)->property == matrix_atom) {
+			// Someone changed the matrix, samples from now on land where the new one puts them
+			xi2_device_get_matrix(display, device->state->id, device->matrix);
+		}
+		XFreeEventData(display, cookie);
+	}
+}
+
+static int monitor_latency_percentile(const MonitorStats * stats, const double fraction) {
+	unsigned long seen = 0;
+	for (int i = 0; i < MONITOR_LATENCY_BUCKETS; i++) {
+		seen += stats->latency[i];
+		if (seen && seen >= fraction * stats->raw_events) {
+			return i;
+		}
+	}
+	return MONITOR_LATENCY_BUCKETS - 1;
+}
+
+static void monitor_report(FILE * file, const MonitorDevice * device, const MonitorStats * stats, const double seconds, const bool final) {
+	unsigned long inside = 0;
+	for (int i = 0; i < MONITOR_GRID * MONITOR_GRID; i++) {
+		inside += stats->cells[i];
+	}
+
+	fprintf(file, "{\"device\": %lu, %s\"seconds\": %.3f, \"raw_per_sec\": %.1f, \"motion_per_sec\": %.1f, ",
+		device->state->id, final ? "\"total\": true, " : "", seconds,
+		seconds > 0 ? stats->raw_events / seconds : 0, seconds > 0 ? stats->motion_events / seconds : 0);
+
+	if (stats->raw_events) {
+		fprintf(file, "\"latency_ms\": {\"p50\": %d, \"p99\": %d, \"max\": %d}, ",
+			monitor_latency_percentile(stats, 0.5), monitor_latency_percentile(stats, 0.99), monitor_latency_percentile(stats, 1));
+	} else {
+		fprintf(file, "\"latency_ms\": null, ");
+	}
+
+	fprintf(file, "\"outside\": %.4f, \"motion_outside\": %.4f",
+		inside + stats->outside ? (double)stats->outside / (inside + stats->outside) : 0,
+		stats->motion_events ? (double)stats->motion_outside / stats->motion_events : 0);
+
+	if (final) {
+		fprintf(file, ", \"region\": [%d, %d, %d, %d], \"histogram\": [", device->region.left, device->region.top, device->region.right, device->region.bottom);
+		for (int row = 0; row < MONITOR_GRID; row++) {
+			fprintf(file, row ? ", [" : "[");
+			for (int column = 0; column < MONITOR_GRID; column++) {
+				fprintf(file, column ? ", %lu" : "%lu", stats->cells[row * MONITOR_GRID + column]);
+			}
+			fprintf(file, "]");
+		}
+		fprintf(file, "]");
+	}
+
+	fprintf(file, "}\n");
+}
+
+static void monitor_stats_add(MonitorStats * total, const MonitorStats * interval) {
+	total->raw_events += interval->raw_events;
+	total->motion_events += interval->motion_events;
+	total->outside += interval->outside;
+	total->motion_outside += interval->motion_outside;
+	for (int i = 0; i < MONITOR_LATENCY_BUCKETS; i++) {
+		total->latency[i] += interval->latency[i];
+	}
+	for (int i = 0; i < MONITOR_GRID * MONITOR_GRID; i++) {
+		total->cells[i] += interval->cells[i];
+	}
+}
+
+int monitor_run(Display * display, Topology * topology, const Target * targets, const DeviceState * states, const int count, FILE * file) {
+	int xi_opcode, xi_event_base, xi_error_base;
+	Atom atoms[2];
+
+	if (!XQueryExtension(display, "XInputExtension", &xi_opcode, &xi_event_base, &xi_error_base) || xi2_matrix_atoms(display, atoms)) {
+		return EMONITOR_NO_XINPUT;
+	}
+
+	MonitorDevice * devices = calloc(count ? count : 1, sizeof(*devices));
+	XIEventMask * masks = calloc(count ? count : 1, sizeof(*masks));
+	unsigned char mask_data[XIMaskLen(XI_RawMotion)] = {0};
+	int device_count = 0, result = 0;
+
+	if (!devices || !masks) {
+		result = EMONITOR_ALLOCATION;
+		goto done;
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (!states[i].valid) {
+			continue;
+		}
+
+		MonitorDevice * device = devices + device_count;
+		device->state = states + i;
+		result = target_find_region(display, topology, targets + i, &device->region);
+		if (result) {
+			goto done;
+		}
+
+		if (xi2_device_get_matrix(display, states[i].id, device->matrix)) {
+			memcpy(device->matrix, identity, sizeof(identity));
+		}
+
+		masks[device_count].deviceid = states[i].id;
+		masks[device_count].mask_len = sizeof(mask_data);
+		masks[device_count].mask = mask_data;
+		device_count++;
+	}
+
+	if (!device_count) {
+		result = EMONITOR_NO_DEVICES;
+		goto done;
+	}
+
+	// Raw events report every sample the device sends and always reach the root window. Transformed
+	// ones show where the server put the pointer, but only reach it when no window below takes them.
+	XISetMask(mask_data, XI_RawMotion);
+	XISetMask(mask_data, XI_Motion);
+	XISetMask(mask_data, XI_PropertyEvent);
+	XISelectEvents(display, DefaultRootWindow(display), masks, device_count);
+
+	const uint32_t offset = monitor_server_offset(display);
+
+	struct sigaction action, previous_int, previous_term;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = monitor_signal_handler;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, &previous_int);
+	sigaction(SIGTERM, &action, &previous_term);
+	// Deliver signals only inside the wait, otherwise one arriving mid report is not seen until the next interval
+	sigset_t blocked, unblocked;
+	sigemptyset(&blocked);
+	sigaddset(&blocked, SIGINT);
+	sigaddset(&blocked, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &blocked, &unblocked);
+
+	struct timespec start, last_report, now;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	last_report = start;
+
+	while (!monitor_stop) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		int remaining_ms = MONITOR_INTERVAL_MS - monitor_elapsed(&last_report, &now) * 1000;
+
+		if (remaining_ms > 0) {
+			int wait_result = xlib_wait_for_events(display, remaining_ms, &unblocked);
+			if (wait_result < 0 && errno != EINTR) {
+				result = EMONITOR_WAIT_FAILED;
+				break;
+			}
+			monitor_drain_events(display, xi_opcode, atoms[0], offset, &topology->screen_size.region, devices, device_count);
+			continue;
+		}
+
+		const double seconds = monitor_elapsed(&last_report, &now);
+		for (int i = 0; i < device_count; i++) {
+			monitor_report(file, devices + i, &devices[i].interval, seconds, false);
+			monitor_stats_add(&devices[i].total, &devices[i].interval);
+			memset(&devices[i].interval, 0, sizeof(devices[i].interval));
+		}
+		fflush(file);
+		last_report = now;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &unblocked, NULL);
+	sigaction(SIGINT, &previous_int, NULL);
+	sigaction(SIGTERM, &previous_term, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	for (int i = 0; i < device_count; i++) {
+		monitor_stats_add(&devices[i].total, &devices[i].interval);
+		monitor_report(file, devices + i, &devices[i].total, monitor_elapsed(&start, &now), true);
+	}
+	fflush(file);
+
+done:
+	free(devices);
+	free(masks);
+	return result;
+}
@@ -0,0 +1,33 @@
+#ifndef XRESTRICT_MONITOR_H_
+#define XRESTRICT_MONITOR_H_
+
+#include <stdio.h>
+#include <X11/Xlib.h>
+
+#include "apply.h"
+
+#define MONITOR_INTERVAL_MS 1000
+// Delivery latency is counted in 1 ms buckets, the last one holding everything slower
+#define MONITOR_LATENCY_BUCKETS 256
+// The target region is split into this many columns and rows for the coordinate histogram
+#define MONITOR_GRID 8
+
+typedef struct MonitorStats {
+	unsigned long raw_events;
+	unsigned long motion_events;  // Transformed events, which only reach the root window when no other window takes them
+	unsigned long outside;        // Raw events whose position under the device's matrix is outside the target region
+	unsigned long motion_outside; // The same for the positions of transformed events
+	unsigned long latency[MONITOR_LATENCY_BUCKETS]; // Of raw events
+	unsigned long cells[MONITOR_GRID * MONITOR_GRID]; // Raw events inside the target region, row by row
+} MonitorStats;
+
+#define EMONITOR_NO_XINPUT   (-1)
+#define EMONITOR_NO_DEVICES  (-2)
+#define EMONITOR_ALLOCATION  (-4)
+#define EMONITOR_WAIT_FAILED (-8)
+// Watches every valid device's events until interrupted, printing one JSON object per device every
+// MONITOR_INTERVAL_MS and a final one with the totals and the coordinate histogram. Leaves the matrices
+// alone. Returns ETARGET_* codes when a target's region can't be found.
+int monitor_run(Display * display, Topology * topology, const Target * targets, const DeviceState * states, const int count, FILE * file);
+
+#endif /* XRESTRICT_MONITOR_H_ */
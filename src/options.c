@@ -0,0 +1,275 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "options.h"
+
+const Target target_defaults = {
+	.device_id = INVALID_DEVICE_ID,
+	.selector = {
+		.identifier = {
+			.vendor = DEVICE_ANY,
+			.product = DEVICE_ANY
+		}
+	},
+	.crtc_index = 0,
+	.full_screen = false,
+	.one_to_one = false,
+	.config = {
+		.type = CTM_Fit,
+		.affinity = {
+			.vertical = VA_Top,
+			.horizontal = HA_Left
+		}
+	}
+};
+
+Target * target_list_append(TargetList * list, const Target * defaults) {
+	if (list->count >= list->capacity) {
+		int capacity = list->capacity ? list->capacity * 2 : 4;
+		Target * targets = realloc(list->targets, capacity * sizeof(*targets));
+		if (!targets) {
+			return NULL;
+		}
+		list->targets = targets;
+		list->capacity = capacity;
+	}
+
+	Target * target = list->targets + list->count++;
+	*target = *defaults;
+	return target;
+}
+
+int parse_target_option(int argc, char ** argv, int * index, Target * target) {
+	int i = *index;
+
+	if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--crtc") == 0) {
+		char * invalid;
+		if (++i >= argc) {
+			return OPTION_INVALID;
+		}
+
+		target->crtc_index = strtol(argv[i], &invalid, 10);
+		if (invalid && *invalid != '\0') {
+			fprintf(stderr, "Failed to parse crtc index \"%s\".\n", argv[i]);
+			return OPTION_INVALID;
+		}
+	} else if (strcmp(argv[i], "-O") == 0 || strcmp(argv[i], "--output") == 0) {
+		if (++i >= argc) {
+			return OPTION_INVALID;
+		}
+
+		if (strlen(argv[i]) >= MAX_OUTPUT_NAME) {
+			fprintf(stderr, "Output name \"%s\" is too long.\n", argv[i]);
+			return OPTION_INVALID;
+		}
+		strcpy(target->output, argv[i]);
+	} else if (strcmp(argv[i], "--vendor") == 0 || strcmp(argv[i], "--product") == 0) {
+		char * invalid;
+		if (++i >= argc) {
+			return OPTION_INVALID;
+		}
+
+		long value = strtol(argv[i], &invalid, 16);
+		if ((invalid && *invalid != '\0') || value < 0 || value > 0xffff) {
+			fprintf(stderr, "Failed to parse USB id \"%s\", expected 4 hex digits.\n", argv[i]);
+			return OPTION_INVALID;
+		}
+
+		if (argv[i - 1][2] == 'v') {
+			target->selector.identifier.vendor = value;
+		} else {
+			target->selector.identifier.product = value;
+		}
+	} else if (strcmp(argv[i], "--name-regex") == 0 || strcmp(argv[i], "--serial") == 0) {
+		if (++i >= argc) {
+			return OPTION_INVALID;
+		}
+
+		const bool name = argv[i - 1][2] == 'n';
+		char * field = name ? target->selector.name : target->selector.serial;
+		const size_t size = name ? MAX_SELECTOR_NAME : MAX_SELECTOR_SERIAL;
+		if (strlen(argv[i]) >= size || argv[i][0] == '\0') {
+			fprintf(stderr, "Selector \"%s\" must be between 1 and %d characters.\n", argv[i], (int)size - 1);
+			return OPTION_INVALID;
+		}
+		strcpy(field, argv[i]);
+	} else if (strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--full") == 0) {
+		target->full_screen = true;
+	} else if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--top") == 0) {
+		target->config.affinity.vertical = VA_Top;
+	} else if (strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "--bottom") == 0) {
+		target->config.affinity.vertical = VA_Bottom;
+	} else if (strcmp(argv[i], "-l") == 0 || strcmp(argv[i], "--left") == 0) {
+		target->config.affinity.horizontal = HA_Left;
+	} else if (strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--right") == 0) {
+		target->config.affinity.horizontal = HA_Right;
+	} else if (strcmp(argv[i], "-X") == 0 || strcmp(argv[i], "--horizontal") == 0) {
+		if (++i >= argc) {
+			return OPTION_INVALID;
+		}
+
+		if (strcmp(argv[i], "left") == 0) {
+			target->config.affinity.horizontal = HA_Left;
+		} else if (strcmp(argv[i], "center") == 0) {
+			target->config.affinity.horizontal = HA_Centered;
+		} else if (strcmp(argv[i], "right") == 0) {
+			target->config.affinity.horizontal = HA_Right;
+		} else {
+			fprintf(stderr, "Unknown horizontal alignment \"%s\".\n", argv[i]);
+			return OPTION_INVALID;
+		}
+	} else if (strcmp(argv[i], "-Y") == 0 || strcmp(argv[i], "--vertical") == 0) {
+		if (++i >= argc) {
+			return OPTION_INVALID;
+		}
+
+		if (strcmp(argv[i], "top") == 0) {
+			target->config.affinity.vertical = VA_Top;
+		} else if (strcmp(argv[i], "center") == 0) {
+			target->config.affinity.vertical = VA_Centered;
+		} else if (strcmp(argv[i], "bottom") == 0) {
+			target->config.affinity.vertical = VA_Bottom;
+		} else {
+			fprintf(stderr, "Unknown vertical alignment \"%s\".\n", argv[i]);
+			return OPTION_INVALID;
+		}
+	} else if (strcmp(argv[i], "--fit") == 0) {
+		target->config.type = CTM_Fit;
+	} else if (strcmp(argv[i], "-w") == 0 || strcmp(argv[i], "--match-width") == 0) {
+		target->config.type = CTM_MatchWidth;
+	} else if (strcmp(argv[i], "-H") == 0 || strcmp(argv[i], "--match-height") == 0) {
+		target->config.type = CTM_MatchHeight;
+	} else if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--one") == 0) {
+		target->one_to_one = true;
+		target->config.type = CTM_None;
+	} else {
+		return OPTION_UNKNOWN;
+	}
+
+	*index = i;
+	return OPTION_CONSUMED;
+}
+
+bool device_selector_set(const DeviceSelector * selector) {
+	return selector->identifier.vendor != DEVICE_ANY || selector->identifier.product != DEVICE_ANY ||
+		selector->name[0] != '\0' || selector->serial[0] != '\0';
+}
+
+int parse_device_id(const char * argument, int * device_id) {
+	char * invalid;
+	*device_id = strtol(argument, &invalid, 10);
+	if (invalid && *invalid != '\0') {
+		fprintf(stderr, "Failed to parse device id \"%s\".\n", argument);
+		return OPTION_INVALID;
+	}
+	return OPTION_CONSUMED;
+}
+
+// Returns the token at *cursor, removing its quotes in place, or NULL at the end of the line. Blanks
+// within single or double quotes are part of the token. Within double quotes, a backslash before " or
+// another backslash stands for that character.
+static char * spec_next_token(char ** cursor, bool * unterminated) {
+	static const char * blanks = " \t\r\n";
+	char * read = *cursor;
+	char quote = '\0';
+
+	while (*read && strchr(blanks, *read)) {
+		read++;
+	}
+	if (!*read) {
+		*cursor = read;
+		return NULL;
+	}
+
+	char * token = read, * write = read;
+	for (; *read; read++) {
+		if (quote && *read == quote) {
+			quote = '\0';
+		} else if (quote == '"' && *read == '\\' && (read[1] == '"' || read[1] == '\\')) {
+			*write++ = *++read;
+		} else if (quote) {
+			*write++ = *read;
+		} else if (*read == '\'' || *read == '"') {
+			quote = *read;
+		} else if (strchr(blanks, *read)) {
+			read++;
+			break;
+		} else {
+			*write++ = *read;
+		}
+	}
+
+	*write = '\0';
+	*cursor = read;
+	*unterminated = quote != '\0';
+	return token;
+}
+
+int parse_target_line(char * line, const int line_number, TargetList * list, const Target * defaults) {
+	char * tokens[MAX_SPEC_TOKENS];
+	int token_count = 0;
+	bool unterminated = false;
+
+	for (char * token = spec_next_token(&line, &unterminated); token; token = spec_next_token(&line, &unterminated)) {
+		// Comments may hold anything, including unbalanced quotes
+		if (token_count == 0 && token[0] == '#') {
+			return OPTION_CONSUMED;
+		}
+		if (unterminated) {
+			fprintf(stderr, "Unterminated quote on line %d.\n", line_number);
+			return OPTION_INVALID;
+		}
+		if (token_count >= MAX_SPEC_TOKENS) {
+			fprintf(stderr, "Too many options on line %d.\n", line_number);
+			return OPTION_INVALID;
+		}
+		tokens[token_count++] = token;
+	}
+
+	if (token_count == 0) {
+		return OPTION_CONSUMED;
+	}
+
+	Target * target = target_list_append(list, defaults);
+	if (!target) {
+		return OPTION_INVALID;
+	}
+
+	// Either "-d DEVICEID" or selectors pick the device
+	int first = 0;
+	if (token_count >= 2 && (strcmp(tokens[0], "-d") == 0 || strcmp(tokens[0], "--device") == 0)) {
+		if (parse_device_id(tokens[1], &target->device_id) != OPTION_CONSUMED) {
+			return OPTION_INVALID;
+		}
+		first = 2;
+	}
+
+	for (int i = first; i < token_count; i++) {
+		if (parse_target_option(token_count, tokens, &i, target) != OPTION_CONSUMED) {
+			fprintf(stderr, "Invalid option \"%s\" on line %d.\n", tokens[i], line_number);
+			return OPTION_INVALID;
+		}
+	}
+
+	if (target->device_id == INVALID_DEVICE_ID && !device_selector_set(&target->selector)) {
+		fprintf(stderr, "Line %d must begin with \"-d DEVICEID\" or select a device with --vendor, --product, --name-regex or --serial.\n", line_number);
+		return OPTION_INVALID;
+	}
+
+	return OPTION_CONSUMED;
+}
+
+int parse_target_spec(FILE * file, TargetList * list, const Target * defaults) {
+	char line[1024];
+	int line_number = 0;
+
+	while (fgets(line, sizeof(line), file)) {
+		if (parse_target_line(line, ++line_number, list, defaults) != OPTION_CONSUMED) {
+			return OPTION_INVALID;
+		}
+	}
+
+	return OPTION_CONSUMED;
+}
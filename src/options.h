@@ -0,0 +1,38 @@
+#ifndef XRESTRICT_OPTIONS_H_
+#define XRESTRICT_OPTIONS_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "apply.h"
+
+#define INVALID_DEVICE_ID -1
+
+#define OPTION_INVALID  (-1)
+#define OPTION_UNKNOWN  0
+#define OPTION_CONSUMED 1
+
+#define MAX_SPEC_TOKENS 64
+
+typedef struct TargetList {
+	Target * targets;
+	int count, capacity;
+} TargetList;
+
+// No device, CRTC 0, fit and aligned to the top left
+extern const Target target_defaults;
+
+Target * target_list_append(TargetList * list, const Target * defaults);
+
+// Options which describe how a single device is restricted
+int parse_target_option(int argc, char ** argv, int * index, Target * target);
+int parse_device_id(const char * argument, int * device_id);
+bool device_selector_set(const DeviceSelector * selector);
+// Parses one "-d DEVICEID [options]" or "SELECTORS [options]" line in place, blank lines and lines
+// starting with # are skipped. Arguments holding blanks are quoted as in a shell, e.g.
+// --name-regex "^Wacom .* Pen$", where double quotes take \" and \\ for " and \.
+int parse_target_line(char * line, const int line_number, TargetList * list, const Target * defaults);
+// Each line holds "-d DEVICEID [options]" or "SELECTORS [options]"
+int parse_target_spec(FILE * file, TargetList * list, const Target * defaults);
+
+#endif /* XRESTRICT_OPTIONS_H_ */
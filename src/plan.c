@@ -0,0 +1,350 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/XInput2.h>
+#include <X11/extensions/Xrandr.h>
+
+#include "plan.h"
+#include "trace.h"
+
+static const CTMAspectPreserveType plan_types[PLAN_TYPES] = {CTM_None, CTM_Fit, CTM_MatchWidth, CTM_MatchHeight};
+static const CTMHorizontalAffinity plan_horizontal[PLAN_ALIGNMENTS] = {HA_Left, HA_Right, HA_Centered};
+static const CTMVerticalAffinity plan_vertical[PLAN_ALIGNMENTS] = {VA_Top, VA_Bottom, VA_Centered};
+
+static size_t plan_cells(const PlanHeader * header) {
+	return (size_t)header->device_count * header->region_count * header->configuration_count;
+}
+
+static size_t plan_size(const PlanHeader * header) {
+	return sizeof(PlanHeader) + header->device_count * sizeof(PlanDevice) +
+		plan_cells(header) * (sizeof(float[9]) + 1);
+}
+
+// Points the plan's arrays into its data
+static void plan_layout(Plan * plan) {
+	char * data = plan->data;
+	plan->header = (const PlanHeader *)data;
+	plan->devices = (const PlanDevice *)(data + sizeof(PlanHeader));
+	plan->matrices = (float (*)[9])(data + sizeof(PlanHeader) + plan->header->device_count * sizeof(PlanDevice));
+	plan->valid = (unsigned char *)(plan->matrices + plan_cells(plan->header));
+}
+
+// One-to-one scaling always comes with CTM_None, so the type alone identifies it
+static int plan_configuration_index(const CTMConfiguration * config) {
+	int type = 0, horizontal = 0, vertical = 0;
+
+	while (type < PLAN_TYPES && plan_types[type] != config->type) {
+		type++;
+	}
+	while (horizontal < PLAN_ALIGNMENTS && plan_horizontal[horizontal] != config->affinity.horizontal) {
+		horizontal++;
+	}
+	while (vertical < PLAN_ALIGNMENTS && plan_vertical[vertical] != config->affinity.vertical) {
+		vertical++;
+	}
+
+	if (type == PLAN_TYPES || horizontal == PLAN_ALIGNMENTS || vertical == PLAN_ALIGNMENTS) {
+		return -1;
+	}
+	return (type * PLAN_ALIGNMENTS + horizontal) * PLAN_ALIGNMENTS + vertical;
+}
+
+// Fills every cell which scales to fit or match, running each configuration over all devices and regions
+// at once. Results are the same as target_compute_matrix's, see the batch functions in input.h.
+static int plan_compute_batch(const Topology * topology, const DeviceState * states, const int device_count, Plan * plan) {
+	const int region_count = plan->header->region_count;
+	const int count = device_count * region_count;
+	RectangleBatch crtcs = {0}, inputs = {0}, scaled = {0}, aligned = {0};
+	MatrixBatch matrices = {0};
+	int result = 0;
+
+	if (rectangle_batch_alloc(&crtcs, count) || rectangle_batch_alloc(&inputs, count) ||
+		rectangle_batch_alloc(&scaled, count) || rectangle_batch_alloc(&aligned, count) ||
+		matrix_batch_alloc(&matrices, count)) {
+		result = EPLAN_ALLOCATION_FAILED;
+		goto done;
+	}
+
+	// Pairs are ordered device, region, as cells are
+	for (int d = 0, pair = 0; d < device_count; d++) {
+		for (int r = 0; r < region_count; r++, pair++) {
+			rectangle_batch_set(&crtcs, pair, r < topology->region_count ? &topology->regions[r].region : &topology->screen_size.region);
+			rectangle_batch_set(&inputs, pair, &states[d].region.region);
+		}
+	}
+
+	// One-to-one scaling, which needs output sizes, is the first type and left to target_compute_matrix
+	for (int c = PLAN_ALIGNMENTS * PLAN_ALIGNMENTS; c < PLAN_CONFIGURATIONS; c++) {
+		const CTMAffinity affinity = {
+			.horizontal = plan_horizontal[(c / PLAN_ALIGNMENTS) % PLAN_ALIGNMENTS],
+			.vertical = plan_vertical[c % PLAN_ALIGNMENTS]
+		};
+
+		rectangle_scale_preserve_aspect_batch(&crtcs, &inputs, plan_types[c / (PLAN_ALIGNMENTS * PLAN_ALIGNMENTS)], &scaled);
+		rectangle_align_batch(&crtcs, &scaled, &affinity, &aligned);
+		calculate_coordinate_transform_matrix_batch(&aligned, &topology->screen_size.region, &matrices);
+
+		for (int pair = 0; pair < count; pair++) {
+			const size_t cell = (size_t)pair * PLAN_CONFIGURATIONS + c;
+			matrix_batch_get(&matrices, pair, plan->matrices[cell]);
+			plan->valid[cell] = 1;
+		}
+	}
+
+done:
+	rectangle_batch_free(&crtcs);
+	rectangle_batch_free(&inputs);
+	rectangle_batch_free(&scaled);
+	rectangle_batch_free(&aligned);
+	matrix_batch_free(&matrices);
+	return result;
+}
+
+int plan_build(Display * display, Topology * topology, const CacheKey * key, Plan * plan) {
+	memset(plan, 0, sizeof(*plan));
+
+	int info_count;
+	trace_begin("query_devices");
+	XIDeviceInfo * info = XIQueryDevice(display, XIAllDevices, &info_count);
+	trace_end();
+	if (!info) {
+		return EPLAN_DEVICE_QUERY;
+	}
+
+	DeviceState * states = calloc(info_count ? info_count : 1, sizeof(*states));
+	if (!states) {
+		XIFreeDeviceInfo(info);
+		return EPLAN_ALLOCATION_FAILED;
+	}
+
+	int device_count = 0;
+	for (int i = 0; i < info_count; i++) {
+		if (info[i].use != XIMasterPointer && info[i].use != XIMasterKeyboard &&
+			!device_state_from_info(display, info + i, states + device_count)) {
+			device_count++;
+		}
+	}
+	XIFreeDeviceInfo(info);
+
+	PlanHeader header = {
+		.magic = PLAN_MAGIC,
+		.version = PLAN_VERSION,
+		.key = *key,
+		.device_count = device_count,
+		.region_count = topology->region_count + 1,
+		.configuration_count = PLAN_CONFIGURATIONS
+	};
+
+	plan->size = plan_size(&header);
+	plan->data = calloc(1, plan->size);
+	if (!plan->data) {
+		free(states);
+		return EPLAN_ALLOCATION_FAILED;
+	}
+	memcpy(plan->data, &header, sizeof(header));
+	plan_layout(plan);
+
+	PlanDevice * devices = (PlanDevice *)plan->devices;
+	for (int i = 0; i < device_count; i++) {
+		devices[i].id = states[i].id;
+		memcpy(devices[i].name, states[i].name, MAX_DEVICE_NAME);
+	}
+
+	trace_begin("compute_matrices");
+	if (plan_compute_batch(topology, states, device_count, plan)) {
+		trace_end();
+		free(states);
+		plan_free(plan);
+		return EPLAN_ALLOCATION_FAILED;
+	}
+
+	// Only needed for one-to-one when the topology query didn't fill in monitor sizes
+	XRRScreenResources * resources = XRRGetScreenResourcesCurrent(display, DefaultRootWindow(display));
+
+	size_t cell = 0;
+	for (int d = 0; d < device_count; d++) {
+		for (int r = 0; r < header.region_count; r++) {
+			for (int c = 0; c < PLAN_CONFIGURATIONS; c++, cell++) {
+				const int type = c / (PLAN_ALIGNMENTS * PLAN_ALIGNMENTS);
+				if (plan_types[type] != CTM_None) {
+					continue;
+				}
+
+				Target target = {
+					.device_id = states[d].id,
+					.crtc_index = r < topology->region_count ? r : 0,
+					.full_screen = r == topology->region_count,
+					.one_to_one = plan_types[type] == CTM_None,
+					.config = {
+						.type = plan_types[type],
+						.affinity = {
+							.horizontal = plan_horizontal[(c / PLAN_ALIGNMENTS) % PLAN_ALIGNMENTS],
+							.vertical = plan_vertical[c % PLAN_ALIGNMENTS]
+						}
+					}
+				};
+
+				plan->valid[cell] = !target_compute_matrix(display, resources, topology, &target, states + d, plan->matrices[cell]);
+			}
+		}
+	}
+
+	if (resources) {
+		XRRFreeScreenResources(resources);
+	}
+	trace_end();
+
+	free(states);
+	return 0;
+}
+
+int plan_path(Display * display, char * path, const size_t path_size) {
+	int result = cache_path(display, path, path_size);
+	if (result) {
+		return result;
+	}
+
+	size_t length = strlen(path);
+	if (length + sizeof(".plan") > path_size) {
+		return ECACHE_PATH;
+	}
+	memcpy(path + length, ".plan", sizeof(".plan"));
+	return 0;
+}
+
+int plan_store(const char * path, const Plan * plan) {
+	char temporary[4096];
+	int length = snprintf(temporary, sizeof(temporary), "%s.%ld", path, (long)getpid());
+	if (length < 0 || (size_t)length >= sizeof(temporary)) {
+		return EPLAN_WRITE;
+	}
+
+	FILE * file = fopen(temporary, "wb");
+	if (!file) {
+		return EPLAN_WRITE;
+	}
+
+	bool written = fwrite(plan->data, plan->size, 1, file) == 1;
+	if (fclose(file) || !written || rename(temporary, path)) {
+		unlink(temporary);
+		return EPLAN_WRITE;
+	}
+	return 0;
+}
+
+int plan_load(const char * path, const CacheKey * key, Plan * plan) {
+	memset(plan, 0, sizeof(*plan));
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return EPLAN_MISS;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) || (size_t)info.st_size < sizeof(PlanHeader)) {
+		close(fd);
+		return EPLAN_INVALID;
+	}
+
+	void * data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return EPLAN_INVALID;
+	}
+
+	const PlanHeader * header = data;
+	int result = 0;
+	if (header->magic != PLAN_MAGIC || header->version != PLAN_VERSION ||
+		header->device_count < 0 || header->region_count < 1 ||
+		header->configuration_count != PLAN_CONFIGURATIONS ||
+		(size_t)info.st_size != plan_size(header)) {
+		result = EPLAN_INVALID;
+	} else if (memcmp(&header->key, key, sizeof(*key)) != 0) {
+		result = EPLAN_MISS;
+	}
+
+	if (result) {
+		munmap(data, info.st_size);
+		return result;
+	}
+
+	plan->data = data;
+	plan->size = info.st_size;
+	plan->mapped = true;
+	plan_layout(plan);
+	return 0;
+}
+
+void plan_free(Plan * plan) {
+	if (plan->mapped) {
+		munmap(plan->data, plan->size);
+	} else {
+		free(plan->data);
+	}
+	memset(plan, 0, sizeof(*plan));
+}
+
+const float * plan_lookup(const Plan * plan, const Target * target) {
+	if (!plan->data) {
+		return NULL;
+	}
+
+	const PlanHeader * header = plan->header;
+	int device = 0;
+	while (device < header->device_count && plan->devices[device].id != (uint32_t)target->device_id) {
+		device++;
+	}
+
+	// "-o --fit" keeps one-to-one input with another type, which the plan doesn't cover
+	int configuration = target->one_to_one == (target->config.type == CTM_None) ? plan_configuration_index(&target->config) : -1;
+
+	// Out of range CRTCs and outputs are left to the regular path, which reports or resolves them
+	if (device == header->device_count || configuration < 0 || target->output[0] ||
+		target->crtc_index < 0 || target->crtc_index >= header->region_count - 1) {
+		return NULL;
+	}
+
+	int region = target->full_screen ? header->region_count - 1 : target->crtc_index;
+
+	size_t cell = ((size_t)device * header->region_count + region) * header->configuration_count + configuration;
+	return plan->valid[cell] ? plan->matrices[cell] : NULL;
+}
+
+int plan_check_devices(Display * display, const Plan * plan, const Target * targets, const int count) {
+	int info_count = 0;
+	XIDeviceInfo * infos = XIQueryDevice(display, XIAllDevices, &info_count);
+	int result = 0;
+
+	if (!infos) {
+		return EPLAN_DEVICE_QUERY;
+	}
+
+	for (int i = 0; i < count && !result; i++) {
+		const PlanDevice * device = NULL;
+		for (int d = 0; d < plan->header->device_count && !device; d++) {
+			if (plan->devices[d].id == (uint32_t)targets[i].device_id) {
+				device = plan->devices + d;
+			}
+		}
+
+		const XIDeviceInfo * info = NULL;
+		for (int d = 0; d < info_count && !info; d++) {
+			if (infos[d].deviceid == targets[i].device_id) {
+				info = infos + d;
+			}
+		}
+
+		// Names are stored truncated like DeviceState's
+		if (!device || !info || strncmp(device->name, info->name, MAX_DEVICE_NAME - 1) != 0) {
+			result = EPLAN_MISS;
+		}
+	}
+
+	XIFreeDeviceInfo(infos);
+	return result;
+}
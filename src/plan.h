@@ -0,0 +1,66 @@
+#ifndef XRESTRICT_PLAN_H_
+#define XRESTRICT_PLAN_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <X11/Xlib.h>
+
+#include "apply.h"
+#include "cache.h"
+
+#define PLAN_MAGIC   0x31505258 // "XRP1"
+#define PLAN_VERSION 1
+
+// Every scaling type crossed with every horizontal and vertical alignment,
+// CTM_None stands for one-to-one scaling since that is the only way to select it
+#define PLAN_TYPES      4
+#define PLAN_ALIGNMENTS 3
+#define PLAN_CONFIGURATIONS (PLAN_TYPES * PLAN_ALIGNMENTS * PLAN_ALIGNMENTS)
+
+typedef struct PlanDevice {
+	uint32_t id;
+	char     name[MAX_DEVICE_NAME];
+} PlanDevice;
+
+// On disk the header is followed by device_count PlanDevices, then one matrix and
+// then one valid byte per cell. Cells are ordered device, region, configuration,
+// and region region_count - 1 is the full screen.
+typedef struct PlanHeader {
+	uint32_t magic;
+	uint32_t version;
+	CacheKey key;
+	int32_t  device_count;
+	int32_t  region_count;
+	int32_t  configuration_count;
+	int32_t  padding;
+} PlanHeader;
+
+typedef struct Plan {
+	const PlanHeader * header;
+	const PlanDevice * devices;
+	float            (*matrices)[9];
+	unsigned char *    valid;
+	void *             data; // The whole plan, malloc'ed or mapped
+	size_t             size;
+	bool               mapped;
+} Plan;
+
+#define EPLAN_ALLOCATION_FAILED (-1)
+#define EPLAN_DEVICE_QUERY      (-2)
+#define EPLAN_MISS              (-4)
+#define EPLAN_INVALID           (-8)
+#define EPLAN_WRITE             (-16)
+// Computes the matrix of every absolute pointer on every CRTC and the full screen, in every configuration
+int plan_build(Display * display, Topology * topology, const CacheKey * key, Plan * plan);
+int plan_path(Display * display, char * path, const size_t path_size);
+int plan_store(const char * path, const Plan * plan);
+int plan_load(const char * path, const CacheKey * key, Plan * plan);
+void plan_free(Plan * plan);
+
+// Returns NULL when the plan doesn't cover the target or its matrix couldn't be computed
+const float * plan_lookup(const Plan * plan, const Target * target);
+// Device ids are reused after a replug, so before trusting plan_lookup every target's device must still
+// have the name it had when the plan was made. Returns EPLAN_MISS when one doesn't, with a single request.
+int plan_check_devices(Display * display, const Plan * plan, const Target * targets, const int count);
+
+#endif /* XRESTRICT_PLAN_H_ */
@@ -0,0 +1,300 @@
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "profile.h"
+#include "cache.h"
+#include "trace.h"
+
+int profile_source_path(char * path, const size_t path_size) {
+	const char * config_home = getenv("XDG_CONFIG_HOME");
+	const char * home = getenv("HOME");
+	int length;
+
+	if (config_home && *config_home) {
+		length = snprintf(path, path_size, "%s/xrestrict/profiles", config_home);
+	} else if (home && *home) {
+		length = snprintf(path, path_size, "%s/.config/xrestrict/profiles", home);
+	} else {
+		return EPROFILE_PATH;
+	}
+
+	if (length < 0 || (size_t)length >= path_size) {
+		return EPROFILE_PATH;
+	}
+	return 0;
+}
+
+int profile_binary_path(char * path, const size_t path_size) {
+	int length = cache_directory(path, path_size);
+	if (length < 0) {
+		return EPROFILE_PATH;
+	}
+
+	int written = snprintf(path + length, path_size - length, "/profiles");
+	if (written < 0 || (size_t)written >= path_size - length) {
+		return EPROFILE_PATH;
+	}
+	return 0;
+}
+
+static void profile_header_source(ProfileHeader * header, const struct stat * source) {
+	header->source_inode = source->st_ino;
+	header->source_size = source->st_size;
+	header->source_mtime_sec = source->st_mtim.tv_sec;
+	header->source_mtime_nsec = source->st_mtim.tv_nsec;
+}
+
+static size_t profile_size(const ProfileHeader * header) {
+	return sizeof(ProfileHeader) + (size_t)header->profile_count * sizeof(ProfileEntry) +
+		(size_t)header->target_count * sizeof(ProfileTarget);
+}
+
+// Finds name in compiled profiles, which have already been validated
+static int profile_find(const void * data, const char * name, TargetList * list) {
+	const ProfileHeader * header = data;
+	const ProfileEntry * entries = (const ProfileEntry *)(header + 1);
+	const ProfileTarget * targets = (const ProfileTarget *)(entries + header->profile_count);
+
+	for (int i = 0; i < header->profile_count; i++) {
+		if (strncmp(entries[i].name, name, MAX_PROFILE_NAME) != 0) {
+			continue;
+		}
+
+		for (int j = 0; j < entries[i].target_count; j++) {
+			const ProfileTarget * compiled = targets + entries[i].first_target + j;
+			Target * target = target_list_append(list, &target_defaults);
+			if (!target) {
+				return EPROFILE_ALLOCATION_FAILED;
+			}
+
+			target->device_id = compiled->device_id;
+			target->selector.identifier.vendor = compiled->vendor;
+			target->selector.identifier.product = compiled->product;
+			memcpy(target->selector.name, compiled->name, MAX_SELECTOR_NAME);
+			target->selector.name[MAX_SELECTOR_NAME - 1] = '\0';
+			memcpy(target->selector.serial, compiled->serial, MAX_SELECTOR_SERIAL);
+			target->selector.serial[MAX_SELECTOR_SERIAL - 1] = '\0';
+			target->crtc_index = compiled->crtc_index;
+			memcpy(target->output, compiled->output, MAX_OUTPUT_NAME);
+			target->output[MAX_OUTPUT_NAME - 1] = '\0';
+			target->full_screen = compiled->flags & PROFILE_TARGET_FULL_SCREEN;
+			target->one_to_one = compiled->flags & PROFILE_TARGET_ONE_TO_ONE;
+			target->config.type = compiled->type;
+			target->config.affinity.horizontal = compiled->horizontal;
+			target->config.affinity.vertical = compiled->vertical;
+		}
+		return 0;
+	}
+
+	return EPROFILE_NOT_FOUND;
+}
+
+// Maps binary if it was compiled from source as it is now
+static void * profile_map(const char * binary, const struct stat * source, size_t * size) {
+	int fd = open(binary, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) || (size_t)info.st_size < sizeof(ProfileHeader)) {
+		close(fd);
+		return NULL;
+	}
+
+	void * data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return NULL;
+	}
+
+	ProfileHeader expected;
+	profile_header_source(&expected, source);
+
+	const ProfileHeader * header = data;
+	if (header->magic != PROFILE_MAGIC || header->version != PROFILE_VERSION ||
+		header->profile_count < 0 || header->target_count < 0 ||
+		(size_t)info.st_size != profile_size(header) ||
+		header->source_inode != expected.source_inode || header->source_size != expected.source_size ||
+		header->source_mtime_sec != expected.source_mtime_sec || header->source_mtime_nsec != expected.source_mtime_nsec) {
+		munmap(data, info.st_size);
+		return NULL;
+	}
+
+	*size = info.st_size;
+	return data;
+}
+
+static ProfileEntry * profile_entry_append(ProfileEntry ** entries, int * count, int * capacity) {
+	if (*count >= *capacity) {
+		int new_capacity = *capacity ? *capacity * 2 : 4;
+		ProfileEntry * new_entries = realloc(*entries, new_capacity * sizeof(**entries));
+		if (!new_entries) {
+			return NULL;
+		}
+		*entries = new_entries;
+		*capacity = new_capacity;
+	}
+
+	ProfileEntry * entry = *entries + (*count)++;
+	memset(entry, 0, sizeof(*entry));
+	return entry;
+}
+
+// "[name]" starts a profile, every other line is "-d DEVICEID [options]" or "SELECTORS [options]" as with --stdin
+static int profile_parse(FILE * file, ProfileEntry ** entries, int * entry_count, TargetList * list) {
+	char line[1024];
+	int line_number = 0, entry_capacity = 0;
+	ProfileEntry * current = NULL;
+
+	while (fgets(line, sizeof(line), file)) {
+		line_number++;
+
+		char * start = line + strspn(line, " \t");
+		if (*start == '[') {
+			char * end = strchr(start, ']');
+			if (!end || end == start + 1 || end - start - 1 >= MAX_PROFILE_NAME) {
+				fprintf(stderr, "Invalid profile name on line %d.\n", line_number);
+				return EPROFILE_PARSE;
+			}
+
+			current = profile_entry_append(entries, entry_count, &entry_capacity);
+			if (!current) {
+				return EPROFILE_ALLOCATION_FAILED;
+			}
+			memcpy(current->name, start + 1, end - start - 1);
+			current->first_target = list->count;
+			continue;
+		}
+
+		const int target_count = list->count;
+		if (parse_target_line(line, line_number, list, &target_defaults) != OPTION_CONSUMED) {
+			return EPROFILE_PARSE;
+		}
+
+		if (list->count != target_count) {
+			if (!current) {
+				fprintf(stderr, "Line %d comes before the first \"[profile]\".\n", line_number);
+				return EPROFILE_PARSE;
+			}
+			current->target_count++;
+		}
+	}
+
+	return 0;
+}
+
+static void * profile_compile(FILE * file, const struct stat * source, size_t * size) {
+	ProfileEntry * entries = NULL;
+	int entry_count = 0;
+	TargetList list = {0};
+	void * data = NULL;
+
+	int result = profile_parse(file, &entries, &entry_count, &list);
+	if (result) {
+		goto done;
+	}
+
+	ProfileHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = PROFILE_MAGIC;
+	header.version = PROFILE_VERSION;
+	header.profile_count = entry_count;
+	header.target_count = list.count;
+	profile_header_source(&header, source);
+
+	*size = profile_size(&header);
+	data = calloc(1, *size);
+	if (!data) {
+		goto done;
+	}
+
+	memcpy(data, &header, sizeof(header));
+	memcpy((char *)data + sizeof(header), entries, entry_count * sizeof(*entries));
+
+	ProfileTarget * targets = (ProfileTarget *)((char *)data + sizeof(header) + entry_count * sizeof(*entries));
+	for (int i = 0; i < list.count; i++) {
+		const Target * target = list.targets + i;
+		targets[i].device_id = target->device_id;
+		targets[i].vendor = target->selector.identifier.vendor;
+		targets[i].product = target->selector.identifier.product;
+		memcpy(targets[i].name, target->selector.name, MAX_SELECTOR_NAME);
+		memcpy(targets[i].serial, target->selector.serial, MAX_SELECTOR_SERIAL);
+		targets[i].crtc_index = target->crtc_index;
+		memcpy(targets[i].output, target->output, MAX_OUTPUT_NAME);
+		targets[i].type = target->config.type;
+		targets[i].horizontal = target->config.affinity.horizontal;
+		targets[i].vertical = target->config.affinity.vertical;
+		targets[i].flags = (target->full_screen ? PROFILE_TARGET_FULL_SCREEN : 0) |
+			(target->one_to_one ? PROFILE_TARGET_ONE_TO_ONE : 0);
+	}
+
+done:
+	free(entries);
+	free(list.targets);
+	return data;
+}
+
+static void profile_store(const char * binary, const void * data, const size_t size) {
+	char temporary[4096];
+	int length = snprintf(temporary, sizeof(temporary), "%s.%ld", binary, (long)getpid());
+	if (length < 0 || (size_t)length >= sizeof(temporary)) {
+		return;
+	}
+
+	FILE * file = fopen(temporary, "wb");
+	if (!file) {
+		return;
+	}
+
+	bool written = fwrite(data, size, 1, file) == 1;
+	if (fclose(file) || !written || rename(temporary, binary)) {
+		unlink(temporary);
+	}
+}
+
+int profile_load(const char * source, const char * binary, const char * name, TargetList * list) {
+	FILE * file = fopen(source, "r");
+	struct stat info;
+
+	if (!file || fstat(fileno(file), &info)) {
+		if (file) {
+			fclose(file);
+		}
+		return EPROFILE_NO_SOURCE;
+	}
+
+	size_t size;
+	trace_begin("profile_map");
+	void * data = profile_map(binary, &info, &size);
+	trace_end();
+
+	if (data) {
+		fclose(file);
+		int result = profile_find(data, name, list);
+		munmap(data, size);
+		return result;
+	}
+
+	trace_begin("profile_compile");
+	data = profile_compile(file, &info, &size);
+	fclose(file);
+	if (data) {
+		profile_store(binary, data, size);
+	}
+	trace_end();
+
+	if (!data) {
+		return EPROFILE_PARSE;
+	}
+
+	int result = profile_find(data, name, list);
+	free(data);
+	return result;
+}
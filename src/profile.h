@@ -0,0 +1,65 @@
+#ifndef XRESTRICT_PROFILE_H_
+#define XRESTRICT_PROFILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "apply.h"
+#include "options.h"
+
+#define PROFILE_MAGIC   0x31465258 // "XRF1"
+#define PROFILE_VERSION 2
+
+#define MAX_PROFILE_NAME 32
+
+#define PROFILE_TARGET_FULL_SCREEN 1
+#define PROFILE_TARGET_ONE_TO_ONE  2
+
+// A Target with fixed size fields
+typedef struct ProfileTarget {
+	int32_t device_id;
+	int32_t vendor;
+	int32_t product;
+	char    name[MAX_SELECTOR_NAME];
+	char    serial[MAX_SELECTOR_SERIAL];
+	int32_t crtc_index;
+	char    output[MAX_OUTPUT_NAME];
+	uint8_t type;       // CTMAspectPreserveType
+	uint8_t horizontal; // CTMHorizontalAffinity
+	uint8_t vertical;   // CTMVerticalAffinity
+	uint8_t flags;
+} ProfileTarget;
+
+typedef struct ProfileEntry {
+	char    name[MAX_PROFILE_NAME];
+	int32_t first_target;
+	int32_t target_count;
+} ProfileEntry;
+
+// On disk the header is followed by profile_count ProfileEntries and then target_count ProfileTargets.
+// The compiled file is only used while the profile file it was compiled from is unchanged.
+typedef struct ProfileHeader {
+	uint32_t magic;
+	uint32_t version;
+	int64_t  source_inode;
+	int64_t  source_size;
+	int64_t  source_mtime_sec;
+	int64_t  source_mtime_nsec;
+	int32_t  profile_count;
+	int32_t  target_count;
+} ProfileHeader;
+
+#define EPROFILE_PATH              (-1)
+#define EPROFILE_NO_SOURCE         (-2)
+#define EPROFILE_PARSE             (-4)
+#define EPROFILE_NOT_FOUND         (-8)
+#define EPROFILE_ALLOCATION_FAILED (-16)
+// $XDG_CONFIG_HOME/xrestrict/profiles, or ~/.config/xrestrict/profiles
+int profile_source_path(char * path, const size_t path_size);
+// Next to the layout cache
+int profile_binary_path(char * path, const size_t path_size);
+// Appends the targets of the profile called name to list, compiling source to binary first when
+// binary is missing or stale. Failing to save the compiled profiles isn't an error.
+int profile_load(const char * source, const char * binary, const char * name, TargetList * list);
+
+#endif /* XRESTRICT_PROFILE_H_ */
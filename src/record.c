@@ -0,0 +1,322 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/XInput2.h>
+#include <X11/extensions/Xrandr.h>
+
+#include "record.h"
+
+#define RECORD_BATCH 256
+
+static volatile sig_atomic_t record_stop = 0;
+
+static void record_signal_handler(int signal) {
+	record_stop = 1;
+}
+
+// Replays have no server to ask, so one-to-one scaling needs every monitor's size up front
+static void record_fill_density(Display * display, Topology * topology) {
+	XRRScreenResources * resources = NULL;
+
+	for (int i = 0; i < topology->region_count; i++) {
+		if (topology->regions[i].width > 0 && topology->regions[i].height > 0) {
+			continue;
+		}
+		if (!resources) {
+			resources = XRRGetScreenResourcesCurrent(display, DefaultRootWindow(display));
+			if (!resources) {
+				return;
+			}
+		}
+		xlib_get_crtc_output_density(display, resources, topology->regions + i);
+	}
+
+	if (resources) {
+		XRRFreeScreenResources(resources);
+	}
+}
+
+static void record_select_events(Display * display, const XID id) {
+	unsigned char mask_data[XIMaskLen(XI_RawMotion)] = {0};
+	XIEventMask mask = {
+		.deviceid = id,
+		.mask_len = sizeof(mask_data),
+		.mask = mask_data
+	};
+	XISetMask(mask_data, XI_RawButtonPress);
+	XISetMask(mask_data, XI_RawButtonRelease);
+	XISetMask(mask_data, XI_RawMotion);
+	XISelectEvents(display, DefaultRootWindow(display), &mask, 1);
+	XFlush(display);
+}
+
+// Decodes every queued event into samples, returns how many were added
+static int record_drain_events(Display * display, const int xi_opcode, const DeviceState * state, Point * last, RecordSample * samples, int * sample_count, FILE * file) {
+	XEvent event;
+	XGenericEventCookie * cookie = &event.xcookie;
+	int added = 0;
+
+	while (XPending(display)) {
+		XNextEvent(display, &event);
+
+		if (cookie->type != GenericEvent || cookie->extension != xi_opcode || !XGetEventData(display, cookie)) {
+			continue;
+		}
+
+		const XIRawEvent * raw = (XIRawEvent *)cookie->data;
+		const XIValuatorState * valuators = &raw->valuators;
+		Point point;
+
+		if (raw->deviceid == (int)state->id) {
+			xi2_read_points((const XIValuatorState * const *)&valuators, 1, &state->valuators, last, &point);
+
+			RecordSample * sample = samples + (*sample_count)++;
+			sample->time = raw->time;
+			sample->device_id = raw->deviceid;
+			sample->flags = cookie->evtype == XI_RawButtonPress ? RECORD_SAMPLE_PRESS :
+				cookie->evtype == XI_RawButtonRelease ? RECORD_SAMPLE_RELEASE : 0;
+			sample->x = point.x;
+			sample->y = point.y;
+			added++;
+
+			if (*sample_count == RECORD_BATCH) {
+				fwrite(samples, sizeof(*samples), *sample_count, file);
+				*sample_count = 0;
+			}
+		}
+		XFreeEventData(display, cookie);
+	}
+
+	return added;
+}
+
+int record_run(Display * display, Topology * topology, const DeviceState * state, const char * path) {
+	int xi_opcode, xi_event_base, xi_error_base;
+
+	if (!XQueryExtension(display, "XInputExtension", &xi_opcode, &xi_event_base, &xi_error_base)) {
+		return ERECORD_NO_XINPUT;
+	}
+
+	RecordHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = RECORD_MAGIC;
+	header.version = RECORD_VERSION;
+	header.region_size = sizeof(CRTCRegion);
+	header.sample_size = sizeof(RecordSample);
+	header.region_count = topology->region_count;
+	header.device_id = state->id;
+	memcpy(header.device_name, state->name, sizeof(header.device_name));
+	header.device_region = state->region;
+	header.screen_size = topology->screen_size.region;
+
+	if (xi2_device_get_matrix(display, state->id, header.matrix)) {
+		return ERECORD_NO_MATRIX;
+	}
+
+	record_fill_density(display, topology);
+
+	FILE * file = fopen(path, "wb");
+	if (!file) {
+		return ERECORD_OPEN;
+	}
+
+	if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+		fwrite(topology->regions, sizeof(CRTCRegion), topology->region_count, file) != (size_t)topology->region_count ||
+		fflush(file)) {
+		fclose(file);
+		return ERECORD_WRITE;
+	}
+
+	record_select_events(display, state->id);
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = record_signal_handler;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	// Only let stop requests in while waiting, so none arrives after record_stop was checked
+	sigset_t blocked, unblocked;
+	sigemptyset(&blocked);
+	sigaddset(&blocked, SIGINT);
+	sigaddset(&blocked, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &blocked, &unblocked);
+
+	RecordSample samples[RECORD_BATCH];
+	int sample_count = 0;
+	unsigned long total = 0;
+	Point last = {0, 0};
+	int result = 0;
+
+	printf("Recording device %lu to %s, press Ctrl+C to stop.\n", state->id, path);
+	fflush(stdout);
+
+	while (!record_stop) {
+		int wait_result = xlib_wait_for_events(display, -1, &unblocked);
+		if (wait_result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			result = ERECORD_WRITE;
+			break;
+		}
+
+		total += record_drain_events(display, xi_opcode, state, &last, samples, &sample_count, file);
+
+		// Keep the file current so a killed recording only loses the last batch of events
+		fwrite(samples, sizeof(*samples), sample_count, file);
+		sample_count = 0;
+		if (fflush(file)) {
+			result = ERECORD_WRITE;
+			break;
+		}
+	}
+	pthread_sigmask(SIG_SETMASK, &unblocked, NULL);
+
+	if (fclose(file) && !result) {
+		result = ERECORD_WRITE;
+	}
+
+	printf("Recorded %lu samples.\n", total);
+	return result;
+}
+
+static void replay_transform(const float * matrix, const PointerRegion * device, const Rectangle * screen, const RecordSample * sample, Point * result) {
+	// The server applies the matrix to valuators normalized to [0, 1], then scales to the screen
+	double x = (sample->x - device->region.left) / RECT_WIDTH(device->region);
+	double y = (sample->y - device->region.top) / RECT_HEIGHT(device->region);
+	double w = matrix[6] * x + matrix[7] * y + matrix[8];
+
+	result->x = (matrix[0] * x + matrix[1] * y + matrix[2]) / w * RECT_WIDTH(*screen) + screen->left;
+	result->y = (matrix[3] * x + matrix[4] * y + matrix[5]) / w * RECT_HEIGHT(*screen) + screen->top;
+}
+
+static bool replay_contains(const Rectangle * region, const Point * point) {
+	return region->left <= point->x && point->x <= region->right &&
+		region->top <= point->y && point->y <= region->bottom;
+}
+
+int replay_run(const char * path, const Target * target) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return ERECORD_OPEN;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) || (size_t)info.st_size < sizeof(RecordHeader)) {
+		close(fd);
+		return ERECORD_INVALID;
+	}
+
+	void * data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return ERECORD_INVALID;
+	}
+
+	const RecordHeader * header = data;
+	const size_t samples_offset = sizeof(RecordHeader) + (size_t)header->region_count * sizeof(CRTCRegion);
+
+	if (header->magic != RECORD_MAGIC || header->version != RECORD_VERSION ||
+		header->region_size != sizeof(CRTCRegion) || header->sample_size != sizeof(RecordSample) ||
+		header->region_count < 0 || (size_t)info.st_size < samples_offset ||
+		RECT_WIDTH(header->device_region.region) <= 0 || RECT_HEIGHT(header->device_region.region) <= 0) {
+		munmap(data, info.st_size);
+		return ERECORD_INVALID;
+	}
+
+	// A partially written trailing sample is ignored
+	const size_t sample_count = (info.st_size - samples_offset) / sizeof(RecordSample);
+	const RecordSample * samples = (const RecordSample *)((const char *)data + samples_offset);
+
+	Topology topology = {0};
+	topology.screen_size.region = header->screen_size;
+	topology.region_count = topology.region_capacity = header->region_count;
+	topology.regions = malloc((header->region_count ? header->region_count : 1) * sizeof(CRTCRegion));
+	if (!topology.regions) {
+		munmap(data, info.st_size);
+		return ERECORD_INVALID;
+	}
+	memcpy(topology.regions, (const char *)data + sizeof(RecordHeader), header->region_count * sizeof(CRTCRegion));
+
+	DeviceState state;
+	memset(&state, 0, sizeof(state));
+	state.id = header->device_id;
+	memcpy(state.name, header->device_name, sizeof(state.name));
+	state.name[MAX_DEVICE_NAME - 1] = '\0';
+	state.region = header->device_region;
+	state.valid = true;
+
+	float matrix[9];
+	int result = target_compute_matrix(NULL, NULL, &topology, target, &state, matrix);
+	if (result || crtc_index_build(&topology.index, topology.regions, topology.region_count)) {
+		if (result == ETARGET_CRTC_OUT_OF_RANGE) {
+			fprintf(stderr, "CRTC index %d greater than highest index available %d.\n", target->crtc_index, topology.region_count - 1);
+		} else if (result == ETARGET_OUTPUT_DENSITY) {
+			fprintf(stderr, "The recording lacks the monitor size needed for one-to-one scaling.\n");
+		}
+		topology_free(&topology);
+		munmap(data, info.st_size);
+		return result ? result : ERECORD_INVALID;
+	}
+
+	const Rectangle * target_region = target->full_screen ? &topology.screen_size.region : &topology.regions[target->crtc_index].region;
+	unsigned long presses = 0, outside_target = 0, presses_outside_target = 0, outside_screen = 0;
+	double error_sum = 0, error_max = 0;
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (size_t i = 0; i < sample_count; i++) {
+		const RecordSample * sample = samples + i;
+		Point replayed, recorded;
+
+		replay_transform(matrix, &state.region, &topology.screen_size.region, sample, &replayed);
+		replay_transform(header->matrix, &state.region, &topology.screen_size.region, sample, &recorded);
+
+		double error = hypot(replayed.x - recorded.x, replayed.y - recorded.y);
+		error_sum += error;
+		if (error > error_max) {
+			error_max = error;
+		}
+
+		const bool press = sample->flags & RECORD_SAMPLE_PRESS;
+		presses += press;
+		if (!replay_contains(target_region, &replayed)) {
+			outside_target++;
+			presses_outside_target += press;
+		}
+		if (crtc_index_find(&topology.index, &replayed) < 0) {
+			outside_screen++;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	printf("Device %u \"%s\": %zu samples, %lu presses", header->device_id, state.name, sample_count, presses);
+	if (sample_count > 1) {
+		printf(", %.1f s", (uint32_t)(samples[sample_count - 1].time - samples[0].time) / 1000.0);
+	}
+	printf("\nRecorded Coordinate Transformation Matrix = ");
+	print_matrix(stdout, header->matrix);
+	printf("\nReplayed Coordinate Transformation Matrix = ");
+	print_matrix(stdout, matrix);
+	printf("\nOutside the target region: %lu samples, %lu presses\n", outside_target, presses_outside_target);
+	printf("Outside every CRTC: %lu samples\n", outside_screen);
+	printf("Distance from the recorded mapping: mean %.2f px, max %.2f px\n", sample_count ? error_sum / sample_count : 0, error_max);
+	printf("Replayed %.0f samples per second\n", elapsed > 0 ? sample_count / elapsed : 0);
+
+	topology_free(&topology);
+	munmap(data, info.st_size);
+	return 0;
+}
@@ -0,0 +1,47 @@
+#ifndef XRESTRICT_RECORD_H_
+#define XRESTRICT_RECORD_H_
+
+#include <stdint.h>
+#include <X11/Xlib.h>
+
+#include "apply.h"
+
+#define RECORD_MAGIC   0x31525258 // "XRR1"
+#define RECORD_VERSION 1
+
+// Written once when recording starts, followed by region_count CRTCRegions and then samples
+// until the end of the file. A recording cut short still replays up to its last whole sample.
+typedef struct RecordHeader {
+	uint32_t      magic;
+	uint32_t      version;
+	int32_t       region_size;
+	int32_t       sample_size;
+	int32_t       region_count;
+	uint32_t      device_id;
+	char          device_name[MAX_DEVICE_NAME];
+	PointerRegion device_region;
+	Rectangle     screen_size;
+	float         matrix[9]; // The device's matrix while recording
+} RecordHeader;
+
+#define RECORD_SAMPLE_PRESS   1
+#define RECORD_SAMPLE_RELEASE 2
+
+typedef struct RecordSample {
+	uint32_t time;      // Server time in milliseconds
+	uint16_t device_id; // The slave device which sent the event
+	uint16_t flags;
+	float    x, y;      // Valuator values, in device units
+} RecordSample;
+
+#define ERECORD_OPEN       (-1)
+#define ERECORD_WRITE      (-2)
+#define ERECORD_INVALID    (-4)
+#define ERECORD_NO_XINPUT  (-8)
+#define ERECORD_NO_MATRIX  (-16)
+// Appends the device's events to path until interrupted
+int record_run(Display * display, Topology * topology, const DeviceState * state, const char * path);
+// Maps every recorded sample through the matrix target describes and reports where they land
+int replay_run(const char * path, const Target * target);
+
+#endif /* XRESTRICT_RECORD_H_ */
@@ -1,6 +1,8 @@
 #include <stdio.h>
+#include <string.h>
 #include "xrestrict.h"
 #include "input.h"
+#include "display.h"
 
 static int verbosity = 1;
 static int success = 0;
@@ -15,8 +17,8 @@ static int failed = 0;
 			printf("E: " #test " failed!\n"); \
 		} else { \
 			printf("F"); \
-			failed++; \
 		} \
+		failed++; \
 	} \
 } while (0);
 
@@ -24,6 +26,157 @@ void rectangle_print(const Rectangle * rectangle) {
 	printf("{ .top = %d, .left = %d, .bottom = %d, .right = %d }", rectangle->top, rectangle->left, rectangle->bottom, rectangle->right);
 }
 
+// xorshift32, seeded so that every run checks the same cases
+static unsigned int random_state = 0x2545f491;
+
+static int random_between(const int low, const int high) {
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 17;
+	random_state ^= random_state << 5;
+	return low + random_state % (unsigned int)(high - low + 1);
+}
+
+#define BATCH_CASES 1000
+
+// Runs the scalar and batch geometry over the same random monitors and input regions, returns how many
+// results differ in any bit
+static int batch_mismatches(const CTMAspectPreserveType type, const CTMAffinity * affinity) {
+	RectangleBatch crtcs, inputs, scaled, aligned;
+	MatrixBatch matrices;
+	float ratios[RECTANGLE_BATCH_PADDED(BATCH_CASES)];
+	const Rectangle screen = {.top = 0, .left = 0, .bottom = 6000, .right = 12000};
+	int mismatches = 0;
+
+	rectangle_batch_alloc(&crtcs, BATCH_CASES);
+	rectangle_batch_alloc(&inputs, BATCH_CASES);
+	rectangle_batch_alloc(&scaled, BATCH_CASES);
+	rectangle_batch_alloc(&aligned, BATCH_CASES);
+	matrix_batch_alloc(&matrices, BATCH_CASES);
+	if (!crtcs.top || !inputs.top || !scaled.top || !aligned.top || !matrices.x_scale) {
+		return -1;
+	}
+
+	for (int i = 0; i < BATCH_CASES; i++) {
+		Rectangle crtc, input;
+		crtc.left = random_between(0, 8000);
+		crtc.top = random_between(0, 4000);
+		crtc.right = crtc.left + random_between(1, 4000);
+		crtc.bottom = crtc.top + random_between(1, 2000);
+		// Tablet ranges are often far larger than any monitor, and some are tiny
+		input.left = input.top = random_between(0, 1) ? 0 : random_between(-100, 100);
+		input.right = input.left + random_between(1, 65536);
+		input.bottom = input.top + random_between(1, 65536);
+		rectangle_batch_set(&crtcs, i, &crtc);
+		rectangle_batch_set(&inputs, i, &input);
+	}
+
+	rectangle_select_ratio_preserve_aspect_batch(&crtcs, &inputs, type, ratios);
+	rectangle_scale_preserve_aspect_batch(&crtcs, &inputs, type, &scaled);
+	rectangle_align_batch(&crtcs, &scaled, affinity, &aligned);
+	calculate_coordinate_transform_matrix_batch(&aligned, &screen, &matrices);
+
+	for (int i = 0; i < BATCH_CASES; i++) {
+		Rectangle crtc, input, expected_scaled, expected_aligned, batch_scaled, batch_aligned;
+		float expected_matrix[9], batch_matrix[9];
+
+		rectangle_batch_get(&crtcs, i, &crtc);
+		rectangle_batch_get(&inputs, i, &input);
+		const float ratio = rectangle_select_ratio_preserve_aspect(&crtc, &input, type);
+		rectangle_scale_preserve_aspect(&crtc, &input, type, &expected_scaled);
+		rectangle_align(&crtc, &expected_scaled, affinity, &expected_aligned);
+		calculate_coordinate_transform_matrix(&expected_aligned, &screen, expected_matrix);
+
+		rectangle_batch_get(&scaled, i, &batch_scaled);
+		rectangle_batch_get(&aligned, i, &batch_aligned);
+		matrix_batch_get(&matrices, i, batch_matrix);
+
+		if (ratio != ratios[i] ||
+			memcmp(&expected_scaled, &batch_scaled, sizeof(Rectangle)) ||
+			memcmp(&expected_aligned, &batch_aligned, sizeof(Rectangle)) ||
+			memcmp(expected_matrix, batch_matrix, sizeof(expected_matrix))) {
+			mismatches++;
+		}
+	}
+
+	rectangle_batch_free(&crtcs);
+	rectangle_batch_free(&inputs);
+	rectangle_batch_free(&scaled);
+	rectangle_batch_free(&aligned);
+	matrix_batch_free(&matrices);
+	return mismatches;
+}
+
+#define INDEX_LAYOUTS 200
+#define INDEX_QUERIES 500
+
+// Builds random layouts of up to 16 CRTCs, some in a row sharing edges, some mirroring an earlier one and
+// the rest placed anywhere, often overlapping, then returns how many points crtc_index_find puts in a
+// different CRTC than find_containing_crtc
+static int crtc_index_mismatches(void) {
+	CRTCRegion regions[16];
+	int mismatches = 0;
+
+	for (int layout = 0; layout < INDEX_LAYOUTS; layout++) {
+		const int count = random_between(1, 16);
+		memset(regions, 0, sizeof(regions));
+
+		for (int i = 0; i < count; i++) {
+			Rectangle * region = &regions[i].region;
+			const int kind = i ? random_between(0, 2) : 2;
+			if (kind == 0) {
+				// Right of the previous one, touching it
+				region->left = regions[i - 1].region.right;
+				region->top = regions[i - 1].region.top + random_between(-1, 1) * random_between(0, 200);
+			} else if (kind == 1) {
+				*region = regions[random_between(0, i - 1)].region;
+				continue;
+			} else {
+				region->left = random_between(-2000, 6000);
+				region->top = random_between(-1000, 3000);
+			}
+			region->right = region->left + random_between(1, 2560);
+			region->bottom = region->top + random_between(1, 1600);
+		}
+
+		CRTCIndex index;
+		if (crtc_index_build(&index, regions, count)) {
+			return -1;
+		}
+
+		for (int i = 0; i < INDEX_QUERIES; i++) {
+			const Rectangle * region = &regions[random_between(0, count - 1)].region;
+			Point point;
+			// Corners and edges of some CRTC, or anywhere around the layout
+			switch (random_between(0, 3)) {
+			case 0:
+				point.x = random_between(0, 1) ? region->left : region->right;
+				point.y = random_between(0, 1) ? region->top : region->bottom;
+				break;
+			case 1:
+				point.x = random_between(0, 1) ? region->left : region->right;
+				point.y = random_between(region->top - 10, region->bottom + 10);
+				break;
+			case 2:
+				point.x = random_between(region->left - 10, region->right + 10) + 0.5;
+				point.y = random_between(0, 1) ? region->top : region->bottom;
+				break;
+			default:
+				point.x = random_between(-2100, 8700) + random_between(0, 3) * 0.25;
+				point.y = random_between(-1100, 4700) + random_between(0, 3) * 0.25;
+				break;
+			}
+
+			if (crtc_index_find(&index, &point) != find_containing_crtc(regions, count, &point)) {
+				mismatches++;
+			}
+		}
+
+		crtc_index_free(&index);
+	}
+
+	return mismatches;
+}
+
 int main(int argc, char ** argv) {
 	Rectangle reference = {
 		.top = 5,
@@ -119,7 +272,91 @@ int main(int argc, char ** argv) {
 	test2.right = 17 + 10;
 	ratio = rectangle_select_ratio_preserve_aspect(&reference, &test2, CTM_Fit);
 	printf("\n%dx%d\n", (int)(10 * ratio), (int)(16 * ratio));
-	
+
+	// Valuators 1, 3, 9 and 10 are set, values only holds those
+	unsigned char mask[4] = {0x0a, 0x06, 0, 0};
+	double values[4] = {100, 200, 900, 1000};
+	XIValuatorState valuators = {
+		.mask_len = sizeof(mask),
+		.mask = mask,
+		.values = values
+	};
+	ValuatorIndices indices = {.x = 3, .y = 10};
+	Point point;
+
+	ASSERT(xi2_valuator_offset(mask, sizeof(mask), 1) == 0);
+	ASSERT(xi2_valuator_offset(mask, sizeof(mask), 9) == 2);
+	ASSERT(xi2_valuator_offset(mask, sizeof(mask), 2) == EVALUATOR_NOT_SET);
+	ASSERT(xi2_valuator_offset(mask, 1, 9) == EVALUATOR_NOT_SET);
+	ASSERT(xi2_valuator_offset(mask, sizeof(mask), 32) == EVALUATOR_NOT_SET);
+
+	ASSERT(xi2_read_point(&valuators, &indices, &point) == 0);
+	ASSERT(point.x == 200 && point.y == 1000);
+
+	// The second event only moved along y
+	unsigned char y_mask[4] = {0, 0x04, 0, 0};
+	double y_values[1] = {1100};
+	XIValuatorState y_only = {
+		.mask_len = sizeof(y_mask),
+		.mask = y_mask,
+		.values = y_values
+	};
+	const XIValuatorState * batch[2] = {&valuators, &y_only};
+	Point last = {0, 0}, points[2];
+
+	ASSERT(xi2_read_point(&y_only, &indices, &point) == EVALUATOR_NOT_SET);
+	ASSERT(xi2_read_points(batch, 2, &indices, &last, points) == 1);
+	ASSERT(points[1].x == 200 && points[1].y == 1100);
+	ASSERT(last.x == 200 && last.y == 1100);
+
+	// A slightly rotated and offset panel is recovered exactly from a grid of touches
+	const float expected[9] = {
+		0.98f, -0.02f, 0.015f,
+		0.03f, 1.01f, -0.02f,
+		0, 0, 1
+	};
+	CalibrationFit fit;
+	float fitted[9];
+	Point residual;
+
+	calibration_fit_reset(&fit);
+	for (int i = 0; i < 100; i++) {
+		Point device = {(i % 10) / 9.0, (i / 10) / 9.0};
+		Point screen = {
+			expected[0] * device.x + expected[1] * device.y + expected[2],
+			expected[3] * device.x + expected[4] * device.y + expected[5]
+		};
+		calibration_fit_add(&fit, &device, &screen);
+	}
+
+	ASSERT(calibration_fit_solve(&fit, fitted, &residual) == 0);
+	ASSERT(xi2_matrix_equal(fitted, expected));
+	ASSERT(residual.x < 1e-6 && residual.y < 1e-6);
+
+	// Touches along a single line leave the matrix undetermined
+	calibration_fit_reset(&fit);
+	for (int i = 0; i < 10; i++) {
+		Point device = {i / 9.0, i / 9.0}, screen = {i / 9.0, i / 9.0};
+		calibration_fit_add(&fit, &device, &screen);
+	}
+	ASSERT(calibration_fit_solve(&fit, fitted, NULL) == ECALIBRATION_DEGENERATE);
+
+	// The batch kernels agree with the scalar functions for every aspect type and alignment
+	const CTMAspectPreserveType types[] = {CTM_None, CTM_Fit, CTM_MatchWidth, CTM_MatchHeight};
+	for (unsigned int t = 0; t < sizeof(types) / sizeof(*types); t++) {
+		for (int alignment = 0; alignment < 9; alignment++) {
+			const CTMAffinity batch_affinity = {
+				.horizontal = (CTMHorizontalAffinity)(alignment % 3),
+				.vertical = (CTMVerticalAffinity)(alignment / 3)
+			};
+			ASSERT(batch_mismatches(types[t], &batch_affinity) == 0);
+		}
+		ASSERT(batch_mismatches(types[t], NULL) == 0);
+	}
+
+	// The index finds the same CRTC as the linear scan for every point, whether CRTCs overlap, mirror each other or share edges
+	ASSERT(crtc_index_mismatches() == 0);
+
 	printf("\nSuccess %d Failed %d\n", success, failed);
-	return 0;
+	return failed ? -1 : 0;
 }
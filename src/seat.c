@@ -0,0 +1,104 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <X11/Xlib.h>
+
+#include "seat.h"
+#include "context.h"
+#include "selector.h"
+
+static void * seat_apply(void * argument) {
+	Seat * seat = argument;
+
+	XRestrictContext context;
+	if (xrestrict_context_open(&context, seat->display_name, seat->use_cache)) {
+		seat->result = ESEAT_OPEN_FAILED;
+		return NULL;
+	}
+
+	if (target_list_select(context.display, &seat->list)) {
+		xrestrict_context_close(&context);
+		seat->result = ESEAT_SELECT_FAILED;
+		return NULL;
+	}
+
+	seat->results = calloc(seat->list.count ? seat->list.count : 1, sizeof(*seat->results));
+	if (!seat->results) {
+		xrestrict_context_close(&context);
+		seat->result = ESEAT_ALLOCATION_FAILED;
+		return NULL;
+	}
+
+	if (xrestrict_context_refresh_topology(&context)) {
+		xrestrict_context_close(&context);
+		seat->result = ESEAT_TOPOLOGY_FAILED;
+		return NULL;
+	}
+
+	// Each seat prints to its own buffer, which seats_apply prints once every seat is done
+	FILE * output = open_memstream(&seat->output, &seat->output_size);
+	if (!output) {
+		xrestrict_context_close(&context);
+		seat->result = ESEAT_ALLOCATION_FAILED;
+		return NULL;
+	}
+	context.output = output;
+
+	if (seat->mode == APPLY_DRY_RUN) {
+		fprintf(output, "Display %s:\n", XDisplayName(seat->display_name));
+	}
+	seat->failures = xrestrict_context_apply(&context, seat->list.targets, seat->results, seat->list.count, seat->mode);
+
+	fclose(output);
+	xrestrict_context_close(&context);
+	return NULL;
+}
+
+void seats_apply(Seat * seats, const int count) {
+	pthread_t * threads = calloc(count, sizeof(*threads));
+	bool * started = calloc(count, sizeof(*started));
+
+	XInitThreads();
+
+	for (int i = 0; i < count; i++) {
+		seats[i].result = 0;
+		seats[i].failures = 0;
+		seats[i].output = NULL;
+		seats[i].output_size = 0;
+		if (threads && started) {
+			started[i] = !pthread_create(threads + i, NULL, seat_apply, seats + i);
+		}
+	}
+
+	// A seat without a thread is still configured, just not in parallel
+	for (int i = 0; i < count; i++) {
+		if (started && started[i]) {
+			pthread_join(threads[i], NULL);
+		}
+	}
+	for (int i = 0; i < count; i++) {
+		if (!started || !started[i]) {
+			seat_apply(seats + i);
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (seats[i].output) {
+			fwrite(seats[i].output, 1, seats[i].output_size, stdout);
+			free(seats[i].output);
+			seats[i].output = NULL;
+		}
+	}
+	fflush(stdout);
+
+	free(threads);
+	free(started);
+}
+
+void seats_free(Seat * seats, const int count) {
+	for (int i = 0; i < count; i++) {
+		free(seats[i].list.targets);
+		free(seats[i].results);
+	}
+	free(seats);
+}
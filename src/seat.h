@@ -0,0 +1,33 @@
+#ifndef XRESTRICT_SEAT_H_
+#define XRESTRICT_SEAT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "apply.h"
+#include "options.h"
+
+// One X display and screen, e.g. ":1" or ":0.1", and the devices to restrict on it
+typedef struct Seat {
+	const char * display_name; // NULL for $DISPLAY
+	TargetList   list;
+	int          result;   // One of ESEAT_*, or 0
+	int *        results;  // One per target, as from xrestrict_context_apply
+	int          failures;
+	char *       output;   // What the seat printed, kept until every seat is done
+	size_t       output_size;
+	ApplyMode    mode;
+	bool         use_cache;
+} Seat;
+
+#define ESEAT_OPEN_FAILED       (-1)
+#define ESEAT_TOPOLOGY_FAILED   (-2)
+#define ESEAT_ALLOCATION_FAILED (-4)
+#define ESEAT_SELECT_FAILED     (-8)
+// Configures every seat over its own connection on its own thread, and returns once all are done.
+// What each seat prints is written to stdout afterwards, one seat after another.
+// Must be called before any other Xlib call, since it enables Xlib's thread support.
+void seats_apply(Seat * seats, const int count);
+void seats_free(Seat * seats, const int count);
+
+#endif /* XRESTRICT_SEAT_H_ */
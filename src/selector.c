@@ -0,0 +1,282 @@
+#ifdef HAVE_CONFIG_H
+#	include "config.h"
+#endif
+
+#include <limits.h>
+#include <regex.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/XInput2.h>
+
+#include "selector.h"
+#include "display.h"
+#include "trace.h"
+#if USE_XCB
+#	include "xcb_io.h"
+#endif
+
+// How far above the input device a USB device's serial is looked for
+#define SELECTOR_MAX_LEVELS 6
+
+static int selector_read_line(const char * path, char * value, const size_t value_size) {
+	FILE * file = fopen(path, "r");
+	if (!file) {
+		return ESELECTOR_QUERY_FAILED;
+	}
+
+	bool read = fgets(value, value_size, file) != NULL;
+	fclose(file);
+	if (!read) {
+		return ESELECTOR_QUERY_FAILED;
+	}
+
+	value[strcspn(value, "\n")] = '\0';
+	return value[0] ? 0 : ESELECTOR_QUERY_FAILED;
+}
+
+int selector_node_serial(const char * node, char * serial, const size_t serial_size) {
+	const char * event = strrchr(node, '/');
+	char path[PATH_MAX];
+
+	event = event ? event + 1 : node;
+
+	// Bluetooth and some USB devices report a serial to the input layer itself
+	snprintf(path, sizeof(path), "/sys/class/input/%s/device/uniq", event);
+	if (!selector_read_line(path, serial, serial_size)) {
+		return 0;
+	}
+
+	// Otherwise it belongs to the USB device somewhere above the input device. The kernel resolves ".."
+	// after following the "device" link, so each one climbs a level of the device tree.
+	int length = snprintf(path, sizeof(path), "/sys/class/input/%s/device", event);
+	for (int level = 0; level < SELECTOR_MAX_LEVELS && length > 0 && (size_t)length + strlen("/../serial") < sizeof(path); level++) {
+		strcpy(path + length, "/serial");
+		if (!selector_read_line(path, serial, serial_size)) {
+			return 0;
+		}
+		length += sprintf(path + length, "/..");
+	}
+
+	serial[0] = '\0';
+	return ESELECTOR_QUERY_FAILED;
+}
+
+// Reads the properties selectors need for every device at once
+static void selector_read_identity(Display * display, SelectorDevice * devices, const int count, const bool identifiers, const bool nodes) {
+	trace_begin("device_identity");
+#	if USE_XCB
+		XID * ids = malloc((count ? count : 1) * sizeof(*ids));
+		DeviceIdentifier * found = identifiers ? malloc((count ? count : 1) * sizeof(*found)) : NULL;
+		char (*found_nodes)[MAX_DEVICE_NODE] = nodes ? malloc((count ? count : 1) * sizeof(*found_nodes)) : NULL;
+
+		if (ids && (found || !identifiers) && (found_nodes || !nodes)) {
+			for (int i = 0; i < count; i++) {
+				ids[i] = devices[i].id;
+			}
+			xcbio_devices_get_identity(display, ids, found, found_nodes, count);
+			for (int i = 0; i < count; i++) {
+				if (found) {
+					devices[i].identifier = found[i];
+				}
+				if (found_nodes) {
+					memcpy(devices[i].node, found_nodes[i], MAX_DEVICE_NODE);
+				}
+			}
+		}
+		free(ids);
+		free(found);
+		free(found_nodes);
+#	else
+		// Devices may go away in between, which mustn't take the default error handler down with them
+		XErrorTrap trap;
+		xlib_error_trap_push(display, &trap);
+		for (int i = 0; i < count; i++) {
+			if (identifiers && xi2_device_get_identifier(display, devices[i].id, &devices[i].identifier)) {
+				devices[i].identifier.vendor = devices[i].identifier.product = DEVICE_ANY;
+			}
+			if (nodes && xi2_device_get_node(display, devices[i].id, devices[i].node, MAX_DEVICE_NODE)) {
+				devices[i].node[0] = '\0';
+			}
+		}
+		xlib_error_trap_pop(display, &trap);
+		xlib_error_trap_free(&trap);
+#	endif
+	trace_end();
+}
+
+// Lists every absolute slave pointer with whatever the selectors need to know about it
+static int selector_index_build(Display * display, const bool identifiers, const bool serials, SelectorDevice ** devices) {
+	int info_count = 0;
+
+	trace_begin("query_devices");
+	XIDeviceInfo * info = XIQueryDevice(display, XIAllDevices, &info_count);
+	trace_end();
+	if (!info) {
+		return ESELECTOR_QUERY_FAILED;
+	}
+
+	SelectorDevice * index = calloc(info_count ? info_count : 1, sizeof(*index));
+	if (!index) {
+		XIFreeDeviceInfo(info);
+		return ESELECTOR_ALLOCATION_FAILED;
+	}
+
+	int count = 0;
+	for (int i = 0; i < info_count; i++) {
+		ValuatorIndices valuators;
+		if ((info[i].use != XISlavePointer && info[i].use != XIFloatingSlave) ||
+			xi2_device_info_find_xy_valuators(display, info + i, &valuators)) {
+			continue;
+		}
+
+		SelectorDevice * device = index + count++;
+		device->id = info[i].deviceid;
+		strncpy(device->name, info[i].name, MAX_DEVICE_NAME - 1);
+		device->identifier.vendor = device->identifier.product = DEVICE_ANY;
+	}
+	XIFreeDeviceInfo(info);
+
+	if (identifiers || serials) {
+		selector_read_identity(display, index, count, identifiers, serials);
+	}
+
+	for (int i = 0; serials && i < count; i++) {
+		if (index[i].node[0] != '\0') {
+			selector_node_serial(index[i].node, index[i].serial, MAX_SELECTOR_SERIAL);
+		}
+	}
+
+	*devices = index;
+	return count;
+}
+
+static bool selector_matches(const DeviceSelector * selector, const regex_t * regex, const SelectorDevice * device) {
+	const DeviceIdentifier * wanted = &selector->identifier;
+
+	return (wanted->vendor == DEVICE_ANY || wanted->vendor == device->identifier.vendor) &&
+		(wanted->product == DEVICE_ANY || wanted->product == device->identifier.product) &&
+		(!regex || regexec(regex, device->name, 0, NULL, 0) == 0) &&
+		(selector->serial[0] == '\0' || strcmp(selector->serial, device->serial) == 0);
+}
+
+// Prints text in double quotes, as parse_target_line reads it back
+static void selector_print_quoted(FILE * file, const char * text) {
+	fputc('"', file);
+	for (; *text; text++) {
+		if (*text == '"' || *text == '\\') {
+			fputc('\\', file);
+		}
+		fputc(*text, file);
+	}
+	fputc('"', file);
+}
+
+static void selector_print(FILE * file, const DeviceSelector * selector) {
+	if (selector->identifier.vendor != DEVICE_ANY) {
+		fprintf(file, " --vendor %04x", selector->identifier.vendor);
+	}
+	if (selector->identifier.product != DEVICE_ANY) {
+		fprintf(file, " --product %04x", selector->identifier.product);
+	}
+	if (selector->name[0] != '\0') {
+		fprintf(file, " --name-regex ");
+		selector_print_quoted(file, selector->name);
+	}
+	if (selector->serial[0] != '\0') {
+		fprintf(file, " --serial ");
+		selector_print_quoted(file, selector->serial);
+	}
+}
+
+// Appends a copy of target for every device its selector matches
+static int selector_expand(const Target * target, const SelectorDevice * devices, const int device_count, TargetList * selected) {
+	regex_t regex;
+	int matches = 0;
+
+	if (target->selector.name[0] != '\0' && regcomp(&regex, target->selector.name, REG_EXTENDED | REG_NOSUB)) {
+		fprintf(stderr, "Invalid regular expression \"%s\".\n", target->selector.name);
+		return ESELECTOR_INVALID_REGEX;
+	}
+	const regex_t * name = target->selector.name[0] != '\0' ? &regex : NULL;
+
+	for (int i = 0; i < device_count; i++) {
+		if (!selector_matches(&target->selector, name, devices + i)) {
+			continue;
+		}
+
+		Target * match = target_list_append(selected, target);
+		if (!match) {
+			matches = ESELECTOR_ALLOCATION_FAILED;
+			break;
+		}
+		match->device_id = devices[i].id;
+		match->selector = target_defaults.selector;
+		matches++;
+	}
+
+	if (name) {
+		regfree(&regex);
+	}
+
+	if (matches == 0) {
+		fprintf(stderr, "No absolute pointer matches");
+		selector_print(stderr, &target->selector);
+		fprintf(stderr, ".\n");
+		return ESELECTOR_NO_MATCH;
+	}
+	return matches < 0 ? matches : 0;
+}
+
+int target_list_select(Display * display, TargetList * list) {
+	bool selecting = false, identifiers = false, serials = false;
+
+	for (int i = 0; i < list->count; i++) {
+		const DeviceSelector * selector = &list->targets[i].selector;
+		if (!device_selector_set(selector)) {
+			continue;
+		}
+
+		if (list->targets[i].device_id != INVALID_DEVICE_ID) {
+			fprintf(stderr, "-d DEVICEID can't be combined with --vendor, --product, --name-regex or --serial.\n");
+			return ESELECTOR_CONFLICT;
+		}
+
+		selecting = true;
+		identifiers = identifiers || selector->identifier.vendor != DEVICE_ANY || selector->identifier.product != DEVICE_ANY;
+		serials = serials || selector->serial[0] != '\0';
+	}
+
+	if (!selecting) {
+		return 0;
+	}
+
+	SelectorDevice * devices = NULL;
+	int device_count = selector_index_build(display, identifiers, serials, &devices);
+	if (device_count < 0) {
+		return device_count;
+	}
+
+	TargetList selected = {0};
+	int result = 0;
+	for (int i = 0; i < list->count && !result; i++) {
+		const Target * target = list->targets + i;
+		if (device_selector_set(&target->selector)) {
+			result = selector_expand(target, devices, device_count, &selected);
+		} else if (!target_list_append(&selected, target)) {
+			result = ESELECTOR_ALLOCATION_FAILED;
+		}
+	}
+	free(devices);
+
+	if (result) {
+		free(selected.targets);
+		return result;
+	}
+
+	free(list->targets);
+	*list = selected;
+	return 0;
+}
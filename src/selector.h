@@ -0,0 +1,30 @@
+#ifndef XRESTRICT_SELECTOR_H_
+#define XRESTRICT_SELECTOR_H_
+
+#include <X11/Xlib.h>
+
+#include "input.h"
+#include "options.h"
+
+// What a selector is matched against, one per absolute slave pointer
+typedef struct SelectorDevice {
+	XID              id;
+	char             name[MAX_DEVICE_NAME];
+	DeviceIdentifier identifier;                 // DEVICE_ANY when the driver doesn't say
+	char             node[MAX_DEVICE_NODE];      // Only read when a selector needs the serial
+	char             serial[MAX_SELECTOR_SERIAL];
+} SelectorDevice;
+
+// Reads the serial the kernel reports for the device node, e.g. "/dev/input/event5", from sysfs
+int selector_node_serial(const char * node, char * serial, const size_t serial_size);
+
+#define ESELECTOR_QUERY_FAILED      (-1)
+#define ESELECTOR_INVALID_REGEX     (-2)
+#define ESELECTOR_NO_MATCH          (-4)
+#define ESELECTOR_ALLOCATION_FAILED (-8)
+#define ESELECTOR_CONFLICT          (-16)
+// Replaces every target with a selector by one target per matching device. Every selector is matched
+// against a single device scan, plus one batch of property reads when any selector needs them.
+int target_list_select(Display * display, TargetList * list);
+
+#endif /* XRESTRICT_SELECTOR_H_ */
@@ -0,0 +1,179 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "trace.h"
+
+typedef struct TraceFrame {
+	TracePhase *    phase;
+	struct timespec start;
+	unsigned long   start_request;
+	unsigned long   start_round_trips;
+	unsigned long   start_extra_requests;
+} TraceFrame;
+
+static struct {
+	bool          enabled;
+	FILE *        output;
+	Display *     display;
+	unsigned long closed_requests;
+	unsigned long last_request;
+	unsigned long round_trips;
+	unsigned long extra_requests;
+	struct timespec start;
+	TracePhase    phases[TRACE_MAX_PHASES];
+	int           phase_count;
+	TraceFrame    stack[TRACE_MAX_DEPTH];
+	int           depth;
+} trace;
+
+static double trace_elapsed_ms(const struct timespec * start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+static unsigned long trace_next_request(void) {
+	// A fresh connection starts counting requests at 1
+	return trace.closed_requests + (trace.display ? NextRequest(trace.display) : 1);
+}
+
+// Called by Xlib after every library call which issued a request
+static int trace_after_function(Display * display) {
+	unsigned long last = NextRequest(display) - 1;
+
+	// Only a call which waited on a reply has heard back about its own last request. Reading events
+	// also moves LastKnownRequestProcessed, so progress since the previous call doesn't count.
+	if (last != trace.last_request && LastKnownRequestProcessed(display) >= last) {
+		trace.round_trips++;
+	}
+	trace.last_request = last;
+	return 0;
+}
+
+static void trace_exit_report(void) {
+	trace_report(trace.output);
+}
+
+void trace_enable(FILE * output) {
+	if (trace.enabled) {
+		return;
+	}
+
+	trace.enabled = true;
+	trace.output = output;
+	clock_gettime(CLOCK_MONOTONIC, &trace.start);
+	atexit(trace_exit_report);
+}
+
+bool trace_enabled(void) {
+	return trace.enabled;
+}
+
+void trace_attach(Display * display) {
+	if (!trace.enabled) {
+		return;
+	}
+
+	trace.display = display;
+	trace.last_request = NextRequest(display) - 1;
+	XSetAfterFunction(display, trace_after_function);
+}
+
+void trace_detach(Display * display) {
+	if (!trace.enabled || trace.display != display) {
+		return;
+	}
+
+	trace.closed_requests += NextRequest(display) - 1;
+	trace.display = NULL;
+	XSetAfterFunction(display, NULL);
+}
+
+static TracePhase * trace_find_phase(const char * name) {
+	for (int i = 0; i < trace.phase_count; i++) {
+		if (strcmp(trace.phases[i].name, name) == 0) {
+			return trace.phases + i;
+		}
+	}
+
+	if (trace.phase_count >= TRACE_MAX_PHASES) {
+		return NULL;
+	}
+
+	TracePhase * phase = trace.phases + trace.phase_count++;
+	memset(phase, 0, sizeof(*phase));
+	phase->name = name;
+	return phase;
+}
+
+void trace_begin(const char * name) {
+	if (!trace.enabled) {
+		return;
+	}
+
+	// Unbalanced or overly deep phases are still counted in their parent
+	TraceFrame * frame = trace.depth < TRACE_MAX_DEPTH ? trace.stack + trace.depth : NULL;
+	trace.depth++;
+	if (!frame) {
+		return;
+	}
+
+	frame->phase = trace_find_phase(name);
+	frame->start_request = trace_next_request();
+	frame->start_round_trips = trace.round_trips;
+	frame->start_extra_requests = trace.extra_requests;
+	clock_gettime(CLOCK_MONOTONIC, &frame->start);
+}
+
+void trace_end(void) {
+	if (!trace.enabled || trace.depth == 0) {
+		return;
+	}
+
+	trace.depth--;
+	if (trace.depth >= TRACE_MAX_DEPTH) {
+		return;
+	}
+
+	TraceFrame * frame = trace.stack + trace.depth;
+	TracePhase * phase = frame->phase;
+	if (!phase) {
+		return;
+	}
+
+	phase->calls++;
+	phase->wall_ms += trace_elapsed_ms(&frame->start);
+	phase->requests += trace_next_request() - frame->start_request;
+	phase->requests += trace.extra_requests - frame->start_extra_requests;
+	phase->round_trips += trace.round_trips - frame->start_round_trips;
+}
+
+void trace_count(const unsigned long requests, const unsigned long round_trips) {
+	if (!trace.enabled) {
+		return;
+	}
+
+	trace.extra_requests += requests;
+	trace.round_trips += round_trips;
+}
+
+void trace_report(FILE * file) {
+	if (!trace.enabled) {
+		return;
+	}
+
+	fprintf(file, "{\"wall_ms\": %.3f, \"requests\": %lu, \"round_trips\": %lu, \"phases\": [",
+			trace_elapsed_ms(&trace.start),
+			trace_next_request() - 1 + trace.extra_requests,
+			trace.round_trips);
+
+	for (int i = 0; i < trace.phase_count; i++) {
+		const TracePhase * phase = trace.phases + i;
+		fprintf(file, "%s\n\t{\"name\": \"%s\", \"calls\": %lu, \"wall_ms\": %.3f, \"requests\": %lu, \"round_trips\": %lu}",
+				i ? "," : "",
+				phase->name, phase->calls, phase->wall_ms, phase->requests, phase->round_trips);
+	}
+	fprintf(file, "\n]}\n");
+	fflush(file);
+}
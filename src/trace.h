@@ -0,0 +1,31 @@
+#ifndef XRESTRICT_TRACE_H_
+#define XRESTRICT_TRACE_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <X11/Xlib.h>
+
+#define TRACE_MAX_PHASES 32
+#define TRACE_MAX_DEPTH  8
+
+typedef struct TracePhase {
+	const char *  name;
+	unsigned long calls;
+	double        wall_ms;
+	unsigned long requests;
+	unsigned long round_trips;
+} TracePhase;
+
+// Phases nest, each one is charged for everything which happens until its trace_end()
+void trace_enable(FILE * output);
+bool trace_enabled(void);
+void trace_attach(Display * display);
+// Must be called before the display is closed
+void trace_detach(Display * display);
+void trace_begin(const char * name);
+void trace_end(void);
+// For requests issued outside of Xlib's bookkeeping, e.g. over xcb
+void trace_count(const unsigned long requests, const unsigned long round_trips);
+void trace_report(FILE * file);
+
+#endif /* XRESTRICT_TRACE_H_ */
@@ -0,0 +1,209 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xlib-xcb.h>
+#include <X11/Xatom.h>
+#include <xcb/randr.h>
+#include <xcb/xinput.h>
+
+#include "xcb_io.h"
+#include "input.h"
+#include "trace.h"
+
+int xcbio_get_crtc_regions(Display * display, XRRScreenResources * resources, CRTCRegion * regions, const int max_regions) {
+	xcb_connection_t * connection = XGetXCBConnection(display);
+
+	xcb_randr_get_crtc_info_cookie_t * crtc_cookies = malloc(resources->ncrtc * sizeof(*crtc_cookies));
+	xcb_randr_get_output_info_cookie_t * output_cookies = malloc(resources->noutput * sizeof(*output_cookies));
+	xcb_randr_get_output_info_reply_t ** outputs = calloc(resources->noutput, sizeof(*outputs));
+
+	if (!crtc_cookies || !output_cookies || !outputs) {
+		free(crtc_cookies);
+		free(output_cookies);
+		free(outputs);
+		return ECRTC_INFO_REQUEST_FAILED;
+	}
+
+	// Every output is known up front, so their sizes can be requested alongside the CRTCs
+	for (int i = 0; i < resources->ncrtc; i++) {
+		crtc_cookies[i] = xcb_randr_get_crtc_info(connection, resources->crtcs[i], resources->configTimestamp);
+	}
+	for (int i = 0; i < resources->noutput; i++) {
+		output_cookies[i] = xcb_randr_get_output_info(connection, resources->outputs[i], resources->configTimestamp);
+	}
+
+	trace_count(resources->ncrtc + resources->noutput, 1);
+
+	for (int i = 0; i < resources->noutput; i++) {
+		xcb_generic_error_t * error = NULL;
+		outputs[i] = xcb_randr_get_output_info_reply(connection, output_cookies[i], &error);
+		free(error);
+	}
+
+	int region_count = 0;
+	int result = 0;
+	for (int i = 0; i < resources->ncrtc; i++) {
+		xcb_generic_error_t * error = NULL;
+		xcb_randr_get_crtc_info_reply_t * crtc_info = xcb_randr_get_crtc_info_reply(connection, crtc_cookies[i], &error);
+		free(error);
+
+		// Keep collecting replies after a failure so none are left queued
+		if (!crtc_info) {
+			result = ECRTC_INFO_REQUEST_FAILED;
+			continue;
+		} else if (result || crtc_info->num_outputs < 1) {
+			free(crtc_info);
+			continue;
+		} else if (region_count >= max_regions) {
+			result = EREGIONS_OVERFLOW;
+			free(crtc_info);
+			continue;
+		}
+
+		CRTCRegion * region = regions + region_count++;
+		region->crtc = resources->crtcs[i];
+		region->width = region->height = 0;
+
+		if (crtc_info->num_outputs == 1) {
+			region->output = xcb_randr_get_crtc_info_outputs(crtc_info)[0];
+
+			for (int j = 0; j < resources->noutput; j++) {
+				if (resources->outputs[j] == region->output && outputs[j]) {
+					region->width = outputs[j]->mm_width;
+					region->height = outputs[j]->mm_height;
+					break;
+				}
+			}
+		} else {
+			region->output = None;
+		}
+
+		region->region.top = crtc_info->y;
+		region->region.left = crtc_info->x;
+		region->region.bottom = crtc_info->y + crtc_info->height;
+		region->region.right = crtc_info->x + crtc_info->width;
+		free(crtc_info);
+	}
+
+	for (int i = 0; i < resources->noutput; i++) {
+		free(outputs[i]);
+	}
+	free(outputs);
+	free(output_cookies);
+	free(crtc_cookies);
+
+	return result ? result : region_count;
+}
+
+int xcbio_devices_get_matrix(Display * display, const XID * ids, float (*matrices)[9], int * results, const int count) {
+	xcb_connection_t * connection = XGetXCBConnection(display);
+	Atom atoms[2];
+	int failures = 0;
+
+	if (xi2_matrix_atoms(display, atoms)) {
+		for (int i = 0; i < count; i++) {
+			results[i] = EINTERN_FAILED;
+		}
+		return count;
+	}
+
+	xcb_input_xi_get_property_cookie_t * cookies = malloc(count * sizeof(*cookies));
+	if (!cookies) {
+		for (int i = 0; i < count; i++) {
+			results[i] = EGET_PROPERTY_FAILED;
+		}
+		return count;
+	}
+
+	for (int i = 0; i < count; i++) {
+		cookies[i] = xcb_input_xi_get_property(connection, ids[i], 0, atoms[0], atoms[1], 0, 9);
+	}
+
+	trace_count(count, 1);
+
+	for (int i = 0; i < count; i++) {
+		xcb_generic_error_t * error = NULL;
+		xcb_input_xi_get_property_reply_t * reply = xcb_input_xi_get_property_reply(connection, cookies[i], &error);
+		free(error);
+
+		if (!reply || reply->format != 32 || reply->num_items != 9) {
+			results[i] = EGET_PROPERTY_FAILED;
+			failures++;
+		} else {
+			const float * retrieved_matrix = xcb_input_xi_get_property_items(reply);
+			for (int j = 0; j < 9; j++) {
+				matrices[i][j] = retrieved_matrix[j];
+			}
+			results[i] = 0;
+		}
+		free(reply);
+	}
+
+	free(cookies);
+	return failures;
+}
+
+void xcbio_devices_get_identity(Display * display, const XID * ids, DeviceIdentifier * identifiers, char (*nodes)[MAX_DEVICE_NODE], const int count) {
+	xcb_connection_t * connection = XGetXCBConnection(display);
+	Atom atoms[2] = {None, None};
+
+	for (int i = 0; i < count; i++) {
+		if (identifiers) {
+			identifiers[i].vendor = identifiers[i].product = DEVICE_ANY;
+		}
+		if (nodes) {
+			nodes[i][0] = '\0';
+		}
+	}
+
+	xcb_input_xi_get_property_cookie_t * cookies = malloc(2 * count * sizeof(*cookies));
+	if (!cookies || xi2_identity_atoms(display, atoms)) {
+		free(cookies);
+		return;
+	}
+
+	const bool want_identifiers = identifiers && atoms[0] != None;
+	const bool want_nodes = nodes && atoms[1] != None;
+	int requests = 0;
+	for (int i = 0; i < count; i++) {
+		if (want_identifiers) {
+			cookies[2 * i] = xcb_input_xi_get_property(connection, ids[i], 0, atoms[0], XA_INTEGER, 0, 2);
+			requests++;
+		}
+		if (want_nodes) {
+			cookies[2 * i + 1] = xcb_input_xi_get_property(connection, ids[i], 0, atoms[1], XA_STRING, 0, MAX_DEVICE_NODE / 4);
+			requests++;
+		}
+	}
+
+	trace_count(requests, requests ? 1 : 0);
+
+	for (int i = 0; i < count; i++) {
+		xcb_generic_error_t * error = NULL;
+		xcb_input_xi_get_property_reply_t * reply;
+
+		if (want_identifiers) {
+			reply = xcb_input_xi_get_property_reply(connection, cookies[2 * i], &error);
+			free(error);
+			error = NULL;
+			if (reply && reply->format == 32 && reply->num_items == 2) {
+				const int32_t * values = xcb_input_xi_get_property_items(reply);
+				identifiers[i].vendor = values[0];
+				identifiers[i].product = values[1];
+			}
+			free(reply);
+		}
+
+		if (want_nodes) {
+			reply = xcb_input_xi_get_property_reply(connection, cookies[2 * i + 1], &error);
+			free(error);
+			if (reply && reply->format == 8 && reply->num_items > 0 && reply->num_items < MAX_DEVICE_NODE) {
+				memcpy(nodes[i], xcb_input_xi_get_property_items(reply), reply->num_items);
+				nodes[i][reply->num_items] = '\0';
+			}
+			free(reply);
+		}
+	}
+
+	free(cookies);
+}
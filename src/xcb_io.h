@@ -0,0 +1,20 @@
+#ifndef XRESTRICT_XCB_IO_H_
+#define XRESTRICT_XCB_IO_H_
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrandr.h>
+
+#include "display.h"
+#include "input.h"
+
+// Same results as xlib_get_crtc_regions, but every CRTC and output request is sent before any
+// reply is read, and the output sizes are filled in as well.
+int xcbio_get_crtc_regions(Display * display, XRRScreenResources * resources, CRTCRegion * regions, const int max_regions);
+
+// Reads the matrices of count devices in a single round trip, returns the number of failures
+int xcbio_devices_get_matrix(Display * display, const XID * ids, float (*matrices)[9], int * results, const int count);
+// Reads "Device Product ID" into identifiers and "Device Node" into nodes for count devices in a single
+// round trip. Either may be NULL to skip that property, devices lacking one get DEVICE_ANY or "".
+void xcbio_devices_get_identity(Display * display, const XID * ids, DeviceIdentifier * identifiers, char (*nodes)[MAX_DEVICE_NODE], const int count);
+
+#endif /* XRESTRICT_XCB_IO_H_ */
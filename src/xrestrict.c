@@ -1,3 +1,7 @@
+#ifdef HAVE_CONFIG_H
+#	include "config.h"
+#endif
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
@@ -10,35 +14,75 @@
 
 #include "input.h"
 #include "display.h"
+#include "apply.h"
+#include "calibrate.h"
+#include "context.h"
+#include "daemon.h"
+#include "follow.h"
+#include "generate.h"
+#include "monitor.h"
+#include "record.h"
+#include "plan.h"
+#include "options.h"
+#include "profile.h"
+#include "seat.h"
+#include "selector.h"
+#include "trace.h"
+#if USE_XCB
+#	include "xcb_io.h"
+#endif
 #include "xrestrict.h"
 
-#define INVALID_DEVICE_ID -1
-#define MAX_ABSOLUTE_POINTERS 16
-#define MAX_CRTC 10
-
-void calc_matrix(const XID deviceid, const CTMConfiguration * config, Rectangle * screen_size, const CRTCRegion * crtc, const Rectangle * input_region, float * matrix) {
-	Rectangle scaled, aligned;
-
-	rectangle_scale_preserve_aspect(&(crtc->region), input_region, config->type, &scaled);
-
-	rectangle_align(&(crtc->region), &scaled, &config->affinity, &aligned);
-
-	calculate_coordinate_transform_matrix(&aligned, screen_size, matrix);
-}
-
 void print_usage(FILE * file, char * cmd) {
-	fprintf(file, "Usage: %s -d DEVICEID [-c CRTCINDEX][-f] [--dry]\n", cmd);
-	fprintf(file, "   or: %s -i|-I [-d DEVICEID] [-c CRTCINDEX][-f] [--dry]\n\n", cmd);
+	fprintf(file, "Usage: %s -d DEVICEID [-c CRTCINDEX][-f] [-d DEVICEID [-c CRTCINDEX][-f]]... [--dry] [--daemon|--follow]\n", cmd);
+	fprintf(file, "   or: %s [--vendor VENDOR] [--product PRODUCT] [--name-regex REGEX] [--serial SERIAL] [-c CRTCINDEX][-f] [--dry] [--daemon|--follow]\n", cmd);
+	fprintf(file, "   or: %s -i|-I [-d DEVICEID] [-c CRTCINDEX][-f] [--timeout SECONDS] [--dry] [--daemon]\n", cmd);
+	fprintf(file, "   or: %s --stdin [--dry] [--daemon] < SPEC\n", cmd);
+	fprintf(file, "   or: %s --profile NAME [--dry] [--daemon|--follow]\n", cmd);
+	fprintf(file, "   or: %s --display DISPLAY -d DEVICEID [options] [--display DISPLAY -d DEVICEID [options]]... [--dry]\n", cmd);
+	fprintf(file, "   or: %s -d DEVICEID --record FILE\n", cmd);
+	fprintf(file, "   or: %s --replay FILE [-c CRTCINDEX][-f] [options]\n", cmd);
+	fprintf(file, "   or: %s -d DEVICEID [-c CRTCINDEX][-f] --calibrate [--dry]\n", cmd);
+	fprintf(file, "   or: %s --generate FILE [--jobs N]\n", cmd);
+	fprintf(file, "   or: %s -d DEVICEID [-c CRTCINDEX][-f] [-d DEVICEID [-c CRTCINDEX][-f]]... --monitor\n", cmd);
+	fprintf(file, "   or: %s --plan\n\n", cmd);
 
 	fprintf(file, "\t-d DEVICEID, --device DEVICEID\n");
-	fprintf(file, "\t\t\t\tSpecify the XID of the XInput2 device to modify.\n");
+	fprintf(file, "\t\t\t\tSpecify the XID of the XInput2 device to modify. May be repeated, options following a DEVICEID apply only to that device.\n");
+	fprintf(file, "\t--vendor VENDOR, --product PRODUCT\n");
+	fprintf(file, "\t\t\t\tInstead of DEVICEID, restrict every absolute pointer with this hexadecimal USB vendor and/or product id.\n");
+	fprintf(file, "\t--name-regex REGEX\tInstead of DEVICEID, restrict every absolute pointer whose name matches the extended regular expression REGEX.\n");
+	fprintf(file, "\t--serial SERIAL\t\tInstead of DEVICEID, restrict every absolute pointer with this serial number.\n");
 	fprintf(file, "\t-c CRTCID, --device CRTCID\n");
 	fprintf(file, "\t\t\t\tThe CRTC to restrict the device to.\n");
+	fprintf(file, "\t-O OUTPUT, --output OUTPUT\n");
+	fprintf(file, "\t\t\t\tRestrict the device to the monitor connected to OUTPUT, e.g. \"HDMI-1\", instead of CRTCID.\n");
 	fprintf(file, "\t-i, --interactive\tInteractively determine the monitor and input device to use.\n");
 	fprintf(file, "\t-I, --interactive-identity\n");
 	fprintf(file, "\t\t\t\tSame as -i but prior to engaging interactive selection, reverts all Coordinate Transformation Matrices to identity and attempts to restore them afterwards.\n");
+	fprintf(file, "\t--timeout SECONDS\tGive up on interactive selection if there was no click after SECONDS.\n");
 	fprintf(file, "\t-f, --full\t\tUse the full screen area.\n");
+	fprintf(file, "\t--atomic\t\tWrite every matrix while holding a server grab, and put every device back if any write fails.\n");
 	fprintf(file, "\t--dry\t\t\tOutput the \"Coordinate Transformation Matrix\" instead of setting it.\n");
+	fprintf(file, "\t--stdin\t\t\tRead additional devices from standard input, one \"-d DEVICEID [options]\" per line.\n");
+	fprintf(file, "\t--display DISPLAY\tRestrict the devices following it on DISPLAY, e.g. \":1\" or \":0.1\". Every display is configured at once, each on its own thread.\n");
+	fprintf(file, "\t--profile NAME\t\tAdd the devices listed under \"[NAME]\" in ~/.config/xrestrict/profiles, in the same format as --stdin.\n");
+	fprintf(file, "\t--no-cache\t\tAlways query the monitor layout from the server instead of reusing the layout saved by an earlier run.\n");
+	fprintf(file, "\t--trace\t\t\tOn exit, print a JSON summary of the time, X requests and round trips spent in each phase to stderr.\n");
+	fprintf(file, "\t--daemon\t\tStay running and reapply the restriction whenever monitors or input devices change.\n");
+	fprintf(file, "\t--follow\t\tStay running and restrict the devices to whichever monitor the pointer is on, instead of CRTCINDEX.\n");
+	fprintf(file, "\t--record FILE\t\tRecord the device's events, the monitor layout and its current matrix to FILE until interrupted.\n");
+	fprintf(file, "\t--replay FILE\t\tReport where the events recorded in FILE land with the given options, without a display.\n");
+	fprintf(file, "\t--calibrate\t\tShow targets on the monitor and fit the matrix which puts the device's touches on them, for touchscreens whose panel doesn't line up with the monitor.\n");
+	fprintf(file, "\t--monitor\t\tLeave the matrices alone and report each device's event rate, delivery latency and samples outside its monitor every second until interrupted, then a histogram of where samples landed.\n");
+	fprintf(file, "\t--generate FILE\t\tWithout a display, print the matrices of the targets in the monitor and device layouts FILE describes, see generate.h. FILE may be - for standard input.\n");
+	fprintf(file, "\t--jobs N\t\tCompute --generate's layouts on N threads (Default: one per processor).\n");
+	fprintf(file, "\t--plan\t\t\tPrecompute the matrix of every absolute device on every monitor in every configuration and save it.\n");
+	fprintf(file, "\t--use-plan\t\tTake matrices from the saved plan when it matches the current monitors and devices, skipping the monitor queries.\n");
+#	if !USE_XCB
+		fprintf(file, "\nThis build has no XCB to read the current matrices in one batch, so a single run writes every matrix, even ones a device already holds.\n");
+		fprintf(file, "--atomic reads them first at one round trip per device, --daemon and --follow skip the writes once they have seen each matrix.\n");
+#	endif
 	fprintf(file, "\nAlignment Control:\n");
 	fprintf(file, "\t-X, --horiztontal left|center|right\n");
 	fprintf(file, "\t\t\t\tAlign input region horizontally (Default: left).\n");
@@ -55,9 +99,492 @@ void print_usage(FILE * file, char * cmd) {
 	fprintf(file, "\t--fit\t\t\tScale input region to completely contain target region (Default).\n");
 }
 
-#define PARSE_NONE      0
-#define PARSE_DEVICEID  1
-#define PARSE_CRTCINDEX 2
+typedef struct SavedMatrices {
+	XID *	ids;
+	float	(*matrices)[9];
+	int		count;
+} SavedMatrices;
+
+static void saved_matrices_free(SavedMatrices * saved) {
+	free(saved->ids);
+	free(saved->matrices);
+	saved->ids = NULL;
+	saved->matrices = NULL;
+	saved->count = 0;
+}
+
+static void saved_matrices_restore(Display * display, const SavedMatrices * saved, const ApplyMode mode);
+
+// Writes matrices, or identity when NULL, to every saved device in one batch, returns the number of failures
+static int saved_matrices_write(Display * display, const SavedMatrices * saved, float (*matrices)[9], int * results, const ApplyMode mode) {
+	DeviceState * states = calloc(saved->count ? saved->count : 1, sizeof(*states));
+	float (*identities)[9] = matrices ? NULL : calloc(saved->count ? saved->count : 1, sizeof(*identities));
+	int failures;
+
+	if (!states || (!matrices && !identities)) {
+		free(states);
+		free(identities);
+		for (int i = 0; i < saved->count; i++) {
+			results[i] = ETARGET_SET_FAILED;
+		}
+		return saved->count;
+	}
+
+	for (int i = 0; i < saved->count; i++) {
+		states[i].id = saved->ids[i];
+		results[i] = 0;
+		if (identities) {
+			memcpy(identities[i], identity, sizeof(identities[i]));
+		}
+	}
+
+	if (mode == APPLY_ATOMIC) {
+		failures = target_write_atomic(display, states, matrices ? matrices : identities, results, saved->count, NULL);
+	} else {
+		failures = target_write_batch(display, states, matrices ? matrices : identities, results, saved->count);
+	}
+
+	free(states);
+	free(identities);
+	return failures;
+}
+
+// Remembers the matrices of every absolute pointer and resets them to identity
+static int saved_matrices_identity(Display * display, XIDeviceInfo * info, const XIDeviceInfo * info_end, SavedMatrices * saved, const ApplyMode mode) {
+	const int device_count = info_end - info;
+
+	saved->ids = malloc(device_count * sizeof(*saved->ids));
+	saved->matrices = malloc(device_count * sizeof(*saved->matrices));
+	int * read_results = malloc(device_count * sizeof(*read_results));
+	saved->count = 0;
+
+	if (!saved->ids || !saved->matrices || !read_results) {
+		free(read_results);
+		saved_matrices_free(saved);
+		fprintf(stderr, "Out of memory.\n");
+		return -1;
+	}
+
+	int absolute_pointer_count = xi2_find_absolute_pointers(display, info, info_end, saved->ids, device_count);
+
+	if (absolute_pointer_count < 0) {
+		free(read_results);
+		saved_matrices_free(saved);
+		fprintf(stderr, "Error");
+		return -1;
+	}
+
+#	if USE_XCB
+		xcbio_devices_get_matrix(display, saved->ids, saved->matrices, read_results, absolute_pointer_count);
+#	else
+		for (int i = 0; i < absolute_pointer_count; i++) {
+			read_results[i] = xi2_device_get_matrix(display, saved->ids[i], saved->matrices[i]);
+		}
+#	endif
+
+	int current_pointer = 0;
+	for (int i = 0; i < absolute_pointer_count; i++) {
+		if (!read_results[i]) {
+			saved->ids[current_pointer] = saved->ids[i];
+			memmove(saved->matrices[current_pointer], saved->matrices[i], sizeof(saved->matrices[i]));
+			current_pointer++;
+		}
+	}
+	saved->count = current_pointer;
+	free(read_results);
+
+	int * write_results = malloc((saved->count ? saved->count : 1) * sizeof(*write_results));
+	if (!write_results || saved_matrices_write(display, saved, NULL, write_results, mode)) {
+		// An atomic write has already put every device back
+		if (write_results && mode != APPLY_ATOMIC) {
+			fprintf(stderr, "Error setting Coordinate Transformation Matrices, attempting to revert.\n");
+			saved_matrices_restore(display, saved, mode);
+		}
+		free(write_results);
+		saved_matrices_free(saved);
+		return -1;
+	}
+
+	free(write_results);
+	return 0;
+}
+
+static void saved_matrices_restore(Display * display, const SavedMatrices * saved, const ApplyMode mode) {
+	int * results = malloc((saved->count ? saved->count : 1) * sizeof(*results));
+
+	if (!results || saved_matrices_write(display, saved, saved->matrices, results, mode)) {
+		for (int i = 0; i < saved->count; i++) {
+			if (!results || results[i]) {
+				fprintf(stderr, "Error restoring Coordinate Transformation Matrix for device %lu. ", saved->ids[i]);
+				fprintf(stderr, "Original matrix was [");
+				for (int j = 0; j < 9; j++) {
+					fprintf(stderr, " %f", saved->matrices[i][j]);
+				}
+				fprintf(stderr, "]\n");
+			}
+		}
+	}
+
+	free(results);
+}
+
+static void interactive_print_masters(const XIDeviceInfo * info, const XIDeviceInfo * info_end, const XID * masters, const int master_count) {
+	for (int i = 0; i < master_count; i++) {
+		const XIDeviceInfo * slave;
+		const XIDeviceInfo * master = info;
+		while (master < info_end && (XID)master->deviceid != masters[i]) {
+			master++;
+		}
+
+		printf("Master pointer %lu \"%s\":", masters[i], master < info_end ? master->name : "");
+		for (slave = info; slave < info_end; slave++) {
+			if (slave->use == XISlavePointer && (XID)slave->attachment == masters[i]) {
+				printf(" %d \"%s\"", slave->deviceid, slave->name);
+			}
+		}
+		printf("\n");
+	}
+}
+
+// Every master pointer picks a device and monitor with a click. With a single master the
+// first target keeps a DEVICEID given with -d, with several every master adds its own target.
+static int interactive_select(Display * display, Topology * topology, const bool set_identity, const ApplyMode mode, const int timeout_ms, TargetList * list) {
+	int device_count;
+
+	XIDeviceInfo * info = XIQueryDevice(display, XIAllDevices, &device_count);
+
+	if (!info) {
+		fprintf(stderr, "Failed to query input devices.\n");
+		return -1;
+	}
+
+	const XIDeviceInfo * info_end = info + device_count;
+
+	XID * masters = malloc(device_count * sizeof(*masters));
+	XID * sources = malloc(device_count * sizeof(*sources));
+	Point * points = malloc(device_count * sizeof(*points));
+	int master_count = masters && sources && points ? xi2_find_master_pointers(info, info_end, masters, device_count) : -1;
+	int result = -1;
+
+	if (master_count <= 0) {
+		XIFreeDeviceInfo(info);
+		fprintf(stderr, "Failed to find a master pointer.\n");
+		goto done;
+	}
+
+	if (master_count > 1) {
+		if (list->targets[0].device_id != INVALID_DEVICE_ID) {
+			XIFreeDeviceInfo(info);
+			fprintf(stderr, "With several master pointers every master picks its own device, -d can't be given.\n");
+			goto done;
+		}
+		interactive_print_masters(info, info_end, masters, master_count);
+	}
+
+	SavedMatrices saved = {0};
+
+	if (set_identity) {
+		trace_begin("identity_matrices");
+		int identity_result = saved_matrices_identity(display, info, info_end, &saved, mode);
+		trace_end();
+
+		if (identity_result) {
+			XIFreeDeviceInfo(info);
+			goto done;
+		}
+	}
+
+	XIFreeDeviceInfo(info);
+
+	if (master_count > 1) {
+		printf("Each user, please use the device you wish to configure, and click on the monitor you wish to use.\n");
+	} else {
+		printf("Please use the device you wish to configure, and click on the monitor you wish to use.\n");
+	}
+	fflush(stdout);
+
+	trace_begin("interactive_click");
+	int click_result = xi2_pointers_get_clicks(display, masters, sources, points, master_count, timeout_ms);
+	trace_end();
+
+	if (set_identity) {
+		trace_begin("restore_matrices");
+		saved_matrices_restore(display, &saved, mode);
+		saved_matrices_free(&saved);
+		trace_end();
+	}
+
+	// A user who never clicked only leaves their own master unconfigured
+	if (click_result == ECLICK_TIMEOUT && master_count > 1) {
+		for (int i = 0; i < master_count; i++) {
+			if (!sources[i]) {
+				fprintf(stderr, "Timed out waiting for a click from master pointer %lu.\n", masters[i]);
+			}
+		}
+	} else if (click_result == ECLICK_TIMEOUT) {
+		fprintf(stderr, "Timed out waiting for a click.\n");
+		goto done;
+	} else if (click_result == ECLICK_INTERRUPTED) {
+		fprintf(stderr, "Interrupted while waiting for a click.\n");
+		goto done;
+	} else if (click_result) {
+		fprintf(stderr, "Failed to use pointer grab to determine CRTC and device id.\n");
+		goto done;
+	}
+
+	const Target first = list->targets[0];
+	if (master_count > 1) {
+		list->count = 0;
+	}
+
+	for (int i = 0; i < master_count; i++) {
+		if (!sources[i]) {
+			continue;
+		}
+
+		int crtc_index = crtc_index_find(&topology->index, points + i);
+		if (crtc_index < 0) {
+			fprintf(stderr, "Click not in recognized CRTC.\n");
+			continue;
+		}
+
+		if (master_count == 1) {
+			list->targets[0].crtc_index = crtc_index;
+			if (list->targets[0].device_id == INVALID_DEVICE_ID) {
+				list->targets[0].device_id = sources[i];
+			}
+			result = 0;
+			break;
+		}
+
+		Target * target = target_list_append(list, &first);
+		if (!target) {
+			fprintf(stderr, "Out of memory.\n");
+			goto done;
+		}
+		target->device_id = sources[i];
+		target->crtc_index = crtc_index;
+		printf("Master pointer %lu: device %lu on CRTC %d\n", masters[i], sources[i], crtc_index);
+		result = 0;
+	}
+
+	// Later code always expects at least the first target
+	if (list->count == 0) {
+		list->targets[0] = first;
+		list->count = 1;
+	}
+
+done:
+	free(masters);
+	free(sources);
+	free(points);
+	return result;
+}
+
+// Returns the number of failures, or -1 when the plan is missing, stale or doesn't cover every target
+static int plan_apply(Display * display, const Target * targets, int * results, const int count, const ApplyMode mode) {
+	char path[4096];
+	if (plan_path(display, path, sizeof(path))) {
+		return -1;
+	}
+
+	trace_begin("plan_key");
+	XRRScreenResources * resources = XRRGetScreenResourcesCurrent(display, DefaultRootWindow(display));
+	trace_end();
+	if (!resources) {
+		return -1;
+	}
+
+	Rectangle screen_size;
+	CacheKey key;
+	xlib_find_screen_size(display, &screen_size);
+	cache_key_from_resources(resources, &screen_size, &key);
+	XRRFreeScreenResources(resources);
+
+	Plan plan;
+	trace_begin("plan_load");
+	int load_result = plan_load(path, &key, &plan);
+	trace_end();
+	if (load_result) {
+		return -1;
+	}
+
+	DeviceState * states = calloc(count, sizeof(*states));
+	float (*matrices)[9] = calloc(count, sizeof(*matrices));
+	int failures = -1;
+
+	if (!states || !matrices) {
+		goto done;
+	}
+
+	for (int i = 0; i < count; i++) {
+		const float * matrix = plan_lookup(&plan, targets + i);
+		if (!matrix) {
+			goto done;
+		}
+		memcpy(matrices[i], matrix, sizeof(matrices[i]));
+		states[i].id = targets[i].device_id;
+		results[i] = 0;
+	}
+
+	trace_begin("plan_check_devices");
+	int check_result = plan_check_devices(display, &plan, targets, count);
+	trace_end();
+	if (check_result) {
+		goto done;
+	}
+
+	if (mode == APPLY_DRY_RUN) {
+		for (int i = 0; i < count; i++) {
+			if (count > 1) {
+				printf("Device %lu: ", states[i].id);
+			}
+			printf("Coordinate Transformation Matrix = ");
+			print_matrix(stdout, matrices[i]);
+			printf("\n");
+		}
+		failures = 0;
+	} else if (mode == APPLY_ATOMIC) {
+		failures = target_write_atomic(display, states, matrices, results, count, NULL);
+	} else {
+		failures = target_write_batch(display, states, matrices, results, count);
+	}
+
+done:
+	free(states);
+	free(matrices);
+	plan_free(&plan);
+	return failures;
+}
+
+static int plan_save(Display * display, Topology * topology) {
+	char path[4096];
+	if (plan_path(display, path, sizeof(path))) {
+		fprintf(stderr, "Failed to find a directory to save the plan in.\n");
+		return -1;
+	}
+
+	XRRScreenResources * resources = XRRGetScreenResourcesCurrent(display, DefaultRootWindow(display));
+	if (!resources) {
+		fprintf(stderr, "Failed to retrieve screen resources for monitor information.\n");
+		return -1;
+	}
+
+	CacheKey key;
+	cache_key_from_resources(resources, &(topology->screen_size.region), &key);
+	XRRFreeScreenResources(resources);
+
+	Plan plan;
+	int result = plan_build(display, topology, &key, &plan);
+	if (result == EPLAN_DEVICE_QUERY) {
+		fprintf(stderr, "Failed to query input devices.\n");
+		return -1;
+	} else if (result) {
+		fprintf(stderr, "Out of memory.\n");
+		return -1;
+	}
+
+	trace_begin("plan_store");
+	result = plan_store(path, &plan);
+	trace_end();
+	if (result) {
+		fprintf(stderr, "Failed to write plan \"%s\".\n", path);
+	} else {
+		printf("Planned %d devices on %d regions in %d configurations to %s.\n",
+			   plan.header->device_count, plan.header->region_count, plan.header->configuration_count, path);
+		for (int i = 0; i < plan.header->device_count; i++) {
+			printf("\t%u\t%s\n", plan.devices[i].id, plan.devices[i].name);
+		}
+	}
+
+	plan_free(&plan);
+	return result ? -1 : 0;
+}
+
+static Seat * seat_append(Seat ** seats, int * count, const char * display_name) {
+	Seat * grown = realloc(*seats, (*count + 1) * sizeof(**seats));
+	if (!grown) {
+		return NULL;
+	}
+
+	*seats = grown;
+	Seat * seat = grown + (*count)++;
+	memset(seat, 0, sizeof(*seat));
+	seat->display_name = display_name;
+	return seat;
+}
+
+static void seat_report_device(const char * display_name, const Target * target, const int result) {
+	const int device_id = target->device_id;
+
+	if (result == EDEVICE_NOT_FOUND) {
+		fprintf(stderr, "Display %s: failed to query device %d.\n", display_name, device_id);
+	} else if (result == EDEVICE_NO_VALUATORS) {
+		fprintf(stderr, "Display %s: failed to find absolute X and Y valuators for device %d.\n", display_name, device_id);
+	} else if (result == EDEVICE_NO_REGION) {
+		fprintf(stderr, "Display %s: failed to retrieve region from device %d.\n", display_name, device_id);
+	}
+	printf("Display %s device %d: %s\n", display_name, device_id, result ? "failed" : "ok");
+}
+
+static int run_seats(Seat * seats, const int seat_count) {
+	for (int i = 0; i < seat_count; i++) {
+		for (int j = 0; j < seats[i].list.count; j++) {
+			const Target * target = seats[i].list.targets + j;
+			if (target->device_id < 0 && !device_selector_set(&target->selector)) {
+				fprintf(stderr, "DEVICEID must be a positive integer\n");
+				return -1;
+			}
+		}
+		if (seats[i].list.count == 0) {
+			fprintf(stderr, "No devices given for display %s.\n", XDisplayName(seats[i].display_name));
+			return -1;
+		}
+	}
+
+	seats_apply(seats, seat_count);
+
+	int failed_seats = 0;
+	for (int i = 0; i < seat_count; i++) {
+		const Seat * seat = seats + i;
+		const char * display_name = XDisplayName(seat->display_name);
+
+		if (seat->result == ESEAT_OPEN_FAILED) {
+			fprintf(stderr, "Failed to open display %s.\n", display_name);
+		} else if (seat->result == ESEAT_SELECT_FAILED) {
+			fprintf(stderr, "Display %s: failed to select devices.\n", display_name);
+		} else if (seat->result == ESEAT_TOPOLOGY_FAILED) {
+			fprintf(stderr, "Display %s: failed to retrieve crtc region information.\n", display_name);
+		} else if (seat->result) {
+			fprintf(stderr, "Out of memory.\n");
+		}
+
+		if (seat->result) {
+			failed_seats++;
+			continue;
+		}
+
+		for (int j = 0; j < seat->list.count; j++) {
+			seat_report_device(display_name, seat->list.targets + j, seat->results[j]);
+		}
+		if (seat->failures) {
+			failed_seats++;
+		}
+	}
+
+	return failed_seats ? -1 : 0;
+}
+
+static void close_display(Display * display) {
+	trace_detach(display);
+	XCloseDisplay(display);
+}
+
+static void close_context(XRestrictContext * context) {
+	Display * display = context->display;
+	xrestrict_context_close(context);
+	close_display(display);
+}
 
 int main(int argc, char ** argv) {
 	if (argc < 2) {
@@ -65,345 +592,504 @@ int main(int argc, char ** argv) {
 		return -1;
 	}
 
-	int device_id = INVALID_DEVICE_ID;
-	int crtc_index = 0;
 	bool dry_run = false;
-	bool full_screen = false;
+	bool atomic = false;
 	bool interactive = false;
 	bool set_identity = false;
-	bool one_to_one = false;
+	bool run_daemon = false;
+	bool follow = false;
+	bool read_spec = false;
+	bool use_cache = true;
+	bool build_plan = false;
+	bool use_plan = false;
+	bool calibrate = false;
+	bool monitor = false;
+	int timeout_ms = -1;
+	const char * record_path = NULL;
+	const char * replay_path = NULL;
+	const char * profile_name = NULL;
+	const char * generate_path = NULL;
+	long jobs = sysconf(_SC_NPROCESSORS_ONLN);
 
-	CTMConfiguration config = {
-		.type = CTM_Fit,
-		.affinity = {
-			.vertical = VA_Top,
-			.horizontal = HA_Left
-		}
-	};
+	Target defaults = target_defaults;
+
+	TargetList list = {0};
+	// Target options apply to the most recent -d, or to every device when given before the first -d
+	Target * current = &defaults;
+
+	// Devices following a --display belong to that display, earlier ones to $DISPLAY
+	Seat * seats = NULL;
+	int seat_count = 0;
+	TargetList * targets = &list;
+
+	// Everything below is released at done, whichever way main leaves
+	Display * display = NULL;
+	XRestrictContext context = {0};
+	DeviceState * states = NULL;
+	int * results = NULL;
+	int result = -1;
 
-	// TODO: break out command line parsing into another function
-	//       or use getopt
 	for (int i = 1; i < argc; i++) {
+		int option_result = parse_target_option(argc, argv, &i, current);
+
+		if (option_result == OPTION_INVALID) {
+			print_usage(stderr, argv[0]);
+			goto done;
+		} else if (option_result == OPTION_CONSUMED) {
+			continue;
+		}
+
 		if (strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--device") == 0) {
-			char * invalid;
 			if (++i >= argc) {
 				print_usage(stderr, argv[0]);
-				return -1;
+				goto done;
 			}
 
-			device_id = strtol(argv[i], &invalid, 10);
-			if (invalid && *invalid != '\0') {
-				fprintf(stderr, "Failed to parse device id \"%s\".\n", argv[i]);
+			current = target_list_append(targets, &defaults);
+			if (!current || parse_device_id(argv[i], &current->device_id) != OPTION_CONSUMED) {
 				print_usage(stderr, argv[0]);
-				return -1;
+				goto done;
 			}
-		} else if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--crtc") == 0) {
-			char * invalid;
+		} else if (strcmp(argv[i], "--display") == 0) {
 			if (++i >= argc) {
 				print_usage(stderr, argv[0]);
-				return -1;
+				goto done;
 			}
 
-			crtc_index = strtol(argv[i], &invalid, 10);
-			if (invalid && *invalid != '\0') {
-				fprintf(stderr, "Failed to parse crtc index \"%s\".\n", argv[i]);
-				print_usage(stderr, argv[0]);
-				return -1;
+			Seat * seat = seat_append(&seats, &seat_count, argv[i]);
+			if (!seat) {
+				fprintf(stderr, "Out of memory.\n");
+				goto done;
 			}
+			targets = &seat->list;
+			current = &defaults;
 		} else if (strcmp(argv[i], "--dry") == 0) {
 			dry_run = true;
-		} else if (strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--full") == 0) {
-			full_screen = true;
-		} else if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--top") == 0) {
-			config.affinity.vertical = VA_Top;
-		} else if (strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "--bottom") == 0) {
-			config.affinity.vertical = VA_Bottom;
-		} else if (strcmp(argv[i], "-l") == 0 || strcmp(argv[i], "--left") == 0) {
-			config.affinity.horizontal = HA_Left;
-		} else if (strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--right") == 0) {
-			config.affinity.horizontal = HA_Right;
-		} else if (strcmp(argv[i], "-X") == 0 || strcmp(argv[i], "--horizontal") == 0) {
+		} else if (strcmp(argv[i], "--atomic") == 0) {
+			atomic = true;
+		} else if (strcmp(argv[i], "--daemon") == 0) {
+			run_daemon = true;
+		} else if (strcmp(argv[i], "--follow") == 0) {
+			follow = true;
+		} else if (strcmp(argv[i], "--trace") == 0) {
+			trace_enable(stderr);
+		} else if (strcmp(argv[i], "--timeout") == 0) {
+			char * invalid;
 			if (++i >= argc) {
 				print_usage(stderr, argv[0]);
-				return -1;
+				goto done;
+			}
+
+			double timeout = strtod(argv[i], &invalid);
+			if ((invalid && *invalid != '\0') || timeout < 0 || timeout > INT_MAX / 1000) {
+				fprintf(stderr, "Failed to parse timeout \"%s\".\n", argv[i]);
+				goto done;
+			}
+			timeout_ms = timeout * 1000;
+		} else if (strcmp(argv[i], "--record") == 0 || strcmp(argv[i], "--replay") == 0) {
+			if (i + 1 >= argc) {
+				print_usage(stderr, argv[0]);
+				goto done;
 			}
 
-			if (strcmp(argv[i], "left") == 0) {
-				config.affinity.horizontal = HA_Left;
-			} else if (strcmp(argv[i], "center") == 0) {
-				config.affinity.horizontal = HA_Centered;
-			} else if (strcmp(argv[i], "right") == 0) {
-				config.affinity.horizontal = HA_Right;
+			if (argv[i][3] == 'c') {
+				record_path = argv[++i];
 			} else {
-				fprintf(stderr, "Unknown horizontal alignment \"%s\".\n", argv[i]);
+				replay_path = argv[++i];
+			}
+		} else if (strcmp(argv[i], "--generate") == 0) {
+			if (++i >= argc) {
 				print_usage(stderr, argv[0]);
-				return -1;
+				goto done;
 			}
-		} else if (strcmp(argv[i], "-Y") == 0 || strcmp(argv[i], "--vertical") == 0) {
+			generate_path = argv[i];
+		} else if (strcmp(argv[i], "--jobs") == 0) {
+			char * invalid;
 			if (++i >= argc) {
 				print_usage(stderr, argv[0]);
-				return -1;
+				goto done;
 			}
 
-			if (strcmp(argv[i], "top") == 0) {
-				config.affinity.vertical = VA_Top;
-			} else if (strcmp(argv[i], "center") == 0) {
-				config.affinity.vertical = VA_Centered;
-			} else if (strcmp(argv[i], "bottom") == 0) {
-				config.affinity.vertical = VA_Bottom;
-			} else {
-				fprintf(stderr, "Unknown vertical alignment \"%s\".\n", argv[i]);
+			jobs = strtol(argv[i], &invalid, 10);
+			if ((invalid && *invalid != '\0') || jobs < 1 || jobs > 1024) {
+				fprintf(stderr, "Failed to parse job count \"%s\".\n", argv[i]);
+				goto done;
+			}
+		} else if (strcmp(argv[i], "--profile") == 0) {
+			if (++i >= argc) {
 				print_usage(stderr, argv[0]);
-				return -1;
+				goto done;
 			}
-		} else if (strcmp(argv[i], "--fit") == 0) {
-			config.type = CTM_Fit;
-		} else if (strcmp(argv[i], "-w") == 0 || strcmp(argv[i], "--match-width") == 0) {
-			config.type = CTM_MatchWidth;
-		} else if (strcmp(argv[i], "-H") == 0 || strcmp(argv[i], "--match-height") == 0) {
-			config.type = CTM_MatchHeight;
+			profile_name = argv[i];
+		} else if (strcmp(argv[i], "--calibrate") == 0) {
+			calibrate = true;
+		} else if (strcmp(argv[i], "--monitor") == 0) {
+			monitor = true;
+		} else if (strcmp(argv[i], "--plan") == 0) {
+			build_plan = true;
+		} else if (strcmp(argv[i], "--use-plan") == 0) {
+			use_plan = true;
+		} else if (strcmp(argv[i], "--no-cache") == 0) {
+			use_cache = false;
+		} else if (strcmp(argv[i], "--stdin") == 0) {
+			read_spec = true;
 		} else if (strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "--interactive") == 0) {
 			interactive = true;
 		} else if (strcmp(argv[i], "-I") == 0 || strcmp(argv[i], "--interactive-identity") == 0) {
 			interactive = true;
 			set_identity = true;
-		} else if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--one") == 0) {
-			one_to_one = true;
-			config.type = CTM_None;
 		} else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
 			print_usage(stdout, argv[0]);
-			return 0;
+			result = 0;
+			goto done;
 		} else {
 			print_usage(stderr, argv[0]);
-			return -1;
+			goto done;
 		}
 	}
 
-	Display * display = XOpenDisplay(NULL);
+	const ApplyMode mode = dry_run ? APPLY_DRY_RUN : atomic ? APPLY_ATOMIC : APPLY_WRITE;
 
-	if (!display) {
-		fprintf(stderr, "Failed to open display.\n");
-		return -1;
+	if (read_spec && parse_target_spec(stdin, targets, &defaults) != OPTION_CONSUMED) {
+		goto done;
 	}
 
-	CRTCRegion screen_size;
-
-	xlib_find_screen_size(display, &(screen_size.region));
-
-	CRTCRegion crtc_regions[MAX_CRTC];
+	if (profile_name) {
+		char source[4096], binary[4096];
+		int profile_result = profile_source_path(source, sizeof(source));
+		if (!profile_result) {
+			profile_result = profile_binary_path(binary, sizeof(binary));
+		}
+		if (!profile_result) {
+			profile_result = profile_load(source, binary, profile_name, targets);
+		}
 
-	XRRScreenResources * resources = XRRGetScreenResourcesCurrent(display, DefaultRootWindow(display));
+		if (profile_result == EPROFILE_PATH) {
+			fprintf(stderr, "Failed to find the profile file, HOME is not set.\n");
+		} else if (profile_result == EPROFILE_NO_SOURCE) {
+			fprintf(stderr, "Failed to open profile file \"%s\".\n", source);
+		} else if (profile_result == EPROFILE_PARSE) {
+			fprintf(stderr, "Failed to parse profile file \"%s\".\n", source);
+		} else if (profile_result == EPROFILE_NOT_FOUND) {
+			fprintf(stderr, "No profile named \"%s\" in \"%s\".\n", profile_name, source);
+		} else if (profile_result) {
+			fprintf(stderr, "Out of memory.\n");
+		}
 
-	if (!resources) {
-		XCloseDisplay(display);
-		fprintf(stderr, "Failed to retrieve screen resources for monitor information.\n");
-		return -1;
+		if (profile_result) {
+			goto done;
+		}
 	}
 
-	int region_count = xlib_get_crtc_regions(display, resources, crtc_regions, MAX_CRTC);
-	XRRFreeScreenResources(resources);
+	if (generate_path) {
+		if (list.count || seat_count || interactive || run_daemon || follow || record_path || replay_path || calibrate || monitor || build_plan || use_plan) {
+			fprintf(stderr, "--generate takes its devices from FILE and can't be combined with -d, --display, -i, --daemon, --follow, --record, --replay, --calibrate, --monitor or --plan.\n");
+			goto done;
+		}
 
-	if (region_count < 0) {
-		XCloseDisplay(display);
-		fprintf(stderr, "Failed to retrieve crtc region information.\n");
-		return -1;
-	}
+		FILE * input = strcmp(generate_path, "-") == 0 ? stdin : fopen(generate_path, "r");
+		if (!input) {
+			fprintf(stderr, "Failed to open \"%s\".\n", generate_path);
+			goto done;
+		}
 
-	ValuatorIndices valuator_indices = {0};
-	int device_count;
+		int generate_result = generate_run(input, stdout, jobs < 1 ? 1 : jobs);
+		if (generate_result == EGENERATE_ALLOCATION) {
+			fprintf(stderr, "Out of memory.\n");
+		} else if (generate_result == EGENERATE_WRITE) {
+			fprintf(stderr, "Failed to write the matrices.\n");
+		}
+		if (input != stdin) {
+			fclose(input);
+		}
+		result = generate_result ? -1 : 0;
+		goto done;
+	}
 
-	if (interactive) {
-		// FIXME: we don't actually handle MPX
-		XID pointerid = 0;
+	if (seat_count) {
+		if (interactive || monitor || run_daemon || follow || record_path || replay_path || calibrate || build_plan || use_plan || trace_enabled()) {
+			fprintf(stderr, "--display only applies restrictions once, it can't be combined with -i, --monitor, --daemon, --follow, --record, --replay, --calibrate, --plan, --use-plan or --trace.\n");
+			goto done;
+		}
 
-		XIDeviceInfo * info = XIQueryDevice(display, XIAllDevices, &device_count);
+		if (list.count) {
+			Seat * seat = seat_append(&seats, &seat_count, NULL);
+			if (!seat) {
+				fprintf(stderr, "Out of memory.\n");
+				goto done;
+			}
+			seat->list = list;
+			memset(&list, 0, sizeof(list));
+		}
 
-		if (!info) {
-			XCloseDisplay(display);
-			fprintf(stderr, "Failed to query input devices.\n");
-			return -1;
+		for (int i = 0; i < seat_count; i++) {
+			seats[i].mode = mode;
+			seats[i].use_cache = use_cache;
 		}
 
-		const XIDeviceInfo * info_end = info + device_count;
+		result = run_seats(seats, seat_count);
+		goto done;
+	}
 
-		if (xi2_find_master_pointers(info, info_end, &pointerid, 1) < 0) {
-			XCloseDisplay(display);
-			fprintf(stderr, "xrestrict only functions correctly in single master pointer environments.\n");
-			return -1;
+	if (interactive && list.count > 1) {
+		fprintf(stderr, "Interactive selection can only configure a single device.\n");
+		goto done;
+	}
+
+	if (follow && run_daemon) {
+		fprintf(stderr, "--follow already reapplies the restriction when monitors change, it can't be combined with --daemon.\n");
+		goto done;
+	}
+
+	if (list.count == 0) {
+		if (!target_list_append(&list, &defaults)) {
+			goto done;
 		}
+	}
 
-		XID absolute_pointers[MAX_ABSOLUTE_POINTERS];
-		float absolute_pointer_matrices[MAX_ABSOLUTE_POINTERS][9];
-		int absolute_pointer_count = 0;
+	if (record_path && (list.count > 1 || run_daemon || follow || replay_path)) {
+		fprintf(stderr, "--record records a single device and can't be combined with --daemon, --follow or --replay.\n");
+		goto done;
+	}
 
-		if (set_identity) {
-			absolute_pointer_count = xi2_find_absolute_pointers(display, info, info_end, absolute_pointers, MAX_ABSOLUTE_POINTERS);
+	if (calibrate && (interactive || list.count > 1 || run_daemon || follow || record_path || replay_path || build_plan)) {
+		fprintf(stderr, "--calibrate calibrates a single device and can't be combined with -i, --daemon, --follow, --record, --replay or --plan.\n");
+		goto done;
+	}
 
-			if (absolute_pointer_count == EDEVICES_OVERFLOW) {
-				XCloseDisplay(display);
-				fprintf(stderr, "More than %d absolute pointers detected, aborting.\n", MAX_ABSOLUTE_POINTERS);
-				return -1;
-			} else if (absolute_pointer_count < 0) {
-				XCloseDisplay(display);
-				fprintf(stderr, "Error");
-				return -1;
-			}
+	if (monitor && (interactive || run_daemon || follow || record_path || replay_path || calibrate || build_plan || use_plan)) {
+		fprintf(stderr, "--monitor only watches devices and can't be combined with -i, --daemon, --follow, --record, --replay, --calibrate or --plan.\n");
+		goto done;
+	}
 
-			int current_pointer = 0;
-			for (int i = 0; i < absolute_pointer_count; i++) {
-				if (!xi2_device_get_matrix(display, absolute_pointers[i], absolute_pointer_matrices[current_pointer])) {
-					absolute_pointers[current_pointer] = absolute_pointers[i];
-					current_pointer++;
-				} 
-			}
-			absolute_pointer_count = current_pointer;
-
-			for (int i = 0; i < absolute_pointer_count; i++) {
-				if (xi2_device_set_matrix(display, absolute_pointers[i], identity)) {
-					fprintf(stderr, "Error setting Coordinate Transformation Matrix for device %lu, attempting to revert.\n", absolute_pointers[i]);
-
-					// Attempt to revert matrices for all devices we've touched
-					// including this one
-					for (; i >= 0; i--) {
-						if (xi2_device_set_matrix(display, absolute_pointers[i], absolute_pointer_matrices[i])) {
-							fprintf(stderr, "Error reverting the Coordinate Transformation matrix for device %lu. It was [", absolute_pointers[i]);
-							for (int j = 0; j < 9; j++) {
-								fprintf(stderr, " %f", absolute_pointer_matrices[i][j]);
-							}
-							fprintf(stderr, " ]\n");
-						}
-					}
-					XIFreeDeviceInfo(info);
-					XCloseDisplay(display);
-					return -1;
-				}
-			}
+	if (replay_path) {
+		if (list.targets[0].output[0]) {
+			fprintf(stderr, "--replay has no display to look up outputs on, use -c CRTCINDEX instead.\n");
+			goto done;
 		}
 
-		XIFreeDeviceInfo(info);
+		int replay_result = replay_run(replay_path, list.targets);
+		if (replay_result == ERECORD_OPEN) {
+			fprintf(stderr, "Failed to open recording \"%s\".\n", replay_path);
+		} else if (replay_result == ERECORD_INVALID) {
+			fprintf(stderr, "\"%s\" is not a recording made by this version of xrestrict.\n", replay_path);
+		}
+		result = replay_result ? -1 : 0;
+		goto done;
+	}
 
-		Point point;
+	trace_begin("open_display");
+	display = XOpenDisplay(NULL);
 
-		printf("Please use the device you wish to configure, and click on the monitor you wish to use.\n");
-		if (xi2_pointer_get_next_click(display, &pointerid, &point)) {
-			XCloseDisplay(display);
-			fprintf(stderr, "Failed to use pointer grab to determine CRTC and device id.\n");
-			return -1;
+	if (!display) {
+		trace_end();
+		fprintf(stderr, "Failed to open display.\n");
+		goto done;
+	}
+	trace_attach(display);
+	trace_end();
+
+	int select_result = target_list_select(display, &list);
+	if (select_result) {
+		if (select_result == ESELECTOR_QUERY_FAILED) {
+			fprintf(stderr, "Failed to query input devices.\n");
+		} else if (select_result == ESELECTOR_ALLOCATION_FAILED) {
+			fprintf(stderr, "Out of memory.\n");
 		}
+		goto done;
+	}
 
-		if (set_identity) {
-			for (int i = 0; i < absolute_pointer_count; i++) {
-				if (xi2_device_set_matrix(display, absolute_pointers[i], absolute_pointer_matrices[i])) {
-					fprintf(stderr, "Error restoring Coordinate Transformation Matrix for device %lu. ", absolute_pointers[i]);
-					fprintf(stderr, "Original matrix was [");
-					for (int j = 0; j < 9; j++) {
-						fprintf(stderr, " %f", absolute_pointer_matrices[i][j]);
-					}
-					fprintf(stderr, "]\n");
-				}
+	if ((interactive || record_path || calibrate) && list.count > 1) {
+		fprintf(stderr, "%s a single device, but %d devices were selected.\n",
+				interactive ? "Interactive selection can only configure" : record_path ? "--record records" : "--calibrate calibrates", list.count);
+		goto done;
+	}
+
+	// A plan hit needs neither the monitor layout nor the devices' ranges
+	if (use_plan && !build_plan && !interactive && !run_daemon && !follow && !record_path && !calibrate && list.targets[0].device_id >= 0) {
+		int * plan_results = calloc(list.count, sizeof(*plan_results));
+		int failures = plan_results ? plan_apply(display, list.targets, plan_results, list.count, mode) : -1;
+
+		if (failures >= 0 && list.count > 1) {
+			for (int i = 0; i < list.count; i++) {
+				printf("Device %d: %s\n", list.targets[i].device_id, plan_results[i] ? "failed" : "ok");
 			}
 		}
+		free(plan_results);
 
-		crtc_index = find_containing_crtc(crtc_regions, region_count, &point);
-		if (crtc_index < 0) {
-			XCloseDisplay(display);
-			fprintf(stderr, "Click not in recognized CRTC.\n");
-			return -1;
+		if (failures >= 0) {
+			result = failures ? -1 : 0;
+			goto done;
 		}
+	}
 
-		if (device_id == INVALID_DEVICE_ID) {
-			device_id = pointerid;
-		}
+	if (xrestrict_context_attach(&context, display, use_cache)) {
+		fprintf(stderr, "The X server lacks RandR or the XInputExtension.\n");
+		goto done;
 	}
 
-	if (device_id < 0) {
-		fprintf(stderr, "DEVICEID must be a positive integer\n");
-		print_usage(stderr, argv[0]);
-		return -1;
+	Topology * topology = &context.topology;
+
+	int topology_result = xrestrict_context_refresh_topology(&context);
+	if (topology_result == ERESOURCES_REQUEST_FAILED) {
+		fprintf(stderr, "Failed to retrieve screen resources for monitor information.\n");
+		goto done;
+	} else if (topology_result) {
+		fprintf(stderr, "Failed to retrieve crtc region information.\n");
+		goto done;
 	}
 
-	XIDeviceInfo * device = XIQueryDevice(display, device_id, &device_count);
-	if (!device) {
-		XCloseDisplay(display);
-		fprintf(stderr, "Failed to query device %d.\n", device_id);
-		return -1;
+	if (build_plan) {
+		result = plan_save(display, topology);
+		goto done;
 	}
 
-	int valuator_result = xi2_device_info_find_xy_valuators(display, device, &valuator_indices);
-	
-	if (valuator_result) {
-		XCloseDisplay(display);
-		fprintf(stderr, "Failed to find absolute X and Y valuators for device %d.\n", device_id);
-		return -1;
+	if (interactive) {
+		if (interactive_select(display, topology, set_identity, mode, timeout_ms, &list)) {
+			goto done;
+		}
+
+		if (record_path && list.count > 1) {
+			fprintf(stderr, "--record records a single device, but several master pointers picked devices.\n");
+			goto done;
+		}
 	}
 
-	if (crtc_index >= region_count) {
-		XCloseDisplay(display);
-		fprintf(stderr, "CRTC index %d greater than highest index available %d.\n", crtc_index, region_count - 1);
-		return -1;
+	for (int i = 0; i < list.count; i++) {
+		if (list.targets[i].device_id < 0) {
+			fprintf(stderr, "DEVICEID must be a positive integer\n");
+			print_usage(stderr, argv[0]);
+			goto done;
+		}
 	}
 
-	PointerRegion pointer_region;
-	int region_result = xi2_device_get_region(device, &valuator_indices, &pointer_region);
+	states = calloc(list.count, sizeof(*states));
+	results = calloc(list.count, sizeof(*results));
+	if (!states || !results) {
+		fprintf(stderr, "Out of memory.\n");
+		goto done;
+	}
 
-	if (region_result) {
-		XCloseDisplay(display);
-		fprintf(stderr, "Failed to retrieve region from device.\n");
-		return -1;
+	xrestrict_context_devices(&context, list.targets, states, results, list.count);
+
+	for (int i = 0; i < list.count; i++) {
+		int device_id = list.targets[i].device_id;
+
+		if (results[i] == EDEVICE_NOT_FOUND) {
+			fprintf(stderr, "Failed to query device %d.\n", device_id);
+		} else if (results[i] == EDEVICE_NO_VALUATORS) {
+			fprintf(stderr, "Failed to find absolute X and Y valuators for device %d.\n", device_id);
+		} else if (results[i]) {
+			fprintf(stderr, "Failed to retrieve region from device %d.\n", device_id);
+		}
 	}
 
-	CRTCRegion * region;
-	Rectangle input_region = pointer_region.region;
-	if (full_screen) {
-		region = &screen_size;
-	} else {
-		region = crtc_regions + crtc_index;
+	if (record_path) {
+		int record_result = results[0];
+		if (!record_result) {
+			record_result = record_run(display, topology, states, record_path);
+		}
 
-		if (one_to_one) {
-			resources = XRRGetScreenResourcesCurrent(display, DefaultRootWindow(display));
-			int output_result = xlib_get_crtc_output_density(display, resources, region);
-			XRRFreeScreenResources(resources);
+		if (record_result == ERECORD_OPEN || record_result == ERECORD_WRITE) {
+			fprintf(stderr, "Failed to write recording \"%s\".\n", record_path);
+		} else if (record_result == ERECORD_NO_MATRIX) {
+			fprintf(stderr, "Failed to read the Coordinate Transformation Matrix of device %d.\n", list.targets[0].device_id);
+		} else if (record_result == ERECORD_NO_XINPUT) {
+			fprintf(stderr, "The X server lacks the XInputExtension.\n");
+		}
 
-			if (output_result) {
-				XCloseDisplay(display);
-				fprintf(stderr, "Failed to retrieve CRTC %d output density.\n", (int)region->crtc);
-				return -1;
-			}
+		result = record_result ? -1 : 0;
+		goto done;
+	}
 
-			input_region = region->region;
+	if (calibrate) {
+		// Device query failures were reported above
+		int calibrate_result = results[0];
+		if (!calibrate_result) {
+			calibrate_result = calibrate_run(display, topology, list.targets, states, mode);
 
-			input_region.right = input_region.left + 1000L * RECT_WIDTH(region->region) * RECT_WIDTH(pointer_region.region) / pointer_region.hres / region->width;
-			input_region.bottom = input_region.top + 1000L * RECT_HEIGHT(region->region) * RECT_HEIGHT(pointer_region.region) / pointer_region.vres / region->height;
+			if (calibrate_result == ETARGET_CRTC_OUT_OF_RANGE) {
+				fprintf(stderr, "CRTC index %d greater than highest index available %d.\n", list.targets[0].crtc_index, topology->region_count - 1);
+			} else if (calibrate_result == ETARGET_OUTPUT_NOT_FOUND) {
+				fprintf(stderr, "No monitor is connected to output \"%s\".\n", list.targets[0].output);
+			} else if (calibrate_result == ECALIBRATE_NO_XINPUT) {
+				fprintf(stderr, "The X server lacks the XInputExtension.\n");
+			} else if (calibrate_result == ECALIBRATE_WINDOW) {
+				fprintf(stderr, "Failed to show the calibration targets.\n");
+			} else if (calibrate_result == ECALIBRATE_INTERRUPTED) {
+				fprintf(stderr, "Calibration cancelled, the matrix was left as it was.\n");
+			} else if (calibrate_result == ECALIBRATE_DEGENERATE) {
+				fprintf(stderr, "The touches were too close together to fit a matrix, try again touching the center of each target.\n");
+			} else if (calibrate_result == ECALIBRATE_WRITE) {
+				fprintf(stderr, "Failed to set the Coordinate Transformation Matrix of device %d.\n", list.targets[0].device_id);
+			}
 		}
+
+		result = calibrate_result ? -1 : 0;
+		goto done;
 	}
 
-	float matrix[9] = {0.0};
+	if (monitor) {
+		// Devices which failed to be queried were reported above and are left out
+		int monitor_result = monitor_run(display, topology, list.targets, states, list.count, stdout);
 
-	calc_matrix(device_id, &config, &(screen_size.region), region, &input_region, matrix);
+		if (monitor_result == ETARGET_CRTC_OUT_OF_RANGE) {
+			fprintf(stderr, "CRTC index greater than highest index available %d.\n", topology->region_count - 1);
+		} else if (monitor_result == ETARGET_OUTPUT_NOT_FOUND) {
+			fprintf(stderr, "No monitor is connected to one of the outputs.\n");
+		} else if (monitor_result == EMONITOR_NO_XINPUT) {
+			fprintf(stderr, "The X server lacks the XInputExtension.\n");
+		} else if (monitor_result == EMONITOR_NO_DEVICES) {
+			fprintf(stderr, "None of the devices could be monitored.\n");
+		} else if (monitor_result == EMONITOR_ALLOCATION) {
+			fprintf(stderr, "Out of memory.\n");
+		} else if (monitor_result) {
+			fprintf(stderr, "Failed to wait for events.\n");
+		}
 
-	if (!dry_run) {
-		int set_matrix_results = xi2_device_set_matrix(display, device_id, matrix);
+		result = monitor_result ? -1 : 0;
+		goto done;
+	}
 
-		if (set_matrix_results) {
-			XCloseDisplay(display);
-			fprintf(stderr, "Failed to set Coordinate Transformation Matrix for device %d.\n", device_id);
-			return -1;
+	int failures = xrestrict_context_apply(&context, list.targets, results, list.count, mode);
+
+	if (list.count > 1) {
+		for (int i = 0; i < list.count; i++) {
+			printf("Device %d: %s\n", list.targets[i].device_id, results[i] ? "failed" : "ok");
 		}
+	}
 
-		set_matrix_results =  xi2_device_check_matrix(display, device_id, matrix);
+	if (failures && !run_daemon && !follow) {
+		goto done;
+	}
 
-		if (set_matrix_results) {
-			XCloseDisplay(display);
-			fprintf(stderr, "Failed to set Coordinate Transformation Matrix for device %d.\n", device_id);
-			return -1;
+	if (run_daemon) {
+		int daemon_result = daemon_run(&context, list.targets, list.count, mode);
+		if (daemon_result) {
+			fprintf(stderr, "Failed to monitor the display for changes.\n");
+			goto done;
 		}
-	} else {
-		printf("Coordinate Transformation Matrix = %f", matrix[0]);
-		for (float * x = matrix + 1; x < (matrix + 9); x++) {
-			printf(" %f", *x);
+	}
+
+	if (follow) {
+		int follow_result = follow_run(&context, list.targets, list.count, mode);
+		if (follow_result) {
+			fprintf(stderr, "Failed to follow the pointer.\n");
+			goto done;
 		}
-		printf("\n");
 	}
 
-	return 0;
+	result = 0;
+
+done:
+	free(states);
+	free(results);
+	free(list.targets);
+	seats_free(seats, seat_count);
+	if (context.display) {
+		close_context(&context);
+	} else if (display) {
+		close_display(display);
+	}
+	return result;
 }